@@ -25,10 +25,10 @@
 #	include "config.h"
 #endif
 
-#include <ctype.h>
 #include <math.h>
 
 #include "geanyplugin.h"
+#include "exportwriter.h"
 
 
 GeanyData		*geany_data;
@@ -85,16 +85,6 @@ static GtkWidget *main_menu_item = NULL;
 \\end{document}\n"
 
 
-enum
-{
-	FORE = 0,
-	BACK,
-	BOLD,
-	ITALIC,
-	USED,
-	MAX_TYPES
-};
-
 enum
 {
 	DATE_TYPE_DEFAULT,
@@ -132,24 +122,6 @@ static gchar* get_tex_rgb(gint rgb_colour)
 }
 
 
-/* convert a style number (0..127) into a string representation (aa, ab, .., ba, bb, .., zy, zz) */
-static gchar *get_tex_style(gint style)
-{
-	static gchar buf[4];
-	int i = 0;
-
-	do
-	{
-		buf[i] = (style % 26) + 'a';
-		style /= 26;
-		i++;
-	} while (style > 0);
-	buf[i] = '\0';
-
-	return buf;
-}
-
-
 static void create_file_save_as_dialog(const gchar *extension, ExportFunc func,
 									   gboolean show_zoom_level_checkbox)
 {
@@ -271,10 +243,29 @@ static void on_menu_create_html_activate(GtkMenuItem *menuitem, gpointer user_da
 }
 
 
-static void write_data(const gchar *filename, const gchar *data)
+/* Adds the part of a template before or after {export_content} */
+static void writer_append_template(ExportWriter *w, const gchar *part, gsize len,
+		GeanyDocument *doc, const gchar *styles, const gchar *date)
+{
+	GString *str = g_string_new_len(part, len);
+
+	utils_string_replace_all(str, "{export_styles}", styles);
+	utils_string_replace_all(str, "{export_date}", date);
+	if (doc->file_name == NULL)
+		utils_string_replace_all(str, "{export_filename}", GEANY_STRING_UNTITLED);
+	else
+		utils_string_replace_all(str, "{export_filename}", doc->file_name);
+
+	g_string_append_len(w->buf, str->str, str->len);
+	g_string_free(str, TRUE);
+}
+
+
+/* Finishes writing the file and reports the result */
+static void writer_close(ExportWriter *w, const gchar *filename)
 {
-	gint error_nr = utils_write_file(filename, data);
 	gchar *utf8_filename = utils_get_utf8_from_locale(filename);
+	gint error_nr = export_writer_close(w);
 
 	if (error_nr == 0)
 		ui_set_statusbar(TRUE, _("Document successfully exported as '%s'."), utf8_filename);
@@ -344,39 +335,27 @@ static void on_file_save_dialog_response(GtkDialog *dialog, gint response, gpoin
 }
 
 
-/* returns the "width" (count of needed characters) for the given number */
-static gint get_line_numbers_arity(gint line_number)
-{
-	gint a = 0;
-	while ((line_number /= 10) != 0)
-		a++;
-	return a;
-}
-
-
-static gint get_line_number_width(GeanyDocument *doc)
-{
-	gint line_count = sci_get_line_count(doc->editor->sci);
-	return get_line_numbers_arity(line_count);
-}
-
-
 static void write_latex_file(GeanyDocument *doc, const gchar *filename,
 	gboolean use_zoom, gboolean insert_line_numbers)
 {
 	GeanyEditor *editor = doc->editor;
 	ScintillaObject *sci = doc->editor->sci;
-	gint i, doc_len, style = -1, old_style = 0, column = 0;
-	gint k, line_number, line_number_width, line_number_max_width = 0, pad;
-	gchar c, c_next, *tmp, *date;
+	gint i;
+	gint tab_width = sci_get_tab_width(editor->sci);
+	gchar *tmp, *date;
+	const gchar *content;
 	/* 0 - fore, 1 - back, 2 - bold, 3 - italic, 4 - font size, 5 - used(0/1) */
 	gint styles[STYLE_MAX + 1][MAX_TYPES];
-	gboolean block_open = FALSE;
-	GString *body;
 	GString *cmds;
-	GString *latex;
+	ExportWriter writer;
 	gint style_max = pow(2, scintilla_send_message(sci, SCI_GETSTYLEBITS, 0, 0));
 
+	if (! export_writer_open(&writer, filename))
+	{
+		writer_close(&writer, filename);
+		return;
+	}
+
 	/* first read all styles from Scintilla */
 	for (i = 0; i < style_max; i++)
 	{
@@ -386,158 +365,7 @@ static void write_latex_file(GeanyDocument *doc, const gchar *filename,
 		styles[i][ITALIC] = scintilla_send_message(sci, SCI_STYLEGETITALIC, i, 0);
 		styles[i][USED] = 0;
 	}
-
-	if (insert_line_numbers)
-		line_number_max_width = get_line_number_width(doc);
-
-	/* read the document and write the LaTeX code */
-	body = g_string_new("");
-	doc_len = sci_get_length(sci);
-	for (i = 0; i <= doc_len; i++)
-	{
-		style = sci_get_style_at(sci, i);
-		c = sci_get_char_at(sci, i);
-		c_next = sci_get_char_at(sci, i + 1);
-
-		/* line numbers */
-		if (insert_line_numbers && column == 0)
-		{
-			line_number = sci_get_line_from_position(sci, i) + 1;
-			line_number_width = get_line_numbers_arity(line_number);
-			/* padding */
-			pad = line_number_max_width - line_number_width;
-			for (k = 0; k < pad; k++)
-			{
-				g_string_append(body, " ");
-			}
-			g_string_append_printf(body, "%d ", line_number);
-		}
-
-		if (style != old_style || ! block_open)
-		{
-			old_style = style;
-			styles[style][USED] = 1;
-			if (block_open)
-			{
-				g_string_append(body, "}\n");
-				block_open = FALSE;
-			}
-			if (i < doc_len)
-			{
-				g_string_append_printf(body, "\\style%s{", get_tex_style(style));
-				block_open = TRUE;
-			}
-		}
-		/* escape the current character if necessary else just add it */
-		switch (c)
-		{
-			case '\r':
-			case '\n':
-			{
-				if (c == '\r' && c_next == '\n')
-					continue; /* when using CR/LF skip CR and add the line break with LF */
-
-				if (block_open)
-				{
-					g_string_append(body, "}");
-					block_open = FALSE;
-				}
-				g_string_append(body, " \\\\\n");
-				column = -1;
-				break;
-			}
-			case '\t':
-			{
-				gint tab_width = sci_get_tab_width(editor->sci);
-				gint tab_stop = tab_width - (column % tab_width);
-
-				column += tab_stop - 1; /* -1 because we add 1 at the end of the loop */
-				g_string_append_printf(body, "\\hspace*{%dem}", tab_stop);
-				break;
-			}
-			case ' ':
-			{
-				if (c_next == ' ')
-				{
-					g_string_append(body, "{\\hspace*{1em}}");
-					i++; /* skip the next character */
-				}
-				else
-					g_string_append_c(body, ' ');
-				break;
-			}
-			case '{':
-			case '}':
-			case '_':
-			case '&':
-			case '$':
-			case '#':
-			case '%':
-			{
-				g_string_append_printf(body, "\\%c", c);
-				break;
-			}
-			case '\\':
-			{
-				g_string_append(body, "\\symbol{92}");
-				break;
-			}
-			case '~':
-			{
-				g_string_append(body, "\\symbol{126}");
-				break;
-			}
-			case '^':
-			{
-				g_string_append(body, "\\symbol{94}");
-				break;
-			}
-			/** TODO still don't work for "---" or "----" */
-			case '-':  /* mask "--" */
-			{
-				if (c_next == '-')
-				{
-					g_string_append(body, "-\\/-");
-					i++; /* skip the next character */
-				}
-				else
-					g_string_append_c(body, '-');
-
-				break;
-			}
-			case '<':  /* mask "<<" */
-			{
-				if (c_next == '<')
-				{
-					g_string_append(body, "<\\/<");
-					i++; /* skip the next character */
-				}
-				else
-					g_string_append_c(body, '<');
-
-				break;
-			}
-			case '>':  /* mask ">>" */
-			{
-				if (c_next == '>')
-				{
-					g_string_append(body, ">\\/>");
-					i++; /* skip the next character */
-				}
-				else
-					g_string_append_c(body, '>');
-
-				break;
-			}
-			default: g_string_append_c(body, c);
-		}
-		column++;
-	}
-	if (block_open)
-	{
-		g_string_append(body, "}\n");
-		block_open = FALSE;
-	}
+	export_read_used_styles(sci, styles, FALSE);
 
 	/* force writing of style 0 (used at least for line breaks) */
 	styles[0][USED] = 1;
@@ -549,7 +377,7 @@ static void write_latex_file(GeanyDocument *doc, const gchar *filename,
 		if (styles[i][USED])
 		{
 			g_string_append_printf(cmds,
-				"\\newcommand{\\style%s}[1]{\\noindent{", get_tex_style(i));
+				"\\newcommand{\\style%s}[1]{\\noindent{", export_get_tex_style(i));
 			if (styles[i][BOLD])
 				g_string_append(cmds, "\\textbf{");
 			if (styles[i][ITALIC])
@@ -572,21 +400,17 @@ static void write_latex_file(GeanyDocument *doc, const gchar *filename,
 	}
 
 	date = get_date(DATE_TYPE_DEFAULT);
-	/* write all */
-	latex = g_string_new(TEMPLATE_LATEX);
-	utils_string_replace_all(latex, "{export_content}", body->str);
-	utils_string_replace_all(latex, "{export_styles}", cmds->str);
-	utils_string_replace_all(latex, "{export_date}", date);
-	if (doc->file_name == NULL)
-		utils_string_replace_all(latex, "{export_filename}", GEANY_STRING_UNTITLED);
-	else
-		utils_string_replace_all(latex, "{export_filename}", doc->file_name);
+	content = strstr(TEMPLATE_LATEX, "{export_content}");
+	writer_append_template(&writer, TEMPLATE_LATEX, content - TEMPLATE_LATEX, doc, cmds->str, date);
 
-	write_data(filename, latex->str);
+	/* read the document and write the LaTeX code */
+	export_write_latex_body(&writer, sci, tab_width, insert_line_numbers);
+
+	content += strlen("{export_content}");
+	writer_append_template(&writer, content, strlen(content), doc, cmds->str, date);
+	writer_close(&writer, filename);
 
-	g_string_free(body, TRUE);
 	g_string_free(cmds, TRUE);
-	g_string_free(latex, TRUE);
 	g_free(date);
 }
 
@@ -596,20 +420,25 @@ static void write_html_file(GeanyDocument *doc, const gchar *filename,
 {
 	GeanyEditor *editor = doc->editor;
 	ScintillaObject *sci = doc->editor->sci;
-	gint i, doc_len, style = -1, old_style = 0, column = 0;
-	gint k, line_number, line_number_width, line_number_max_width = 0, pad;
-	gchar c, c_next, *date;
+	gint i;
+	gint tab_width = sci_get_tab_width(editor->sci);
+	gchar *date;
+	const gchar *content;
 	/* 0 - fore, 1 - back, 2 - bold, 3 - italic, 4 - font size, 5 - used(0/1) */
 	gint styles[STYLE_MAX + 1][MAX_TYPES];
-	gboolean span_open = FALSE;
 	const gchar *font_name;
 	gint font_size;
 	PangoFontDescription *font_desc;
-	GString *body;
 	GString *css;
-	GString *html;
+	ExportWriter writer;
 	gint style_max = pow(2, scintilla_send_message(sci, SCI_GETSTYLEBITS, 0, 0));
 
+	if (! export_writer_open(&writer, filename))
+	{
+		writer_close(&writer, filename);
+		return;
+	}
+
 	/* first read all styles from Scintilla */
 	for (i = 0; i < style_max; i++)
 	{
@@ -619,6 +448,8 @@ static void write_html_file(GeanyDocument *doc, const gchar *filename,
 		styles[i][ITALIC] = scintilla_send_message(sci, SCI_STYLEGETITALIC, i, 0);
 		styles[i][USED] = 0;
 	}
+	/* spans are only started at non-whitespace characters */
+	export_read_used_styles(sci, styles, TRUE);
 
 	/* read Geany's font and font size */
 	font_desc = pango_font_description_from_string(geany->interface_prefs->editor_font);
@@ -629,108 +460,6 @@ static void write_html_file(GeanyDocument *doc, const gchar *filename,
 	if (use_zoom)
 		font_size += scintilla_send_message(sci, SCI_GETZOOM, 0, 0);
 
-	if (insert_line_numbers)
-		line_number_max_width = get_line_number_width(doc);
-
-	/* read the document and write the HTML body */
-	body = g_string_new("");
-	doc_len = sci_get_length(sci);
-	for (i = 0; i <= doc_len; i++)
-	{
-		style = sci_get_style_at(sci, i);
-		c = sci_get_char_at(sci, i);
-		/* sci_get_char_at() takes care of index boundaries and return 0 if i is too high */
-		c_next = sci_get_char_at(sci, i + 1);
-
-		/* line numbers */
-		if (insert_line_numbers && column == 0)
-		{
-			line_number = sci_get_line_from_position(sci, i) + 1;
-			line_number_width = get_line_numbers_arity(line_number);
-			/* padding */
-			pad = line_number_max_width - line_number_width;
-			for (k = 0; k < pad; k++)
-			{
-				g_string_append(body, "&nbsp;");
-			}
-			g_string_append_printf(body, "%d&nbsp;", line_number);
-		}
-
-		if ((style != old_style || ! span_open) && ! isspace(c))
-		{
-			old_style = style;
-			styles[style][USED] = 1;
-			if (span_open)
-			{
-				g_string_append(body, "</span>");
-			}
-			if (i < doc_len)
-			{
-				g_string_append_printf(body, "<span class=\"style_%d\">", style);
-				span_open = TRUE;
-			}
-		}
-		/* escape the current character if necessary else just add it */
-		switch (c)
-		{
-			case '\r':
-			case '\n':
-			{
-				if (c == '\r' && c_next == '\n')
-					continue; /* when using CR/LF skip CR and add the line break with LF */
-
-				if (span_open)
-				{
-					g_string_append(body, "</span>");
-					span_open = FALSE;
-				}
-				g_string_append(body, "<br />\n");
-				column = -1;
-				break;
-			}
-			case '\t':
-			{
-				gint j;
-				gint tab_width = sci_get_tab_width(editor->sci);
-				gint tab_stop = tab_width - (column % tab_width);
-
-				column += tab_stop - 1; /* -1 because we add 1 at the end of the loop */
-				for (j = 0; j < tab_stop; j++)
-				{
-					g_string_append(body, "&nbsp;");
-				}
-				break;
-			}
-			case ' ':
-			{
-				g_string_append(body, "&nbsp;");
-				break;
-			}
-			case '<':
-			{
-				g_string_append(body, "&lt;");
-				break;
-			}
-			case '>':
-			{
-				g_string_append(body, "&gt;");
-				break;
-			}
-			case '&':
-			{
-				g_string_append(body, "&amp;");
-				break;
-			}
-			default: g_string_append_c(body, c);
-		}
-		column++;
-	}
-	if (span_open)
-	{
-		g_string_append(body, "</span>");
-		span_open = FALSE;
-	}
-
 	/* write used styles in the header */
 	css = g_string_new("");
 	g_string_append_printf(css,
@@ -750,22 +479,18 @@ static void write_html_file(GeanyDocument *doc, const gchar *filename,
 	}
 
 	date = get_date(DATE_TYPE_HTML);
-	/* write all */
-	html = g_string_new(TEMPLATE_HTML);
-	utils_string_replace_all(html, "{export_date}", date);
-	utils_string_replace_all(html, "{export_content}", body->str);
-	utils_string_replace_all(html, "{export_styles}", css->str);
-	if (doc->file_name == NULL)
-		utils_string_replace_all(html, "{export_filename}", GEANY_STRING_UNTITLED);
-	else
-		utils_string_replace_all(html, "{export_filename}", doc->file_name);
+	content = strstr(TEMPLATE_HTML, "{export_content}");
+	writer_append_template(&writer, TEMPLATE_HTML, content - TEMPLATE_HTML, doc, css->str, date);
+
+	/* read the document and write the HTML body */
+	export_write_html_body(&writer, sci, tab_width, insert_line_numbers);
 
-	write_data(filename, html->str);
+	content += strlen("{export_content}");
+	writer_append_template(&writer, content, strlen(content), doc, css->str, date);
+	writer_close(&writer, filename);
 
 	pango_font_description_free(font_desc);
-	g_string_free(body, TRUE);
 	g_string_free(css, TRUE);
-	g_string_free(html, TRUE);
 	g_free(date);
 }
 
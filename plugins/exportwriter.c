@@ -0,0 +1,476 @@
+/*
+ *      exportwriter.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2007-2012 Enrico Tröger <enrico(dot)troeger(at)uvena(dot)de>
+ *      Copyright 2007-2012 Nick Treleaven <nick(dot)treleaven(at)btinternet(dot)com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Reads the styled text of a document in chunks and writes the body of the HTML and LaTeX
+ * exports, see exportwriter.h. */
+
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include "exportwriter.h"
+
+
+/* number of characters read from Scintilla at once */
+#define EXPORT_CHUNK_SIZE 65536
+/* size from which buffered output is written to the file */
+#define EXPORT_BUFFER_SIZE 65536
+
+
+/* Reads characters and their styles in chunks with SCI_GETSTYLEDTEXT */
+typedef struct
+{
+	ScintillaObject	*sci;
+	gint			 doc_len;
+	gint			 start;		/* document position of the first buffered character */
+	gint			 len;		/* number of buffered characters */
+	gchar			*buf;		/* pairs of character and style */
+}
+StyledTextReader;
+
+
+static void reader_init(StyledTextReader *r, ScintillaObject *sci)
+{
+	r->sci = sci;
+	r->doc_len = scintilla_send_message(sci, SCI_GETLENGTH, 0, 0);
+	r->start = 0;
+	r->len = 0;
+	r->buf = g_malloc(EXPORT_CHUNK_SIZE * 2 + 2);
+}
+
+
+static void reader_fill(StyledTextReader *r, gint pos)
+{
+	struct Sci_TextRange tr;
+
+	r->start = pos;
+	r->len = MIN(EXPORT_CHUNK_SIZE, r->doc_len - pos);
+	tr.chrg.cpMin = pos;
+	tr.chrg.cpMax = pos + r->len;
+	tr.lpstrText = r->buf;
+	scintilla_send_message(r->sci, SCI_GETSTYLEDTEXT, 0, (sptr_t) &tr);
+}
+
+
+/* Returns the character at pos, or 0 at the end of the document, and sets its style
+ * if style is not NULL. Reading forwards only refills the buffer once per chunk. */
+static gchar reader_get(StyledTextReader *r, gint pos, gint *style)
+{
+	gint i;
+
+	if (pos >= r->doc_len)
+	{
+		if (style != NULL)
+			*style = 0;
+		return '\0';
+	}
+	if (pos < r->start || pos >= r->start + r->len)
+		reader_fill(r, pos);
+
+	i = (pos - r->start) * 2;
+	if (style != NULL)
+		*style = (guchar) r->buf[i + 1];
+	return r->buf[i];
+}
+
+
+static void reader_free(StyledTextReader *r)
+{
+	g_free(r->buf);
+}
+
+
+/* Marks the styles used by the document, only for non-whitespace characters if skip_spaces
+ * is set. This is needed before the text is written because the header defines the styles. */
+void export_read_used_styles(ScintillaObject *sci, gint styles[][MAX_TYPES], gboolean skip_spaces)
+{
+	StyledTextReader r;
+	gint i, style;
+
+	reader_init(&r, sci);
+	for (i = 0; i < r.doc_len; i++)
+	{
+		gchar c = reader_get(&r, i, &style);
+
+		if (! skip_spaces || ! isspace(c))
+			styles[style][USED] = 1;
+	}
+	reader_free(&r);
+}
+
+
+gboolean export_writer_open(ExportWriter *w, const gchar *filename)
+{
+	w->buf = g_string_sized_new(EXPORT_BUFFER_SIZE + 1024);
+	w->error_nr = 0;
+	errno = 0;
+	w->fp = g_fopen(filename, "w");
+	if (w->fp == NULL)
+		w->error_nr = errno;
+	return w->fp != NULL;
+}
+
+
+static void writer_flush(ExportWriter *w)
+{
+	if (w->buf->len > 0 && w->error_nr == 0)
+	{
+		errno = 0;
+		if (fwrite(w->buf->str, 1, w->buf->len, w->fp) != w->buf->len)
+			w->error_nr = errno ? errno : EIO;
+	}
+	g_string_truncate(w->buf, 0);
+}
+
+
+/* Writes the output if enough has been buffered */
+void export_writer_check_flush(ExportWriter *w)
+{
+	if (w->buf->len >= EXPORT_BUFFER_SIZE)
+		writer_flush(w);
+}
+
+
+/* Writes the remaining output, closes the file and frees w.
+ * Returns: 0, or the errno value of the first error. */
+gint export_writer_close(ExportWriter *w)
+{
+	if (w->fp != NULL)
+	{
+		writer_flush(w);
+		errno = 0;
+		if (fclose(w->fp) != 0 && w->error_nr == 0)
+			w->error_nr = errno;
+	}
+	g_string_free(w->buf, TRUE);
+	return w->error_nr;
+}
+
+
+/* returns the "width" (count of needed characters) for the given number */
+static gint get_line_numbers_arity(gint line_number)
+{
+	gint a = 0;
+	while ((line_number /= 10) != 0)
+		a++;
+	return a;
+}
+
+
+static gint get_line_number_width(ScintillaObject *sci)
+{
+	gint line_count = scintilla_send_message(sci, SCI_GETLINECOUNT, 0, 0);
+	return get_line_numbers_arity(line_count);
+}
+
+
+static void append_line_number(GString *body, gint line_number, gint max_width, const gchar *space)
+{
+	gint k;
+	/* padding */
+	gint pad = max_width - get_line_numbers_arity(line_number);
+
+	for (k = 0; k < pad; k++)
+	{
+		g_string_append(body, space);
+	}
+	g_string_append_printf(body, "%d%s", line_number, space);
+}
+
+
+/* convert a style number (0..127) into a string representation (aa, ab, .., ba, bb, .., zy, zz) */
+const gchar *export_get_tex_style(gint style)
+{
+	static gchar buf[4];
+	int i = 0;
+
+	do
+	{
+		buf[i] = (style % 26) + 'a';
+		style /= 26;
+		i++;
+	} while (style > 0);
+	buf[i] = '\0';
+
+	return buf;
+}
+
+
+/* Writes the LaTeX code of the text of sci, the styles used must have been defined */
+void export_write_latex_body(ExportWriter *w, ScintillaObject *sci, gint tab_width,
+		gboolean insert_line_numbers)
+{
+	gint i, doc_len, style = -1, old_style = 0, column = 0;
+	gint line_number = 1, line_number_max_width = 0;
+	gchar c, c_next;
+	gboolean block_open = FALSE;
+	GString *body = w->buf;
+	StyledTextReader reader;
+
+	if (insert_line_numbers)
+		line_number_max_width = get_line_number_width(sci);
+
+	reader_init(&reader, sci);
+	doc_len = reader.doc_len;
+	for (i = 0; i < doc_len; i++)
+	{
+		c = reader_get(&reader, i, &style);
+		c_next = reader_get(&reader, i + 1, NULL);
+
+		/* line numbers */
+		if (insert_line_numbers && column == 0)
+			append_line_number(body, line_number, line_number_max_width, " ");
+
+		if (style != old_style || ! block_open)
+		{
+			old_style = style;
+			if (block_open)
+			{
+				g_string_append(body, "}\n");
+				block_open = FALSE;
+			}
+			g_string_append_printf(body, "\\style%s{", export_get_tex_style(style));
+			block_open = TRUE;
+		}
+		/* escape the current character if necessary else just add it */
+		switch (c)
+		{
+			case '\r':
+			case '\n':
+			{
+				if (c == '\r' && c_next == '\n')
+					continue; /* when using CR/LF skip CR and add the line break with LF */
+
+				if (block_open)
+				{
+					g_string_append(body, "}");
+					block_open = FALSE;
+				}
+				g_string_append(body, " \\\\\n");
+				column = -1;
+				line_number++;
+				break;
+			}
+			case '\t':
+			{
+				gint tab_stop = tab_width - (column % tab_width);
+
+				column += tab_stop - 1; /* -1 because we add 1 at the end of the loop */
+				g_string_append_printf(body, "\\hspace*{%dem}", tab_stop);
+				break;
+			}
+			case ' ':
+			{
+				if (c_next == ' ')
+				{
+					g_string_append(body, "{\\hspace*{1em}}");
+					i++; /* skip the next character */
+				}
+				else
+					g_string_append_c(body, ' ');
+				break;
+			}
+			case '{':
+			case '}':
+			case '_':
+			case '&':
+			case '$':
+			case '#':
+			case '%':
+			{
+				g_string_append_printf(body, "\\%c", c);
+				break;
+			}
+			case '\\':
+			{
+				g_string_append(body, "\\symbol{92}");
+				break;
+			}
+			case '~':
+			{
+				g_string_append(body, "\\symbol{126}");
+				break;
+			}
+			case '^':
+			{
+				g_string_append(body, "\\symbol{94}");
+				break;
+			}
+			/** TODO still don't work for "---" or "----" */
+			case '-':  /* mask "--" */
+			{
+				if (c_next == '-')
+				{
+					g_string_append(body, "-\\/-");
+					i++; /* skip the next character */
+				}
+				else
+					g_string_append_c(body, '-');
+
+				break;
+			}
+			case '<':  /* mask "<<" */
+			{
+				if (c_next == '<')
+				{
+					g_string_append(body, "<\\/<");
+					i++; /* skip the next character */
+				}
+				else
+					g_string_append_c(body, '<');
+
+				break;
+			}
+			case '>':  /* mask ">>" */
+			{
+				if (c_next == '>')
+				{
+					g_string_append(body, ">\\/>");
+					i++; /* skip the next character */
+				}
+				else
+					g_string_append_c(body, '>');
+
+				break;
+			}
+			default: g_string_append_c(body, c);
+		}
+		column++;
+		export_writer_check_flush(w);
+	}
+	/* the number of the empty line after a final line break */
+	if (insert_line_numbers && column == 0)
+		append_line_number(body, line_number, line_number_max_width, " ");
+	if (block_open)
+	{
+		g_string_append(body, "}\n");
+		block_open = FALSE;
+	}
+	reader_free(&reader);
+}
+
+
+/* Writes the HTML code of the text of sci, the styles used must have been defined */
+void export_write_html_body(ExportWriter *w, ScintillaObject *sci, gint tab_width,
+		gboolean insert_line_numbers)
+{
+	gint i, doc_len, style = -1, old_style = 0, column = 0;
+	gint line_number = 1, line_number_max_width = 0;
+	gchar c, c_next;
+	gboolean span_open = FALSE;
+	GString *body = w->buf;
+	StyledTextReader reader;
+
+	if (insert_line_numbers)
+		line_number_max_width = get_line_number_width(sci);
+
+	reader_init(&reader, sci);
+	doc_len = reader.doc_len;
+	for (i = 0; i < doc_len; i++)
+	{
+		c = reader_get(&reader, i, &style);
+		c_next = reader_get(&reader, i + 1, NULL);
+
+		/* line numbers */
+		if (insert_line_numbers && column == 0)
+			append_line_number(body, line_number, line_number_max_width, "&nbsp;");
+
+		if ((style != old_style || ! span_open) && ! isspace(c))
+		{
+			old_style = style;
+			if (span_open)
+			{
+				g_string_append(body, "</span>");
+			}
+			g_string_append_printf(body, "<span class=\"style_%d\">", style);
+			span_open = TRUE;
+		}
+		/* escape the current character if necessary else just add it */
+		switch (c)
+		{
+			case '\r':
+			case '\n':
+			{
+				if (c == '\r' && c_next == '\n')
+					continue; /* when using CR/LF skip CR and add the line break with LF */
+
+				if (span_open)
+				{
+					g_string_append(body, "</span>");
+					span_open = FALSE;
+				}
+				g_string_append(body, "<br />\n");
+				column = -1;
+				line_number++;
+				break;
+			}
+			case '\t':
+			{
+				gint j;
+				gint tab_stop = tab_width - (column % tab_width);
+
+				column += tab_stop - 1; /* -1 because we add 1 at the end of the loop */
+				for (j = 0; j < tab_stop; j++)
+				{
+					g_string_append(body, "&nbsp;");
+				}
+				break;
+			}
+			case ' ':
+			{
+				g_string_append(body, "&nbsp;");
+				break;
+			}
+			case '<':
+			{
+				g_string_append(body, "&lt;");
+				break;
+			}
+			case '>':
+			{
+				g_string_append(body, "&gt;");
+				break;
+			}
+			case '&':
+			{
+				g_string_append(body, "&amp;");
+				break;
+			}
+			default: g_string_append_c(body, c);
+		}
+		column++;
+		export_writer_check_flush(w);
+	}
+	/* the number of the empty line after a final line break */
+	if (insert_line_numbers && column == 0)
+		append_line_number(body, line_number, line_number_max_width, "&nbsp;");
+	if (span_open)
+	{
+		g_string_append(body, "</span>");
+		span_open = FALSE;
+	}
+	reader_free(&reader);
+}
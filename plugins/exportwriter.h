@@ -0,0 +1,72 @@
+/*
+ *      exportwriter.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2007-2012 Enrico Tröger <enrico(dot)troeger(at)uvena(dot)de>
+ *      Copyright 2007-2012 Nick Treleaven <nick(dot)treleaven(at)btinternet(dot)com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* The parts of the Export plugin which only need Scintilla, so that scripts/export_bench.c
+ * can run them without Geany. */
+
+#ifndef GEANY_EXPORT_WRITER_H
+#define GEANY_EXPORT_WRITER_H 1
+
+#include <stdio.h>
+
+#include <gtk/gtk.h>
+
+#include "Scintilla.h"
+#include "ScintillaWidget.h"
+
+
+enum
+{
+	FORE = 0,
+	BACK,
+	BOLD,
+	ITALIC,
+	USED,
+	MAX_TYPES
+};
+
+/* Buffers the output and writes it to the file from time to time */
+typedef struct
+{
+	FILE		*fp;
+	GString		*buf;
+	gint		 error_nr;
+}
+ExportWriter;
+
+
+gboolean export_writer_open(ExportWriter *w, const gchar *filename);
+
+void export_writer_check_flush(ExportWriter *w);
+
+gint export_writer_close(ExportWriter *w);
+
+void export_read_used_styles(ScintillaObject *sci, gint styles[][MAX_TYPES], gboolean skip_spaces);
+
+const gchar *export_get_tex_style(gint style);
+
+void export_write_latex_body(ExportWriter *w, ScintillaObject *sci, gint tab_width,
+		gboolean insert_line_numbers);
+
+void export_write_html_body(ExportWriter *w, ScintillaObject *sci, gint tab_width,
+		gboolean insert_line_numbers);
+
+#endif
@@ -31,10 +31,6 @@
 
 #include <gdk/gdkkeysyms.h>
 
-#ifdef G_OS_WIN32
-# include <windows.h>
-#endif
-
 GeanyPlugin *geany_plugin;
 GeanyData *geany_data;
 GeanyFunctions *geany_functions;
@@ -73,7 +69,6 @@ static gboolean hide_object_files = TRUE;
 static GtkWidget *file_view_vbox;
 static GtkWidget *file_view;
 static GtkListStore *file_store;
-static GtkTreeIter *last_dir_iter = NULL;
 static GtkEntryCompletion *entry_completion = NULL;
 
 static GtkWidget *filter_combo;
@@ -108,54 +103,63 @@ PluginCallback plugin_callbacks[] =
 };
 
 
-#ifdef G_OS_WIN32
-static gboolean win32_check_hidden(const gchar *filename)
+/* Directory listings are read asynchronously in batches and kept in a small cache of the
+ * recently shown directories, which is updated by a file monitor instead of relisting.
+ * The rows of the current directory are added in chunks from an idle callback at their
+ * sorted position, so that the view stays responsive for large or slow directories. */
+
+#define LIST_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP
+#define LIST_BATCH_SIZE 256		/* files requested from the enumerator at once */
+#define ADD_CHUNK_SIZE 200		/* rows added to the view per idle call */
+#define MAX_CACHED_DIRS 16
+
+typedef struct FileEntry
 {
-	DWORD attrs;
-	static wchar_t w_filename[MAX_PATH];
-	MultiByteToWideChar(CP_UTF8, 0, filename, -1, w_filename, sizeof(w_filename));
-	attrs = GetFileAttributesW(w_filename);
-	if (attrs != INVALID_FILE_ATTRIBUTES && attrs & FILE_ATTRIBUTE_HIDDEN)
-		return TRUE;
-	return FALSE;
+	gchar *name;			/* in locale encoding */
+	gchar *utf8_name;
+	gchar *sort_key;		/* casefolded utf8_name */
+	gboolean is_dir;
+	gboolean is_hidden;		/* hidden or backup file */
+	GSequenceIter *row;		/* position in shown_entries, or NULL if not shown */
 }
-#endif
-
+FileEntry;
 
-/* Returns: whether name should be hidden. */
-static gboolean check_hidden(const gchar *filename, const gchar *base_name)
+typedef struct DirCache
 {
-	gsize len;
+	gchar *path;				/* in locale encoding */
+	GHashTable *entries;		/* name -> FileEntry */
+	GFileMonitor *monitor;		/* NULL if unsupported, the cache is only kept while shown then */
+	GCancellable *cancellable;	/* for all pending operations of this directory */
+	gint refs;					/* dir_caches' reference and one per pending operation */
+}
+DirCache;
 
-#ifdef G_OS_WIN32
-	if (win32_check_hidden(filename))
-		return TRUE;
-#else
-	if (base_name[0] == '.')
-		return TRUE;
-#endif
+static GHashTable *dir_caches = NULL;	/* path -> DirCache */
+static GQueue cache_queue = G_QUEUE_INIT;	/* most recently used first */
+static DirCache *current_cache = NULL;
+
+static GSequence *shown_entries = NULL;	/* sorted FileEntry's of the rows after "..", if any */
+static gboolean has_parent_row = FALSE;
+static GQueue pending_entries = G_QUEUE_INIT;	/* FileEntry's to add to the view */
+static guint add_entries_idle_id = 0;
+static gchar **hidden_exts = NULL;
 
-	len = strlen(base_name);
-	return base_name[len - 1] == '~';
-}
+
+static void add_entry(DirCache *cache, GFileInfo *info);
 
 
 static gboolean check_object(const gchar *base_name)
 {
-	gboolean ret = FALSE;
 	gchar **ptr;
-	gchar **exts = g_strsplit(hidden_file_extensions, " ", -1);
 
-	foreach_strv(ptr, exts)
+	foreach_strv(ptr, hidden_exts)
 	{
 		if (g_str_has_suffix(base_name, *ptr))
-		{
-			ret = TRUE;
-			break;
-		}
+			return TRUE;
 	}
-	g_strfreev(exts);
-	return ret;
+	return FALSE;
 }
 
 
@@ -178,56 +182,326 @@ static gboolean check_filtered(const gchar *base_name)
 }
 
 
-/* name is in locale encoding */
-static void add_item(const gchar *name)
+/* directories first, then by name ignoring case */
+static gint compare_entries(gconstpointer a, gconstpointer b, gpointer data)
+{
+	const FileEntry *entry_a = a;
+	const FileEntry *entry_b = b;
+	gint cmp;
+
+	if (entry_a->is_dir != entry_b->is_dir)
+		return entry_a->is_dir ? -1 : 1;
+
+	cmp = strcmp(entry_a->sort_key, entry_b->sort_key);
+	return (cmp != 0) ? cmp : strcmp(entry_a->name, entry_b->name);
+}
+
+
+/* Adds a row for entry at its sorted position, unless it is filtered out. */
+static void show_entry(FileEntry *entry)
 {
 	GtkTreeIter iter;
-	gchar *fname, *utf8_name, *utf8_fullname;
+	gchar *fname, *utf8_fullname;
 	const gchar *sep;
-	gboolean dir;
+	gint pos;
 
-	if (G_UNLIKELY(EMPTY(name)))
+	if (! show_hidden_files && entry->is_hidden)
 		return;
+	if (! entry->is_dir)
+	{
+		if (! show_hidden_files && hide_object_files && check_object(entry->utf8_name))
+			return;
+		if (check_filtered(entry->utf8_name))
+			return;
+	}
 
 	/* root directory doesn't need separator */
 	sep = (utils_str_equal(current_dir, "/")) ? "" : G_DIR_SEPARATOR_S;
-	fname = g_strconcat(current_dir, sep, name, NULL);
-	dir = g_file_test(fname, G_FILE_TEST_IS_DIR);
-	utf8_fullname = utils_get_locale_from_utf8(fname);
-	utf8_name = utils_get_utf8_from_locale(name);
+	fname = g_strconcat(current_dir, sep, entry->name, NULL);
+	utf8_fullname = utils_get_utf8_from_locale(fname);
 	g_free(fname);
 
-	if (! show_hidden_files && check_hidden(utf8_fullname, utf8_name))
-		goto done;
+	entry->row = g_sequence_insert_sorted(shown_entries, entry, compare_entries, NULL);
+	pos = g_sequence_iter_get_position(entry->row) + (has_parent_row ? 1 : 0);
+	gtk_list_store_insert_with_values(file_store, &iter, pos,
+		FILEVIEW_COLUMN_ICON, (entry->is_dir) ? GTK_STOCK_DIRECTORY : GTK_STOCK_FILE,
+		FILEVIEW_COLUMN_NAME, entry->utf8_name,
+		FILEVIEW_COLUMN_FILENAME, utf8_fullname,
+		-1);
+	g_free(utf8_fullname);
+}
+
 
-	if (dir)
+/* Removes the row of entry, or entry from the pending ones. */
+static void hide_entry(FileEntry *entry)
+{
+	if (entry->row != NULL)
 	{
-		if (last_dir_iter == NULL)
-			gtk_list_store_prepend(file_store, &iter);
-		else
-		{
-			gtk_list_store_insert_after(file_store, &iter, last_dir_iter);
-			gtk_tree_iter_free(last_dir_iter);
-		}
-		last_dir_iter = gtk_tree_iter_copy(&iter);
+		GtkTreeIter iter;
+		gint pos = g_sequence_iter_get_position(entry->row) + (has_parent_row ? 1 : 0);
+
+		if (gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(file_store), &iter, NULL, pos))
+			gtk_list_store_remove(file_store, &iter);
+		g_sequence_remove(entry->row);
+		entry->row = NULL;
 	}
 	else
+		g_queue_remove(&pending_entries, entry);
+}
+
+
+static gboolean add_pending_entries_idle(gpointer data)
+{
+	guint i;
+
+	for (i = 0; i < ADD_CHUNK_SIZE && ! g_queue_is_empty(&pending_entries); i++)
+		show_entry(g_queue_pop_head(&pending_entries));
+
+	if (g_queue_is_empty(&pending_entries))
 	{
-		if (! show_hidden_files && hide_object_files && check_object(utf8_name))
-			goto done;
-		if (check_filtered(utf8_name))
-			goto done;
+		add_entries_idle_id = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+static void queue_entry(FileEntry *entry)
+{
+	g_queue_push_tail(&pending_entries, entry);
+	if (add_entries_idle_id == 0)
+		add_entries_idle_id = g_idle_add(add_pending_entries_idle, NULL);
+}
+
 
-		gtk_list_store_append(file_store, &iter);
+static void queue_entry_cb(gpointer key, gpointer value, gpointer data)
+{
+	queue_entry(value);
+}
+
+
+static void free_entry(gpointer data)
+{
+	FileEntry *entry = data;
+
+	g_free(entry->name);
+	g_free(entry->utf8_name);
+	g_free(entry->sort_key);
+	g_free(entry);
+}
+
+
+static DirCache *dir_cache_ref(DirCache *cache)
+{
+	cache->refs++;
+	return cache;
+}
+
+
+static void dir_cache_unref(DirCache *cache)
+{
+	if (--cache->refs > 0)
+		return;
+
+	g_object_unref(cache->cancellable);
+	g_hash_table_destroy(cache->entries);
+	g_free(cache->path);
+	g_free(cache);
+}
+
+
+/* Removes cache from use, it is freed once its pending operations have finished */
+static void free_dir_cache(gpointer data)
+{
+	DirCache *cache = data;
+
+	g_cancellable_cancel(cache->cancellable);
+	if (cache->monitor != NULL)
+	{
+		g_signal_handlers_disconnect_matched(cache->monitor, G_SIGNAL_MATCH_DATA,
+			0, 0, NULL, NULL, cache);
+		g_file_monitor_cancel(cache->monitor);
+		g_object_unref(cache->monitor);
+		cache->monitor = NULL;
 	}
-	gtk_list_store_set(file_store, &iter,
-		FILEVIEW_COLUMN_ICON, (dir) ? GTK_STOCK_DIRECTORY : GTK_STOCK_FILE,
-		FILEVIEW_COLUMN_NAME, utf8_name,
-		FILEVIEW_COLUMN_FILENAME, utf8_fullname,
-		-1);
-done:
-	g_free(utf8_name);
-	g_free(utf8_fullname);
+	dir_cache_unref(cache);
+}
+
+
+/* Returns whether cache was removed from use while an operation was pending. The result of
+ * an operation can't be relied upon to tell, older GLib versions may still report success
+ * for it when it is cancelled. */
+static gboolean dir_cache_dropped(DirCache *cache)
+{
+	return g_cancellable_is_cancelled(cache->cancellable);
+}
+
+
+/* Unreadable directories and files are just left out, like before */
+static void on_query_info(GObject *source, GAsyncResult *result, gpointer data)
+{
+	DirCache *cache = data;
+	GFileInfo *info = g_file_query_info_finish(G_FILE(source), result, NULL);
+
+	if (info != NULL)
+	{
+		if (! dir_cache_dropped(cache))
+			add_entry(cache, info);
+		g_object_unref(info);
+	}
+	dir_cache_unref(cache);
+}
+
+
+static void remove_entry(DirCache *cache, const gchar *name)
+{
+	FileEntry *entry = g_hash_table_lookup(cache->entries, name);
+
+	if (entry == NULL)
+		return;
+	if (cache == current_cache)
+		hide_entry(entry);
+	g_hash_table_remove(cache->entries, name);
+}
+
+
+static void on_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer data)
+{
+	DirCache *cache = data;
+	gchar *name = g_file_get_basename(file);
+
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CREATED:
+			if (g_hash_table_lookup(cache->entries, name) == NULL)
+				g_file_query_info_async(file, LIST_ATTRIBUTES, G_FILE_QUERY_INFO_NONE,
+					G_PRIORITY_DEFAULT, cache->cancellable, on_query_info, dir_cache_ref(cache));
+			break;
+		case G_FILE_MONITOR_EVENT_DELETED:
+			remove_entry(cache, name);
+			break;
+		default:
+			break;
+	}
+	g_free(name);
+}
+
+
+static void add_entry(DirCache *cache, GFileInfo *info)
+{
+	const gchar *name = g_file_info_get_name(info);
+	FileEntry *entry;
+
+	if (G_UNLIKELY(EMPTY(name)) || g_hash_table_lookup(cache->entries, name) != NULL)
+		return;
+
+	entry = g_new0(FileEntry, 1);
+	entry->name = g_strdup(name);
+	entry->utf8_name = utils_get_utf8_from_locale(name);
+	entry->sort_key = g_utf8_casefold(entry->utf8_name, -1);
+	entry->is_dir = g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY;
+	entry->is_hidden = g_file_info_get_is_hidden(info) || g_file_info_get_is_backup(info);
+	g_hash_table_insert(cache->entries, entry->name, entry);
+
+	if (cache == current_cache)
+		queue_entry(entry);
+}
+
+
+static void on_next_files(GObject *source, GAsyncResult *result, gpointer data)
+{
+	GFileEnumerator *enumerator = G_FILE_ENUMERATOR(source);
+	DirCache *cache = data;
+	GList *files, *node;
+
+	files = g_file_enumerator_next_files_finish(enumerator, result, NULL);
+	foreach_list(node, files)
+	{
+		if (! dir_cache_dropped(cache))
+			add_entry(cache, node->data);
+		g_object_unref(node->data);
+	}
+	/* done, failed or dropped */
+	if (files == NULL || dir_cache_dropped(cache))
+	{
+		g_list_free(files);
+		g_object_unref(enumerator);
+		dir_cache_unref(cache);
+		return;
+	}
+	g_list_free(files);
+
+	/* keep the reference for the next batch */
+	g_file_enumerator_next_files_async(enumerator, LIST_BATCH_SIZE, G_PRIORITY_DEFAULT,
+		cache->cancellable, on_next_files, cache);
+}
+
+
+static void on_enumerate_children(GObject *source, GAsyncResult *result, gpointer data)
+{
+	DirCache *cache = data;
+	GFileEnumerator *enumerator;
+
+	enumerator = g_file_enumerate_children_finish(G_FILE(source), result, NULL);
+	if (enumerator == NULL || dir_cache_dropped(cache))
+	{
+		if (enumerator != NULL)
+			g_object_unref(enumerator);
+		dir_cache_unref(cache);
+		return;
+	}
+	g_file_enumerator_next_files_async(enumerator, LIST_BATCH_SIZE, G_PRIORITY_DEFAULT,
+		cache->cancellable, on_next_files, cache);
+}
+
+
+/* Returns the cache for path, creating it and starting to list the directory if necessary. */
+static DirCache *get_dir_cache(const gchar *path)
+{
+	DirCache *cache = g_hash_table_lookup(dir_caches, path);
+	GFile *file;
+
+	if (cache != NULL)
+	{
+		/* move to the front */
+		g_queue_remove(&cache_queue, cache);
+		g_queue_push_head(&cache_queue, cache);
+		return cache;
+	}
+
+	cache = g_new0(DirCache, 1);
+	cache->path = g_strdup(path);
+	cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_entry);
+	cache->cancellable = g_cancellable_new();
+	cache->refs = 1;
+
+	file = g_file_new_for_path(path);
+	/* monitor first so that files created while listing aren't missed */
+	cache->monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	if (cache->monitor != NULL)
+		g_signal_connect(cache->monitor, "changed", G_CALLBACK(on_dir_changed), cache);
+	g_file_enumerate_children_async(file, LIST_ATTRIBUTES, G_FILE_QUERY_INFO_NONE,
+		G_PRIORITY_DEFAULT, cache->cancellable, on_enumerate_children, dir_cache_ref(cache));
+	g_object_unref(file);
+
+	g_hash_table_insert(dir_caches, cache->path, cache);
+	g_queue_push_head(&cache_queue, cache);
+	while (g_queue_get_length(&cache_queue) > MAX_CACHED_DIRS)
+	{
+		DirCache *old = g_queue_pop_tail(&cache_queue);
+
+		g_hash_table_remove(dir_caches, old->path);
+	}
+	return cache;
+}
+
+
+static void reset_row_cb(gpointer data, gpointer user_data)
+{
+	FileEntry *entry = data;
+
+	entry->row = NULL;
 }
 
 
@@ -244,7 +518,7 @@ static void add_top_level_entry(void)
 	SETPTR(utf8_dir, utils_get_utf8_from_locale(utf8_dir));
 
 	gtk_list_store_prepend(file_store, &iter);
-	last_dir_iter = gtk_tree_iter_copy(&iter);
+	has_parent_row = TRUE;
 
 	gtk_list_store_set(file_store, &iter,
 		FILEVIEW_COLUMN_ICON, GTK_STOCK_DIRECTORY,
@@ -257,26 +531,51 @@ static void add_top_level_entry(void)
 
 static void clear(void)
 {
+	if (add_entries_idle_id != 0)
+	{
+		g_source_remove(add_entries_idle_id);
+		add_entries_idle_id = 0;
+	}
+	g_queue_clear(&pending_entries);
+
+	g_sequence_foreach(shown_entries, reset_row_cb, NULL);
+	g_sequence_remove_range(g_sequence_get_begin_iter(shown_entries),
+		g_sequence_get_end_iter(shown_entries));
+	has_parent_row = FALSE;
+	current_cache = NULL;
+
 	gtk_list_store_clear(file_store);
+}
+
 
-	/* reset the directory item pointer */
-	if (last_dir_iter != NULL)
-		gtk_tree_iter_free(last_dir_iter);
-	last_dir_iter = NULL;
+/* forgets the listing of path, so that it is read again when shown */
+static void drop_dir_cache(const gchar *path)
+{
+	DirCache *cache = g_hash_table_lookup(dir_caches, path);
+
+	if (cache == NULL)
+		return;
+	if (cache == current_cache)
+		clear();	/* the shown rows refer to the entries */
+	g_queue_remove(&cache_queue, cache);
+	g_hash_table_remove(dir_caches, path);
 }
 
 
-/* recreate the tree model from current_dir. */
+/* recreate the tree model from current_dir, using the cached listing if there is one. */
 static void refresh(void)
 {
+	DirCache *old_cache = current_cache;
 	gchar *utf8_dir;
-	GSList *list, *node;
 
 	/* don't clear when the new path doesn't exist */
 	if (! g_file_test(current_dir, G_FILE_TEST_EXISTS))
 		return;
 
 	clear();
+	/* a listing which isn't monitored would get outdated, it is read again when shown */
+	if (old_cache != NULL && old_cache->monitor == NULL)
+		drop_dir_cache(old_cache->path);
 
 	utf8_dir = utils_get_utf8_from_locale(current_dir);
 	gtk_entry_set_text(GTK_ENTRY(path_entry), utf8_dir);
@@ -286,23 +585,25 @@ static void refresh(void)
 
 	add_top_level_entry();	/* ".." item */
 
-	list = utils_get_file_list(current_dir, NULL, NULL);
-	if (list != NULL)
-	{
-		/* free filenames as we go through the list */
-		foreach_slist(node, list)
-		{
-			gchar *fname = node->data;
+	g_strfreev(hidden_exts);
+	hidden_exts = g_strsplit(hidden_file_extensions, " ", -1);
+
+	/* any entries listed later are queued by add_entry() */
+	current_cache = get_dir_cache(current_dir);
+	g_hash_table_foreach(current_cache->entries, queue_entry_cb, NULL);
 
-			add_item(fname);
-			g_free(fname);
-		}
-		g_slist_free(list);
-	}
 	gtk_entry_completion_set_model(entry_completion, GTK_TREE_MODEL(file_store));
 }
 
 
+/* reads current_dir again instead of using the cached listing */
+static void on_refresh(void)
+{
+	drop_dir_cache(current_dir);
+	refresh();
+}
+
+
 static void on_go_home(void)
 {
 	SETPTR(current_dir, g_strdup(g_get_home_dir()));
@@ -625,7 +926,7 @@ static GtkWidget *create_popup_menu(void)
 	item = gtk_image_menu_item_new_from_stock(GTK_STOCK_REFRESH, NULL);
 	gtk_widget_show(item);
 	gtk_container_add(GTK_CONTAINER(menu), item);
-	g_signal_connect(item, "activate", G_CALLBACK(refresh), NULL);
+	g_signal_connect(item, "activate", G_CALLBACK(on_refresh), NULL);
 
 	item = ui_image_menu_item_new(GTK_STOCK_FIND, _("_Find in Files..."));
 	gtk_widget_show(item);
@@ -827,6 +1128,8 @@ static void prepare_file_view(void)
 
 	gtk_tree_view_set_model(GTK_TREE_VIEW(file_view), GTK_TREE_MODEL(file_store));
 	g_object_unref(file_store);
+	shown_entries = g_sequence_new(NULL);
+	dir_caches = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_dir_cache);
 
 	icon_renderer = gtk_cell_renderer_pixbuf_new();
 	text_renderer = gtk_cell_renderer_text_new();
@@ -873,7 +1176,7 @@ static GtkWidget *make_toolbar(void)
 
 	wid = GTK_WIDGET(gtk_tool_button_new_from_stock(GTK_STOCK_REFRESH));
 	gtk_widget_set_tooltip_text(wid, _("Refresh"));
-	g_signal_connect(wid, "clicked", G_CALLBACK(refresh), NULL);
+	g_signal_connect(wid, "clicked", G_CALLBACK(on_refresh), NULL);
 	gtk_container_add(GTK_CONTAINER(toolbar), wid);
 
 	wid = GTK_WIDGET(gtk_tool_button_new_from_stock(GTK_STOCK_HOME));
@@ -1083,6 +1386,9 @@ void plugin_init(GeanyData *data)
 {
 	GtkWidget *scrollwin, *toolbar, *filterbar;
 
+	/* the callbacks of pending directory listings may still run after plugin_cleanup() */
+	plugin_module_make_resident(geany_plugin);
+
 	filter = NULL;
 
 	file_view_vbox = gtk_vbox_new(FALSE, 0);
@@ -1287,6 +1593,12 @@ void plugin_cleanup(void)
 	g_free(open_cmd);
 	g_free(hidden_file_extensions);
 	clear_filter();
+	clear();
+	g_hash_table_destroy(dir_caches);
+	g_queue_clear(&cache_queue);
+	g_sequence_free(shown_entries);
+	g_strfreev(hidden_exts);
+	hidden_exts = NULL;
 	gtk_widget_destroy(file_view_vbox);
 	g_object_unref(G_OBJECT(entry_completion));
 }
@@ -753,6 +753,14 @@ typedef sptr_t (*SciFnDirect)(sptr_t ptr, unsigned int iMessage, uptr_t wParam,
 #define SCI_INDICATOREND 2509
 #define SCI_SETPOSITIONCACHE 2514
 #define SCI_GETPOSITIONCACHE 2515
+#define SCI_SETPOSITIONCACHEMAXLENGTH 2671
+#define SCI_GETPOSITIONCACHEMAXLENGTH 2672
+#define SC_POSCACHESTAT_HITS 0
+#define SC_POSCACHESTAT_MISSES 1
+#define SC_POSCACHESTAT_EVICTIONS 2
+#define SC_POSCACHESTAT_ENTRIES 3
+#define SCI_GETPOSITIONCACHESTATISTIC 2673
+#define SCI_RESETPOSITIONCACHESTATISTICS 2674
 #define SCI_COPYALLOWLINE 2519
 #define SCI_GETCHARACTERPOINTER 2520
 #define SCI_GETRANGEPOINTER 2643
@@ -223,7 +223,7 @@ Editor::Editor() {
 	hsEnd = -1;
 
 	llc.SetLevel(LineLayoutCache::llcCaret);
-	posCache.SetSize(0x400);
+	posCache.SetSize(0x1000);
 
 	SetRepresentations();
 }
@@ -8186,6 +8186,20 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 	case SCI_GETPOSITIONCACHE:
 		return posCache.GetSize();
 
+	case SCI_SETPOSITIONCACHEMAXLENGTH:
+		posCache.SetMaxLength(wParam);
+		break;
+
+	case SCI_GETPOSITIONCACHEMAXLENGTH:
+		return posCache.GetMaxLength();
+
+	case SCI_GETPOSITIONCACHESTATISTIC:
+		return posCache.GetStatistic(wParam);
+
+	case SCI_RESETPOSITIONCACHESTATISTICS:
+		posCache.ResetStatistics();
+		break;
+
 	case SCI_SETSCROLLWIDTH:
 		PLATFORM_ASSERT(wParam > 0);
 		if ((wParam > 0) && (wParam != static_cast<unsigned int >(scrollWidth))) {
@@ -511,17 +511,17 @@ bool BreakFinder::More() const {
 }
 
 PositionCacheEntry::PositionCacheEntry() :
-	styleNumber(0), len(0), clock(0), positions(0) {
+	styleNumber(0), len(0), hash(0), positions(0), nextInBucket(-1), prevUsed(-1), nextUsed(-1) {
 }
 
 void PositionCacheEntry::Set(unsigned int styleNumber_, const char *s_,
-	unsigned int len_, XYPOSITION *positions_, unsigned int clock_) {
+	unsigned int len_, XYPOSITION *positions_, unsigned int hash_) {
 	Clear();
 	styleNumber = styleNumber_;
 	len = len_;
-	clock = clock_;
+	hash = hash_;
 	if (s_ && positions_) {
-		positions = new XYPOSITION[len + (len / 4) + 1];
+		positions = new XYPOSITION[len + (len / sizeof(XYPOSITION)) + 1];
 		for (unsigned int i=0; i<len; i++) {
 			positions[i] = static_cast<XYPOSITION>(positions_[i]);
 		}
@@ -538,12 +538,12 @@ void PositionCacheEntry::Clear() {
 	positions = 0;
 	styleNumber = 0;
 	len = 0;
-	clock = 0;
+	hash = 0;
 }
 
 bool PositionCacheEntry::Retrieve(unsigned int styleNumber_, const char *s_,
-	unsigned int len_, XYPOSITION *positions_) const {
-	if ((styleNumber == styleNumber_) && (len == len_) &&
+	unsigned int len_, XYPOSITION *positions_, unsigned int hash_) const {
+	if (positions && (hash == hash_) && (styleNumber == styleNumber_) && (len == len_) &&
 		(memcmp(reinterpret_cast<char *>(positions + len), s_, len)== 0)) {
 		for (unsigned int i=0; i<len; i++) {
 			positions_[i] = positions[i];
@@ -554,7 +554,7 @@ bool PositionCacheEntry::Retrieve(unsigned int styleNumber_, const char *s_,
 	}
 }
 
-int PositionCacheEntry::Hash(unsigned int styleNumber_, const char *s, unsigned int len_) {
+unsigned int PositionCacheEntry::Hash(unsigned int styleNumber_, const char *s, unsigned int len_) {
 	unsigned int ret = s[0] << 7;
 	for (unsigned int i=0; i<len_; i++) {
 		ret *= 1000003;
@@ -567,20 +567,14 @@ int PositionCacheEntry::Hash(unsigned int styleNumber_, const char *s, unsigned
 	return ret;
 }
 
-bool PositionCacheEntry::NewerThan(const PositionCacheEntry &other) const {
-	return clock > other.clock;
-}
-
-void PositionCacheEntry::ResetClock() {
-	if (clock > 0) {
-		clock = 1;
-	}
-}
-
 PositionCache::PositionCache() {
-	clock = 1;
-	pces.resize(0x400);
+	entriesUsed = 0;
+	mostRecent = -1;
+	leastRecent = -1;
+	maxLength = lengthDefaultMaxCached;
 	allClear = true;
+	ResetStatistics();
+	SetSize(0x400);
 }
 
 PositionCache::~PositionCache() {
@@ -591,40 +585,110 @@ void PositionCache::Clear() {
 	if (!allClear) {
 		for (size_t i=0; i<pces.size(); i++) {
 			pces[i].Clear();
+			pces[i].nextInBucket = -1;
+			pces[i].prevUsed = -1;
+			pces[i].nextUsed = -1;
 		}
+		std::fill(buckets.begin(), buckets.end(), -1);
 	}
-	clock = 1;
+	entriesUsed = 0;
+	mostRecent = -1;
+	leastRecent = -1;
 	allClear = true;
 }
 
 void PositionCache::SetSize(size_t size_) {
 	Clear();
 	pces.resize(size_);
+	// Keep the chains short by having as many buckets as entries.
+	buckets.assign(size_, -1);
+}
+
+void PositionCache::SetMaxLength(unsigned int maxLength_) {
+	if (maxLength_ < maxLength) {
+		// Longer entries would never be looked up again so drop them.
+		Clear();
+	}
+	maxLength = maxLength_;
+}
+
+unsigned long PositionCache::GetStatistic(int statistic) const {
+	switch (statistic) {
+	case SC_POSCACHESTAT_HITS:
+		return hits;
+	case SC_POSCACHESTAT_MISSES:
+		return misses;
+	case SC_POSCACHESTAT_EVICTIONS:
+		return evictions;
+	case SC_POSCACHESTAT_ENTRIES:
+		return entriesUsed;
+	default:
+		return 0;
+	}
+}
+
+void PositionCache::ResetStatistics() {
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+}
+
+void PositionCache::Unlink(int entry) {
+	PositionCacheEntry &pce = pces[entry];
+	if (pce.prevUsed >= 0)
+		pces[pce.prevUsed].nextUsed = pce.nextUsed;
+	else
+		mostRecent = pce.nextUsed;
+	if (pce.nextUsed >= 0)
+		pces[pce.nextUsed].prevUsed = pce.prevUsed;
+	else
+		leastRecent = pce.prevUsed;
+	pce.prevUsed = -1;
+	pce.nextUsed = -1;
+}
+
+void PositionCache::LinkMostRecent(int entry) {
+	pces[entry].prevUsed = -1;
+	pces[entry].nextUsed = mostRecent;
+	if (mostRecent >= 0)
+		pces[mostRecent].prevUsed = entry;
+	mostRecent = entry;
+	if (leastRecent < 0)
+		leastRecent = entry;
+}
+
+void PositionCache::RemoveFromBucket(int entry) {
+	int *link = &buckets[pces[entry].hash % buckets.size()];
+	while (*link >= 0) {
+		if (*link == entry) {
+			*link = pces[entry].nextInBucket;
+			break;
+		}
+		link = &pces[*link].nextInBucket;
+	}
+	pces[entry].nextInBucket = -1;
 }
 
 void PositionCache::MeasureWidths(Surface *surface, ViewStyle &vstyle, unsigned int styleNumber,
 	const char *s, unsigned int len, XYPOSITION *positions, Document *pdoc) {
 
-	allClear = false;
-	int probe = -1;
-	if ((!pces.empty()) && (len < 30)) {
-		// Only store short strings in the cache so it doesn't churn with
+	bool cacheable = (!pces.empty()) && (len > 0) && (len <= maxLength);
+	unsigned int hashValue = 0;
+	if (cacheable) {
+		// Only store strings up to maxLength in the cache so it doesn't churn with
 		// long comments with only a single comment.
-
-		// Two way associative: try two probe positions.
-		int hashValue = PositionCacheEntry::Hash(styleNumber, s, len);
-		probe = static_cast<int>(hashValue % pces.size());
-		if (pces[probe].Retrieve(styleNumber, s, len, positions)) {
-			return;
-		}
-		int probe2 = static_cast<int>((hashValue * 37) % pces.size());
-		if (pces[probe2].Retrieve(styleNumber, s, len, positions)) {
-			return;
-		}
-		// Not found. Choose the oldest of the two slots to replace
-		if (pces[probe].NewerThan(pces[probe2])) {
-			probe = probe2;
+		hashValue = PositionCacheEntry::Hash(styleNumber, s, len);
+		for (int probe = buckets[hashValue % buckets.size()]; probe >= 0; probe = pces[probe].nextInBucket) {
+			if (pces[probe].Retrieve(styleNumber, s, len, positions, hashValue)) {
+				if (probe != mostRecent) {
+					Unlink(probe);
+					LinkMostRecent(probe);
+				}
+				hits++;
+				return;
+			}
 		}
+		misses++;
 	}
 	if (len > BreakFinder::lengthStartSubdivision) {
 		// Break up into segments
@@ -642,16 +706,22 @@ void PositionCache::MeasureWidths(Surface *surface, ViewStyle &vstyle, unsigned
 	} else {
 		surface->MeasureWidths(vstyle.styles[styleNumber].font, s, len, positions);
 	}
-	if (probe >= 0) {
-		clock++;
-		if (clock > 60000) {
-			// Since there are only 16 bits for the clock, wrap it round and
-			// reset all cache entries so none get stuck with a high clock.
-			for (size_t i=0; i<pces.size(); i++) {
-				pces[i].ResetClock();
-			}
-			clock = 2;
+	if (cacheable) {
+		int entry;
+		if (entriesUsed < static_cast<int>(pces.size())) {
+			entry = entriesUsed++;
+		} else {
+			// Full so replace the least recently used entry
+			entry = leastRecent;
+			Unlink(entry);
+			RemoveFromBucket(entry);
+			evictions++;
 		}
-		pces[probe].Set(styleNumber, s, len, positions, clock);
+		allClear = false;
+		pces[entry].Set(styleNumber, s, len, positions, hashValue);
+		int &bucket = buckets[hashValue % buckets.size()];
+		pces[entry].nextInBucket = bucket;
+		bucket = entry;
+		LinkMostRecent(entry);
 	}
 }
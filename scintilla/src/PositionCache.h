@@ -98,19 +98,22 @@ public:
 };
 
 class PositionCacheEntry {
-	unsigned int styleNumber:8;
-	unsigned int len:8;
-	unsigned int clock:16;
+	friend class PositionCache;
+	unsigned int styleNumber;
+	unsigned int len;
+	unsigned int hash;
 	XYPOSITION *positions;
+	// Links for the hash bucket chain and the least recently used list
+	int nextInBucket;
+	int prevUsed;
+	int nextUsed;
 public:
 	PositionCacheEntry();
 	~PositionCacheEntry();
-	void Set(unsigned int styleNumber_, const char *s_, unsigned int len_, XYPOSITION *positions_, unsigned int clock);
+	void Set(unsigned int styleNumber_, const char *s_, unsigned int len_, XYPOSITION *positions_, unsigned int hash_);
 	void Clear();
-	bool Retrieve(unsigned int styleNumber_, const char *s_, unsigned int len_, XYPOSITION *positions_) const;
-	static int Hash(unsigned int styleNumber_, const char *s, unsigned int len);
-	bool NewerThan(const PositionCacheEntry &other) const;
-	void ResetClock();
+	bool Retrieve(unsigned int styleNumber_, const char *s_, unsigned int len_, XYPOSITION *positions_, unsigned int hash_) const;
+	static unsigned int Hash(unsigned int styleNumber_, const char *s, unsigned int len);
 };
 
 class Representation {
@@ -178,16 +181,32 @@ public:
 
 class PositionCache {
 	std::vector<PositionCacheEntry> pces;
-	unsigned int clock;
+	std::vector<int> buckets;
+	int entriesUsed;
+	int mostRecent;
+	int leastRecent;
+	unsigned int maxLength;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
 	bool allClear;
+	void Unlink(int entry);
+	void LinkMostRecent(int entry);
+	void RemoveFromBucket(int entry);
 	// Private so PositionCache objects can not be copied
 	PositionCache(const PositionCache &);
 public:
+	// Segments longer than this are not cached by default.
+	enum { lengthDefaultMaxCached = 100 };
 	PositionCache();
 	~PositionCache();
 	void Clear();
 	void SetSize(size_t size_);
 	size_t GetSize() const { return pces.size(); }
+	void SetMaxLength(unsigned int maxLength_);
+	unsigned int GetMaxLength() const { return maxLength; }
+	unsigned long GetStatistic(int statistic) const;
+	void ResetStatistics();
 	void MeasureWidths(Surface *surface, ViewStyle &vstyle, unsigned int styleNumber,
 		const char *s, unsigned int len, XYPOSITION *positions, Document *pdoc);
 };
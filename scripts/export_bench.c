@@ -0,0 +1,120 @@
+/*
+ *      export_bench.c
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* This benchmark times the code the Export plugin uses to write HTML and LaTeX files,
+ * from plugins/exportwriter.c: the pass collecting the used styles and the body writers.
+ * A C file with the given number of lines (default 100000) is generated and lexed, then
+ * each export is written to /dev/null.
+ *
+ * This file is not built during the normal build process, instead
+ * compile it with the following command in the root of the Geany source tree
+ * after building Geany:
+ *
+ * cc -o export_bench scripts/export_bench.c plugins/exportwriter.c -Iplugins \
+ *   -Iscintilla/include -DGTK scintilla/.libs/libscintilla.a \
+ *   `pkg-config --cflags --libs gtk+-2.0 gthread-2.0` -lstdc++ -lm
+ *
+ * ./export_bench [lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+
+#include "SciLexer.h"
+#include "exportwriter.h"
+
+
+#define SSM(s, m, w, l) scintilla_send_message(s, m, w, l)
+
+
+static gdouble run(ScintillaObject *sci, gboolean html, gboolean insert_line_numbers)
+{
+	gint styles[STYLE_MAX + 1][MAX_TYPES] = {{0}};
+	GTimer *timer = g_timer_new();
+	ExportWriter writer;
+	gdouble elapsed;
+
+	if (! export_writer_open(&writer, "/dev/null"))
+	{
+		g_printerr("Could not open /dev/null\n");
+		exit(1);
+	}
+	export_read_used_styles(sci, styles, html);
+	if (html)
+		export_write_html_body(&writer, sci, 4, insert_line_numbers);
+	else
+		export_write_latex_body(&writer, sci, 4, insert_line_numbers);
+	export_writer_close(&writer);
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	return elapsed;
+}
+
+
+int main(int argc, char **argv)
+{
+	gint i, lines = (argc > 1) ? atoi(argv[1]) : 100000;
+	GString *text = g_string_new(NULL);
+	ScintillaObject *sci;
+	gdouble mb;
+
+	gtk_init(&argc, &argv);
+
+	for (i = 0; i < lines; i++)
+	{
+		switch (i % 4)
+		{
+			case 0: g_string_append_printf(text, "/* comment %d <with> & markup */\n", i); break;
+			case 1: g_string_append_printf(text, "static int func_%d(char *s)\n", i); break;
+			case 2: g_string_append(text, "{\treturn s[0] == 'x' ? 1 : strlen(\"string\");\n"); break;
+			default: g_string_append(text, "}\n");
+		}
+	}
+	mb = text->len / (1024.0 * 1024.0);
+
+	sci = SCINTILLA(scintilla_new());
+	g_object_ref_sink(sci);
+	SSM(sci, SCI_SETLEXER, SCLEX_CPP, 0);
+	SSM(sci, SCI_SETKEYWORDS, 0, (sptr_t) "char int return static");
+	SSM(sci, SCI_SETTEXT, 0, (sptr_t) text->str);
+	SSM(sci, SCI_COLOURISE, 0, -1);
+
+	printf("%d lines, %.1f MiB\n", lines, mb);
+	printf("%-28s %10s %10s\n", "Export", "Seconds", "MiB/s");
+	for (i = 0; i < 4; i++)
+	{
+		gboolean html = i < 2;
+		gboolean line_numbers = i % 2 == 1;
+		gdouble elapsed = run(sci, html, line_numbers);
+
+		printf("%-28s %10.3f %10.1f\n", html ?
+			(line_numbers ? "HTML with line numbers" : "HTML") :
+			(line_numbers ? "LaTeX with line numbers" : "LaTeX"),
+			elapsed, mb / elapsed);
+	}
+
+	g_object_unref(sci);
+	g_string_free(text, TRUE);
+	return 0;
+}
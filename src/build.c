@@ -53,6 +53,7 @@
 #include "ui_utils.h"
 #include "dialogs.h"
 #include "msgwindow.h"
+#include "geanymsgstore.h"
 #include "filetypes.h"
 #include "keybindings.h"
 #include "vte.h"
@@ -69,13 +70,17 @@
 #endif
 
 /* Number of editor indicators to draw - limited as this can affect performance */
-#define GEANY_BUILD_ERR_HIGHLIGHT_MAX 50
+#define GEANY_BUILD_ERR_HIGHLIGHT_MAX 1000
 
 
 GeanyBuildInfo build_info = {GEANY_GBG_FT, 0, 0, NULL, GEANY_FILETYPES_NONE, NULL, 0};
 
 static gchar *current_dir_entered = NULL;
 
+/* error lines found in the build output whose indicators are not set yet, by document */
+static GHashTable *pending_errors = NULL;
+static guint pending_errors_idle_id = 0;
+
 typedef struct RunInfo
 {
 	GPid pid;
@@ -137,6 +142,11 @@ static void on_build_menu_item(GtkWidget *w, gpointer user_data);
 
 void build_finalize(void)
 {
+	if (pending_errors_idle_id != 0)
+		g_source_remove(pending_errors_idle_id);
+	if (pending_errors != NULL)
+		g_hash_table_destroy(pending_errors);
+
 	g_free(build_info.dir);
 	g_free(build_info.custom_target);
 
@@ -658,6 +668,9 @@ static void clear_all_errors(void)
 {
 	guint i;
 
+	if (pending_errors != NULL)
+		g_hash_table_remove_all(pending_errors);
+
 	foreach_document(i)
 	{
 		editor_indicator_clear_errors(documents[i]->editor);
@@ -665,6 +678,93 @@ static void clear_all_errors(void)
 }
 
 
+static void free_lines(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+
+static gint compare_lines(gconstpointer a, gconstpointer b)
+{
+	return *(const gint *) a - *(const gint *) b;
+}
+
+
+/* Sets the error indicators collected for doc at once, each line only once. */
+static void set_pending_errors(GeanyDocument *doc)
+{
+	GArray *lines;
+	gint last_line = -1;
+	guint i;
+
+	if (pending_errors == NULL)
+		return;
+	lines = g_hash_table_lookup(pending_errors, doc);
+	if (lines == NULL)
+		return;
+
+	g_array_sort(lines, compare_lines);
+	for (i = 0; i < lines->len; i++)
+	{
+		gint line = g_array_index(lines, gint, i);
+
+		if (line != last_line)
+			editor_indicator_set_on_line(doc->editor, GEANY_INDICATOR_ERROR, line);
+		last_line = line;
+	}
+	g_hash_table_remove(pending_errors, doc);
+}
+
+
+static gboolean on_set_pending_errors_idle(gpointer data)
+{
+	GeanyDocument *doc = document_get_current();
+
+	pending_errors_idle_id = 0;
+	if (doc != NULL)
+		set_pending_errors(doc);
+	return FALSE;
+}
+
+
+/* Error indicators are set in one pass per document: for the current document before the
+ * next redraw, so that all lines read from the build output meanwhile are included, and
+ * for other documents when they are switched to. */
+static void add_pending_error(GeanyDocument *doc, gint line)
+{
+	GArray *lines;
+
+	if (pending_errors == NULL)
+		pending_errors = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+			free_lines);
+
+	lines = g_hash_table_lookup(pending_errors, doc);
+	if (lines == NULL)
+	{
+		lines = g_array_new(FALSE, FALSE, sizeof(gint));
+		g_hash_table_insert(pending_errors, doc, lines);
+	}
+	g_array_append_val(lines, line);
+
+	if (doc == document_get_current() && pending_errors_idle_id == 0)
+		pending_errors_idle_id = g_idle_add_full(GDK_PRIORITY_REDRAW - 10,
+			on_set_pending_errors_idle, NULL, NULL);
+}
+
+
+static void on_document_activate(GObject *obj, GeanyDocument *doc, gpointer data)
+{
+	set_pending_errors(doc);
+}
+
+
+static void on_document_close(GObject *obj, GeanyDocument *doc, gpointer data)
+{
+	if (pending_errors != NULL)
+		g_hash_table_remove(pending_errors, doc);
+}
+
+
 #ifdef SYNC_SPAWN
 static void parse_build_output(const gchar **output, gint status)
 {
@@ -804,7 +904,7 @@ static GPid build_spawn_cmd(GeanyDocument *doc, const gchar *cmd, const gchar *d
 	utf8_working_dir = !EMPTY(dir) ? g_strdup(dir) : g_path_get_dirname(doc->file_name);
 	working_dir = utils_get_locale_from_utf8(utf8_working_dir);
 
-	gtk_list_store_clear(msgwindow.store_compiler);
+	geany_msg_store_clear(msgwindow.store_compiler);
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_COMPILER);
 	msgwin_compiler_add(COLOR_BLUE, _("%s (in directory: %s)"), utf8_cmd_string, utf8_working_dir);
 	g_free(utf8_working_dir);
@@ -1089,7 +1189,7 @@ static void process_build_output_line(const gchar *str, gint color)
 		{
 			if (line > 0) /* some compilers, like pdflatex report errors on line 0 */
 				line--;   /* so only adjust the line number if it is greater than 0 */
-			editor_indicator_set_on_line(doc->editor, GEANY_INDICATOR_ERROR, line);
+			add_pending_error(doc, line);
 		}
 		build_info.message_count++;
 		color = COLOR_RED;	/* error message parsed on the line */
@@ -1135,13 +1235,19 @@ gboolean build_parse_make_dir(const gchar *string, gchar **prefix)
 	if (string == NULL)
 		return FALSE;
 
-	if ((pos = strstr(string, "Entering directory")) != NULL)
+	/* this runs on every line of build output, so search only once for the part both
+	 * messages have in common */
+	pos = strstr(string, " directory");
+	if (pos == NULL)
+		return FALSE;
+
+	if (pos - string >= 8 && strncmp(pos - 8, "Entering", 8) == 0)
 	{
 		gsize len;
 		gchar *input;
 
 		/* get the start of the path */
-		pos = strstr(string, "/");
+		pos = strchr(pos, '/');
 
 		if (pos == NULL)
 			return FALSE;
@@ -1157,7 +1263,7 @@ gboolean build_parse_make_dir(const gchar *string, gchar **prefix)
 		return TRUE;
 	}
 
-	if (strstr(string, "Leaving directory") != NULL)
+	if (pos - string >= 7 && strncmp(pos - 7, "Leaving", 7) == 0)
 	{
 		*prefix = NULL;
 		return TRUE;
@@ -2803,6 +2909,8 @@ void build_init(void)
 	gint cmdindex;
 
 	g_signal_connect(geany_object, "project-close", on_project_close, NULL);
+	g_signal_connect(geany_object, "document-activate", G_CALLBACK(on_document_activate), NULL);
+	g_signal_connect(geany_object, "document-close", G_CALLBACK(on_document_close), NULL);
 
 	ft_def = g_new0(GeanyBuildCommand, build_groups_count[GEANY_GBG_FT]);
 	non_ft_def = g_new0(GeanyBuildCommand, build_groups_count[GEANY_GBG_NON_FT]);
@@ -65,6 +65,7 @@
 #include "toolbar.h"
 #include "highlighting.h"
 #include "pluginutils.h"
+#include "finder.h"
 #include "gtkcompat.h"
 
 
@@ -174,7 +175,7 @@ G_MODULE_EXPORT void on_save1_activate(GtkMenuItem *menuitem, gpointer user_data
 
 	if (doc != NULL && cur_page >= 0)
 	{
-		document_save_file(doc, ui_prefs.allow_always_save);
+		document_save_file_in_background(doc, ui_prefs.allow_always_save);
 	}
 }
 
@@ -198,7 +199,7 @@ G_MODULE_EXPORT void on_save_all1_activate(GtkMenuItem *menuitem, gpointer user_
 		if (! doc->changed)
 			continue;
 
-		if (document_save_file(doc, FALSE))
+		if (document_save_file_in_background(doc, FALSE))
 			count++;
 	}
 	if (!count)
@@ -876,8 +877,11 @@ G_MODULE_EXPORT void on_set_file_readonly1_toggled(GtkCheckMenuItem *checkmenuit
 		GeanyDocument *doc = document_get_current();
 		g_return_if_fail(doc != NULL);
 
+		document_wait_for_save(doc);
 		doc->readonly = ! doc->readonly;
-		sci_set_readonly(doc->editor->sci, doc->readonly);
+		/* a held buffer gets the new state when it is released */
+		if (! document_buffer_is_held(doc))
+			sci_set_readonly(doc->editor->sci, doc->readonly);
 		ui_update_tab_status(doc);
 		ui_update_statusbar(doc, -1);
 	}
@@ -1078,6 +1082,12 @@ G_MODULE_EXPORT void on_go_to_line_activate(GtkMenuItem *menuitem, gpointer user
 }
 
 
+G_MODULE_EXPORT void on_go_to_anything_activate(GtkMenuItem *menuitem, gpointer user_data)
+{
+	finder_show();
+}
+
+
 G_MODULE_EXPORT void on_toolbutton_goto_entry_activate(GtkAction *action, const gchar *text, gpointer user_data)
 {
 	GeanyDocument *doc = document_get_current();
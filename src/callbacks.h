@@ -259,6 +259,10 @@ G_MODULE_EXPORT void
 on_go_to_line_activate				 (GtkMenuItem	 *menuitem,
 										gpointer		 user_data);
 
+G_MODULE_EXPORT void
+on_go_to_anything_activate			 (GtkMenuItem	 *menuitem,
+										gpointer		 user_data);
+
 G_MODULE_EXPORT void
 on_help1_activate					  (GtkMenuItem	 *menuitem,
 										gpointer		 user_data);
@@ -40,6 +40,7 @@
 #endif
 
 #include <stdlib.h>
+#include <fcntl.h>
 
 /* gstdio.h also includes sys/stat.h */
 #include <glib/gstdio.h>
@@ -66,12 +67,16 @@
 #include "vte.h"
 #include "build.h"
 #include "symbols.h"
+#include "tagcache.h"
 #include "highlighting.h"
 #include "navqueue.h"
 #include "win32.h"
 #include "search.h"
 #include "filetypesprivate.h"
 #include "project.h"
+#include "trace.h"
+#include "keyfile.h"
+#include "finder.h"
 
 #include "SciLexer.h"
 
@@ -107,6 +112,150 @@ static void document_redo_add(GeanyDocument *doc, guint type, gpointer data);
 static gboolean remove_page(guint page_num);
 
 
+/* The documents by file_name and real_path, so that looking up a document doesn't compare
+ * the names of all of them, e.g. for each line of compiler output. The names indexed for a
+ * document are kept in its private data. */
+static GHashTable *index_file_names = NULL;
+static GHashTable *index_real_paths = NULL;
+/* real paths of the file names looked up, it is cleared when the index changes */
+static GHashTable *real_path_cache = NULL;
+
+/* see document_defer_tag_updates() */
+static gint defer_tag_updates = 0;
+
+/* bounds the memory used for real_path_cache */
+#define REAL_PATH_CACHE_SIZE 1024
+
+
+/* Returns a key for path which matches other keys like utils_filenamecmp() compares */
+static gchar *get_index_key(const gchar *path)
+{
+#ifdef G_OS_WIN32
+	gchar *key = g_utf8_validate(path, -1, NULL) ? g_strdup(path) :
+		g_locale_to_utf8(path, -1, NULL, NULL, NULL);
+
+	if (key != NULL)
+		SETPTR(key, g_utf8_strdown(key, -1));
+	return key;
+#else
+	return g_strdup(path);
+#endif
+}
+
+
+static GeanyDocument *index_lookup(GHashTable *table, const gchar *path)
+{
+#ifdef G_OS_WIN32
+	gchar *key = get_index_key(path);
+	GeanyDocument *doc = (key != NULL) ? g_hash_table_lookup(table, key) : NULL;
+
+	g_free(key);
+	return doc;
+#else
+	return g_hash_table_lookup(table, path);
+#endif
+}
+
+
+static void index_add(GHashTable *table, const gchar *path, GeanyDocument *doc)
+{
+	gchar *key = get_index_key(path);
+	GeanyDocument *other;
+
+	if (key == NULL)
+		return;
+	/* like searching the documents in order, prefer the first one with this name */
+	other = g_hash_table_lookup(table, key);
+	if (other != NULL && other != doc && other->index < doc->index)
+		g_free(key);
+	else
+		g_hash_table_replace(table, key, doc);
+}
+
+
+/* name_offset is the offset of the indexed name in GeanyDocumentPrivate, to find another
+ * document with the same name */
+static void index_remove(GHashTable *table, const gchar *path, GeanyDocument *doc,
+		glong name_offset)
+{
+	gchar *key = get_index_key(path);
+	guint i;
+
+	if (key != NULL && g_hash_table_lookup(table, key) == doc)
+	{
+		g_hash_table_remove(table, key);
+		foreach_document(i)
+		{
+			const gchar *name = G_STRUCT_MEMBER(const gchar *, documents[i]->priv, name_offset);
+
+			if (documents[i] != doc && name != NULL && utils_filenamecmp(name, path) == 0)
+			{
+				index_add(table, name, documents[i]);
+				break;
+			}
+		}
+	}
+	g_free(key);
+}
+
+
+/* Updates the lookup index after file_name or real_path of doc changed or doc was closed */
+static void document_index_update(GeanyDocument *doc)
+{
+	GeanyDocumentPrivate *priv = doc->priv;
+	const gchar *file_name = doc->is_valid ? doc->file_name : NULL;
+	const gchar *real_path = doc->is_valid ? doc->real_path : NULL;
+	gboolean changed = FALSE;
+
+	if (g_strcmp0(priv->indexed_file_name, file_name) != 0)
+	{
+		if (priv->indexed_file_name != NULL)
+			index_remove(index_file_names, priv->indexed_file_name, doc,
+				G_STRUCT_OFFSET(GeanyDocumentPrivate, indexed_file_name));
+		SETPTR(priv->indexed_file_name, g_strdup(file_name));
+		if (file_name != NULL)
+			index_add(index_file_names, file_name, doc);
+		changed = TRUE;
+	}
+	if (g_strcmp0(priv->indexed_real_path, real_path) != 0)
+	{
+		if (priv->indexed_real_path != NULL)
+			index_remove(index_real_paths, priv->indexed_real_path, doc,
+				G_STRUCT_OFFSET(GeanyDocumentPrivate, indexed_real_path));
+		SETPTR(priv->indexed_real_path, g_strdup(real_path));
+		if (real_path != NULL)
+			index_add(index_real_paths, real_path, doc);
+		changed = TRUE;
+	}
+	/* a cached real path might now belong to a document */
+	if (changed)
+		g_hash_table_remove_all(real_path_cache);
+}
+
+
+/* Updates the index for documents whose file_name or real_path was changed without
+ * updating it, e.g. by a plugin. Returns whether there were any.
+ * This compares the names of all documents, so it is only used when a lookup failed. */
+static gboolean document_index_update_all(void)
+{
+	gboolean changed = FALSE;
+	guint i;
+
+	foreach_document(i)
+	{
+		GeanyDocument *doc = documents[i];
+
+		if (g_strcmp0(doc->priv->indexed_file_name, doc->file_name) != 0 ||
+			g_strcmp0(doc->priv->indexed_real_path, doc->real_path) != 0)
+		{
+			document_index_update(doc);
+			changed = TRUE;
+		}
+	}
+	return changed;
+}
+
+
 /**
  * Finds a document whose @c real_path field matches the given filename.
  *
@@ -122,24 +271,22 @@ static gboolean remove_page(guint page_num);
  **/
 GeanyDocument* document_find_by_real_path(const gchar *realname)
 {
-	guint i;
+	GeanyDocument *doc;
 
 	if (! realname)
 		return NULL;	/* file doesn't exist on disk */
 
-	for (i = 0; i < documents_array->len; i++)
-	{
-		GeanyDocument *doc = documents[i];
-
-		if (! doc->is_valid || ! doc->real_path)
-			continue;
-
-		if (utils_filenamecmp(realname, doc->real_path) == 0)
-		{
-			return doc;
-		}
+	doc = index_lookup(index_real_paths, realname);
+	if (doc != NULL && (! doc->is_valid || ! doc->real_path ||
+		utils_filenamecmp(realname, doc->real_path) != 0))
+	{	/* the path was changed without updating the index */
+		document_index_update(doc);
+		doc = index_lookup(index_real_paths, realname);
 	}
-	return NULL;
+	/* another document might have been given this path */
+	if (doc == NULL && document_index_update_all())
+		doc = index_lookup(index_real_paths, realname);
+	return doc;
 }
 
 
@@ -167,7 +314,6 @@ static gchar *get_real_path_from_utf8(const gchar *utf8_filename)
  **/
 GeanyDocument *document_find_by_filename(const gchar *utf8_filename)
 {
-	guint i;
 	GeanyDocument *doc;
 	gchar *realname;
 
@@ -175,23 +321,29 @@ GeanyDocument *document_find_by_filename(const gchar *utf8_filename)
 
 	/* First search GeanyDocument::file_name, so we can find documents with a
 	 * filename set but not saved on disk, like vcdiff produces */
-	for (i = 0; i < documents_array->len; i++)
-	{
-		doc = documents[i];
-
-		if (! doc->is_valid || doc->file_name == NULL)
-			continue;
+	doc = index_lookup(index_file_names, utf8_filename);
+	if (doc != NULL && (! doc->is_valid || doc->file_name == NULL ||
+		utils_filenamecmp(utf8_filename, doc->file_name) != 0))
+	{	/* the file name was changed without updating the index, e.g. by a plugin */
+		document_index_update(doc);
+		doc = index_lookup(index_file_names, utf8_filename);
+	}
+	/* another document might have been given this name */
+	if (doc == NULL && document_index_update_all())
+		doc = index_lookup(index_file_names, utf8_filename);
+	if (doc != NULL)
+		return doc;
 
-		if (utils_filenamecmp(utf8_filename, doc->file_name) == 0)
-		{
-			return doc;
-		}
+	/* Now try matching based on the realpath(), which is unique per file on disk.
+	 * Resolving it needs system calls, so the results are cached. */
+	if (! g_hash_table_lookup_extended(real_path_cache, utf8_filename, NULL, (gpointer *) &realname))
+	{
+		if (g_hash_table_size(real_path_cache) >= REAL_PATH_CACHE_SIZE)
+			g_hash_table_remove_all(real_path_cache);
+		realname = get_real_path_from_utf8(utf8_filename);
+		g_hash_table_insert(real_path_cache, g_strdup(utf8_filename), realname);
 	}
-	/* Now try matching based on the realpath(), which is unique per file on disk */
-	realname = get_real_path_from_utf8(utf8_filename);
-	doc = document_find_by_real_path(realname);
-	g_free(realname);
-	return doc;
+	return document_find_by_real_path(realname);
 }
 
 
@@ -269,6 +421,9 @@ GeanyDocument *document_get_current(void)
 void document_init_doclist()
 {
 	documents_array = g_ptr_array_new();
+	index_file_names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	index_real_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	real_path_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 }
 
 
@@ -279,6 +434,9 @@ void document_finalize()
 	for (i = 0; i < documents_array->len; i++)
 		g_free(documents[i]);
 	g_ptr_array_free(documents_array, TRUE);
+	g_hash_table_destroy(index_file_names);
+	g_hash_table_destroy(index_real_paths);
+	g_hash_table_destroy(real_path_cache);
 }
 
 
@@ -551,6 +709,7 @@ static GeanyDocument *document_create(const gchar *utf8_filename)
 	ui_document_buttons_update();
 
 	doc->is_valid = TRUE;	/* do this last to prevent UI updating with NULL items. */
+	document_index_update(doc);
 	return doc;
 }
 
@@ -580,6 +739,8 @@ static gboolean remove_page(guint page_num)
 
 	g_return_val_if_fail(doc != NULL, FALSE);
 
+	document_wait_for_save(doc);
+
 	if (doc->changed && ! dialogs_show_unsaved_file(doc))
 		return FALSE;
 
@@ -591,6 +752,7 @@ static gboolean remove_page(guint page_num)
 		ui_add_recent_document(doc);
 
 	doc->is_valid = FALSE;
+	document_index_update(doc);
 
 	if (! main_status.quitting)
 	{
@@ -603,6 +765,11 @@ static gboolean remove_page(guint page_num)
 	g_free(doc->priv->saved_encoding.encoding);
 	g_free(doc->file_name);
 	g_free(doc->real_path);
+	g_free(doc->priv->tags_key);
+	g_free(doc->priv->indexed_file_name);
+	g_free(doc->priv->indexed_real_path);
+	if (doc->priv->tag_list_update_source != 0)
+		g_source_remove(doc->priv->tag_list_update_source);
 	tm_workspace_remove_object(doc->tm_file, TRUE, TRUE);
 
 	if (doc->priv->tag_tree)
@@ -1150,6 +1317,7 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 
 			/* file exists on disk, set real_path */
 			SETPTR(doc->real_path, tm_get_real_path(locale_filename));
+			document_index_update(doc);
 
 			doc->priv->is_remote = utils_is_remote_path(locale_filename);
 			monitor_file_setup(doc);
@@ -1310,6 +1478,14 @@ gboolean document_reload_file(GeanyDocument *doc, const gchar *forced_enc)
 
 	g_return_val_if_fail(doc != NULL, FALSE);
 
+	document_wait_for_save(doc);
+	/* e.g. a custom command or word count still uses the text */
+	if (document_buffer_is_held(doc))
+	{
+		ui_set_statusbar(TRUE, _("%s is busy, it can't be reloaded now."), DOC_FILENAME(doc));
+		return FALSE;
+	}
+
 	/* try to set the cursor to the position before reloading */
 	pos = sci_get_current_position(doc->editor->sci);
 	new_doc = document_open_file_full(doc, NULL, pos, doc->readonly, doc->file_type, forced_enc);
@@ -1465,6 +1641,7 @@ gboolean document_save_file_as(GeanyDocument *doc, const gchar *utf8_fname)
 
 	/* reset real path, it's retrieved again in document_save() */
 	SETPTR(doc->real_path, NULL);
+	document_index_update(doc);
 
 	/* detect filetype */
 	if (doc->file_type->id == GEANY_FILETYPES_NONE)
@@ -1494,217 +1671,615 @@ gboolean document_save_file_as(GeanyDocument *doc, const gchar *utf8_fname)
 }
 
 
-static gsize save_convert_to_encoding(GeanyDocument *doc, gchar **data, gsize *len)
+/* size of the buffer the converted text is written from */
+#define SAVE_BUFFER_SIZE 65536
+
+/* A save in progress. The text is read straight from Scintilla's buffer, in at most two
+ * segments (before and after the gap), so it isn't copied before being converted and written.
+ * The fields below the results comment are only written by save_job_run(). */
+typedef struct SaveJob
 {
-	GError *conv_error = NULL;
-	gchar* conv_file_contents = NULL;
-	gsize bytes_read;
-	gsize conv_len;
+	GeanyDocument	*doc;
+	gchar			*locale_filename;
+	gchar			*encoding;		/* encoding to convert to, or NULL to write UTF-8 as it is */
+	gboolean		 bom;			/* whether to write a UTF-8 BOM before the text */
+	gboolean		 safe;			/* use_safe_file_saving */
+	gboolean		 use_gio;		/* use_gio_unsafe_file_saving */
+	gboolean		 gio_backup;	/* gio_unsafe_save_backup */
+	const gchar		*segments[2];
+	gsize			 segment_lens[2];
+	GThread			*thread;
 
-	g_return_val_if_fail(data != NULL && *data != NULL, FALSE);
-	g_return_val_if_fail(len != NULL, FALSE);
+	/* results */
+	gchar			*errmsg;
+	gboolean		 conv_failed;	/* errmsg is about an encoding conversion error */
+	gsize			 conv_error_pos;	/* position of the text which could not be converted */
+	guint			 idle_id;		/* source reporting a finished background save */
+}
+SaveJob;
 
-	/* try to convert it from UTF-8 to original encoding */
-	conv_file_contents = g_convert(*data, *len - 1, doc->encoding, "UTF-8",
-												&bytes_read, &conv_len, &conv_error);
+/* Where the text of a SaveJob is converted and written to */
+typedef struct SaveStream
+{
+	GIConv			 cd;			/* (GIConv) -1 when not converting */
+	gchar			 carry[8];		/* incomplete character at the end of the previous write */
+	gsize			 carry_len;
+	gsize			 pos;			/* number of bytes converted */
+	gchar			*buf;
+	gboolean		 dry_run;		/* only check the conversion, don't write anything */
+	FILE			*fp;
+	GOutputStream	*stream;
+	gchar			*tmp_filename;	/* temporary file renamed to the target for safe saving */
+	gchar			*display_name;
+	GError			*error;
+}
+SaveStream;
 
-	if (conv_error != NULL)
-	{
-		gchar *text = g_strdup_printf(
+
+static void show_conversion_error(GeanyDocument *doc, const gchar *message, gsize pos)
+{
+	gchar *text = g_strdup_printf(
 _("An error occurred while converting the file from UTF-8 in \"%s\". The file remains unsaved."),
-			doc->encoding);
-		gchar *error_text;
+		doc->encoding);
+	gint line, column;
+	gint context_len;
+	gunichar unic;
+	/* don't read over the doc length */
+	gint max_len = MIN((gint)pos + 6, sci_get_length(doc->editor->sci));
+	gchar context[7]; /* read 6 bytes from Sci + '\0' */
+	gchar *error_text;
+
+	sci_get_text_range(doc->editor->sci, pos, max_len, context);
+
+	/* take only one valid Unicode character from the context and discard the leftover */
+	unic = g_utf8_get_char_validated(context, -1);
+	context_len = g_unichar_to_utf8(unic, context);
+	context[context_len] = '\0';
+	get_line_column_from_pos(doc, pos, &line, &column);
+
+	error_text = g_strdup_printf(
+		_("Error message: %s\nThe error occurred at \"%s\" (line: %d, column: %d)."),
+		message, context, line + 1, column);
+
+	geany_debug("encoding error: %s", message);
+	dialogs_show_msgbox_with_secondary(GTK_MESSAGE_ERROR, text, error_text);
+	g_free(text);
+	g_free(error_text);
+}
+
+
+static gboolean save_stream_write_raw(SaveStream *s, const gchar *data, gsize len)
+{
+	if (s->dry_run || len == 0)
+		return TRUE;
+
+	if (s->stream != NULL)
+		return g_output_stream_write_all(s->stream, data, len, NULL, NULL, &s->error);
+
+	errno = 0;
+	if (fwrite(data, sizeof(gchar), len, s->fp) != len)
+	{
+		gint save_errno = errno;
+
+		g_set_error(&s->error,
+			G_FILE_ERROR,
+			g_file_error_from_errno(save_errno),
+			_("Failed to write file '%s': fwrite() failed: %s"),
+			s->display_name,
+			g_strerror(save_errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
 
-		if (conv_error->code == G_CONVERT_ERROR_ILLEGAL_SEQUENCE)
+/* Converts as much of the input as possible. An incomplete character at the end
+ * is left in in/in_left. */
+static gboolean save_stream_convert(SaveStream *s, const gchar **in, gsize *in_left)
+{
+	while (*in_left > 0)
+	{
+		const gchar *start = *in;
+		gchar *out = s->buf;
+		gsize out_left = SAVE_BUFFER_SIZE;
+		gsize ret;
+		gint conv_errno;
+
+		ret = g_iconv(s->cd, (gchar **) in, in_left, &out, &out_left);
+		conv_errno = errno;
+		s->pos += *in - start;
+
+		if (! save_stream_write_raw(s, s->buf, SAVE_BUFFER_SIZE - out_left))
+			return FALSE;
+
+		if (ret == (gsize) -1)
 		{
-			gint line, column;
-			gint context_len;
-			gunichar unic;
-			/* don't read over the doc length */
-			gint max_len = MIN((gint)bytes_read + 6, (gint)*len - 1);
-			gchar context[7]; /* read 6 bytes from Sci + '\0' */
-			sci_get_text_range(doc->editor->sci, bytes_read, max_len, context);
-
-			/* take only one valid Unicode character from the context and discard the leftover */
-			unic = g_utf8_get_char_validated(context, -1);
-			context_len = g_unichar_to_utf8(unic, context);
-			context[context_len] = '\0';
-			get_line_column_from_pos(doc, bytes_read, &line, &column);
-
-			error_text = g_strdup_printf(
-				_("Error message: %s\nThe error occurred at \"%s\" (line: %d, column: %d)."),
-				conv_error->message, context, line + 1, column);
+			if (conv_errno == E2BIG)
+				continue;
+			if (conv_errno == EINVAL)
+				break;
+			g_set_error(&s->error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+				_("Invalid byte sequence in conversion input"));
+			return FALSE;
 		}
-		else
-			error_text = g_strdup_printf(_("Error message: %s."), conv_error->message);
+	}
+	return TRUE;
+}
+
+
+static gboolean save_stream_write(SaveStream *s, const gchar *data, gsize len)
+{
+	const gchar *in;
+	gsize in_left;
+
+	if (s->cd == (GIConv) -1)
+		return save_stream_write_raw(s, data, len);
+
+	if (s->carry_len > 0)
+	{
+		/* complete the character split by the previous write */
+		gsize old_len = s->carry_len;
+		gsize n = MIN(len, sizeof(s->carry) - old_len);
+		gsize used;
+
+		memcpy(s->carry + old_len, data, n);
+		in = s->carry;
+		in_left = old_len + n;
+		if (! save_stream_convert(s, &in, &in_left))
+			return FALSE;
+
+		used = old_len + n - in_left;
+		if (used < old_len)
+		{	/* still incomplete, all of data is in carry now */
+			s->carry_len = old_len + n;
+			return TRUE;
+		}
+		s->carry_len = 0;
+		data += used - old_len;
+		len -= used - old_len;
+	}
+
+	in = data;
+	in_left = len;
+	if (! save_stream_convert(s, &in, &in_left))
+		return FALSE;
+
+	g_return_val_if_fail(in_left <= sizeof(s->carry), FALSE);
+	memcpy(s->carry, in, in_left);
+	s->carry_len = in_left;
+	return TRUE;
+}
+
 
-		geany_debug("encoding error: %s", conv_error->message);
-		dialogs_show_msgbox_with_secondary(GTK_MESSAGE_ERROR, text, error_text);
-		g_error_free(conv_error);
-		g_free(text);
-		g_free(error_text);
+static gboolean save_stream_feed(SaveJob *job, SaveStream *s)
+{
+	guint i;
+
+	s->carry_len = 0;
+	if (job->bom && ! save_stream_write(s, "\xef\xbb\xbf", 3))
 		return FALSE;
+	/* positions are relative to the document text */
+	s->pos = 0;
+
+	for (i = 0; i < G_N_ELEMENTS(job->segments); i++)
+	{
+		gsize len = job->segment_lens[i];
+
+		if (s->cd == (GIConv) -1)
+		{
+			/* like strlen() on the whole text, stop at the first NUL */
+			const gchar *nul = memchr(job->segments[i], '\0', len);
+
+			if (nul != NULL)
+				return save_stream_write(s, job->segments[i], nul - job->segments[i]);
+		}
+		if (! save_stream_write(s, job->segments[i], len))
+			return FALSE;
 	}
-	else
+
+	if (s->cd != (GIConv) -1)
 	{
-		g_free(*data);
-		*data = conv_file_contents;
-		*len = conv_len;
+		gchar *out = s->buf;
+		gsize out_left = SAVE_BUFFER_SIZE;
+
+		if (s->carry_len > 0)
+		{
+			g_set_error(&s->error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+				_("Partial character sequence at end of input"));
+			return FALSE;
+		}
+		/* write the shift sequence returning to the initial state, if any */
+		g_iconv(s->cd, NULL, NULL, &out, &out_left);
+		return save_stream_write_raw(s, s->buf, SAVE_BUFFER_SIZE - out_left);
 	}
 	return TRUE;
 }
 
 
-static gchar *write_data_to_disk(const gchar *locale_filename,
-								 const gchar *data, gsize len)
+static gboolean save_stream_open(SaveJob *job, SaveStream *s)
 {
-	GError *error = NULL;
+	int save_errno;
 
-	if (file_prefs.use_safe_file_saving)
+	if (job->safe)
 	{
-		/* Use old GLib API for safe saving (GVFS-safe, but alters ownership and permissons).
-		 * This is the only option that handles disk space exhaustion. */
-		if (g_file_set_contents(locale_filename, data, len, &error))
-			geany_debug("Wrote %s with g_file_set_contents().", locale_filename);
+		gint fd;
+
+		/* write to a temporary file next to the target and rename it when complete, like
+		 * g_file_set_contents(). This is the only option that handles disk space exhaustion. */
+		s->tmp_filename = g_strconcat(job->locale_filename, ".XXXXXX", NULL);
+		errno = 0;
+#if GLIB_CHECK_VERSION(2, 22, 0)
+		fd = g_mkstemp_full(s->tmp_filename, O_RDWR, 0666);
+#else
+		fd = g_mkstemp(s->tmp_filename);
+#endif
+		if (fd < 0 || (s->fp = fdopen(fd, "wb")) == NULL)
+		{
+			save_errno = errno;
+
+			if (fd >= 0)
+				close(fd);
+			g_set_error(&s->error,
+				G_FILE_ERROR,
+				g_file_error_from_errno(save_errno),
+				_("Failed to create file '%s': %s"),
+				s->display_name,
+				g_strerror(save_errno));
+			SETPTR(s->tmp_filename, NULL);
+			return FALSE;
+		}
 	}
-	else if (file_prefs.use_gio_unsafe_file_saving)
+	else if (job->use_gio)
 	{
 		GFile *fp;
 
 		/* Use GIO API to save file (GVFS-safe)
 		 * It is best in most GVFS setups but don't seem to work correctly on some more complex
 		 * setups (saving from some VM to their host, over some SMB shares, etc.) */
-		fp = g_file_new_for_path(locale_filename);
-		g_file_replace_contents(fp, data, len, NULL, file_prefs.gio_unsafe_save_backup,
-			G_FILE_CREATE_NONE, NULL, NULL, &error);
+		fp = g_file_new_for_path(job->locale_filename);
+		s->stream = G_OUTPUT_STREAM(g_file_replace(fp, NULL, job->gio_backup,
+			G_FILE_CREATE_NONE, NULL, &s->error));
 		g_object_unref(fp);
+		return s->stream != NULL;
 	}
 	else
 	{
-		FILE *fp;
-		int save_errno;
-		gchar *display_name = g_filename_display_name(locale_filename);
-
 		/* Use POSIX API for unsafe saving (GVFS-unsafe) */
 		/* The error handling is taken from glib-2.26.0 gfileutils.c */
 		errno = 0;
-		fp = g_fopen(locale_filename, "wb");
-		if (fp == NULL)
+		s->fp = g_fopen(job->locale_filename, "wb");
+		if (s->fp == NULL)
 		{
 			save_errno = errno;
 
-			g_set_error(&error,
+			g_set_error(&s->error,
 				G_FILE_ERROR,
 				g_file_error_from_errno(save_errno),
 				_("Failed to open file '%s' for writing: fopen() failed: %s"),
-				display_name,
+				s->display_name,
 				g_strerror(save_errno));
+			return FALSE;
 		}
-		else
-		{
-			gsize bytes_written;
+	}
+	return TRUE;
+}
 
-			errno = 0;
-			bytes_written = fwrite(data, sizeof(gchar), len, fp);
 
-			if (len != bytes_written)
-			{
-				save_errno = errno;
+static gboolean flush_to_disk(FILE *fp)
+{
+	if (fflush(fp) != 0)
+		return FALSE;
+#ifndef G_OS_WIN32
+	if (fsync(fileno(fp)) != 0)
+		return FALSE;
+#endif
+	return TRUE;
+}
 
-				g_set_error(&error,
-					G_FILE_ERROR,
-					g_file_error_from_errno(save_errno),
-					_("Failed to write file '%s': fwrite() failed: %s"),
-					display_name,
-					g_strerror(save_errno));
-			}
 
+/* Closes the stream, keeping any earlier error. For safe saving the temporary file
+ * only replaces the target if everything was written. */
+static void save_stream_close(SaveJob *job, SaveStream *s)
+{
+	int save_errno;
+
+	if (s->stream != NULL)
+	{
+		GCancellable *cancellable = g_cancellable_new();
+
+		/* a cancelled close doesn't replace the file with the partial contents */
+		if (s->error != NULL)
+			g_cancellable_cancel(cancellable);
+		g_output_stream_close(s->stream, cancellable, s->error ? NULL : &s->error);
+		g_object_unref(cancellable);
+		g_object_unref(s->stream);
+		return;
+	}
+
+	if (s->fp == NULL)
+		return;
+
+	errno = 0;
+	if (s->tmp_filename != NULL && s->error == NULL && ! flush_to_disk(s->fp))
+	{
+		save_errno = errno;
+
+		g_set_error(&s->error,
+			G_FILE_ERROR,
+			g_file_error_from_errno(save_errno),
+			_("Failed to write file '%s': fsync() failed: %s"),
+			s->display_name,
+			g_strerror(save_errno));
+	}
+
+	errno = 0;
+	/* preserve the fwrite() error if any */
+	if (fclose(s->fp) != 0 && s->error == NULL)
+	{
+		save_errno = errno;
+
+		g_set_error(&s->error,
+			G_FILE_ERROR,
+			g_file_error_from_errno(save_errno),
+			_("Failed to close file '%s': fclose() failed: %s"),
+			s->display_name,
+			g_strerror(save_errno));
+	}
+
+	if (s->tmp_filename != NULL)
+	{
+		if (s->error == NULL)
+		{
+#ifdef G_OS_WIN32
+			/* renaming doesn't replace existing files on Windows */
+			g_unlink(job->locale_filename);
+#endif
 			errno = 0;
-			/* preserve the fwrite() error if any */
-			if (fclose(fp) != 0 && error == NULL)
+			if (g_rename(s->tmp_filename, job->locale_filename) != 0)
 			{
 				save_errno = errno;
 
-				g_set_error(&error,
+				g_set_error(&s->error,
 					G_FILE_ERROR,
 					g_file_error_from_errno(save_errno),
-					_("Failed to close file '%s': fclose() failed: %s"),
-					display_name,
+					_("Failed to rename file '%s': %s"),
+					s->display_name,
 					g_strerror(save_errno));
 			}
 		}
+		if (s->error != NULL)
+			g_unlink(s->tmp_filename);
+	}
+}
+
+
+/* Converts and writes the text, may be run in a worker thread so it must not use
+ * Scintilla or GTK */
+static void save_job_run(SaveJob *job)
+{
+	SaveStream s;
+
+	memset(&s, 0, sizeof(s));
+	s.cd = (GIConv) -1;
+	s.display_name = g_filename_display_name(job->locale_filename);
+
+	if (job->encoding != NULL)
+	{
+		s.cd = g_iconv_open(job->encoding, "UTF-8");
+		if (s.cd == (GIConv) -1)
+		{
+			job->errmsg = g_strdup_printf(_("Conversion from character set '%s' to '%s' is not supported"),
+				"UTF-8", job->encoding);
+			job->conv_failed = TRUE;
+			g_free(s.display_name);
+			return;
+		}
+	}
+	s.buf = g_malloc(SAVE_BUFFER_SIZE);
 
-		g_free(display_name);
+	/* unsafe saving truncates the file, so check the conversion before */
+	if (s.cd != (GIConv) -1 && ! job->safe)
+	{
+		s.dry_run = TRUE;
+		save_stream_feed(job, &s);
+		s.dry_run = FALSE;
+		g_iconv(s.cd, NULL, NULL, NULL, NULL);
 	}
-	if (error != NULL)
+
+	if (s.error == NULL && save_stream_open(job, &s))
 	{
-		gchar *msg = g_strdup(error->message);
-		g_error_free(error);
-		/* geany will warn about file truncation for unsafe saving below */
-		return msg;
+		save_stream_feed(job, &s);
+		save_stream_close(job, &s);
 	}
-	return NULL;
+
+	if (s.error != NULL)
+	{
+		job->conv_failed = s.error->domain == G_CONVERT_ERROR;
+		job->errmsg = g_strdup(s.error->message);
+		job->conv_error_pos = s.pos;
+		g_error_free(s.error);
+	}
+	if (s.cd != (GIConv) -1)
+		g_iconv_close(s.cd);
+	g_free(s.buf);
+	g_free(s.tmp_filename);
+	g_free(s.display_name);
 }
 
 
-static gchar *save_doc(GeanyDocument *doc, const gchar *locale_filename,
-								 const gchar *data, gsize len)
+static void save_job_free(SaveJob *job)
 {
-	gchar *err;
+	g_free(job->locale_filename);
+	g_free(job->encoding);
+	g_free(job->errmsg);
+	g_free(job);
+}
+
 
-	g_return_val_if_fail(doc != NULL, g_strdup(g_strerror(EINVAL)));
-	g_return_val_if_fail(data != NULL, g_strdup(g_strerror(EINVAL)));
+/* Reports the result of a save and updates the document, must be run in the main thread */
+static gboolean save_job_finish(SaveJob *job)
+{
+	GeanyDocument *doc = job->doc;
 
-	err = write_data_to_disk(locale_filename, data, len);
-	if (err)
-		return err;
+	if (job->errmsg != NULL)
+	{
+		if (job->conv_failed)
+			show_conversion_error(doc, job->errmsg, job->conv_error_pos);
+		else
+		{
+			gchar *errmsg = g_strdup(job->errmsg);
+
+			ui_set_statusbar(TRUE, _("Error saving file (%s)."), errmsg);
+
+			if (! job->safe)
+			{
+				SETPTR(errmsg,
+					g_strdup_printf(_("%s\n\nThe file on disk may now be truncated!"), errmsg));
+			}
+			dialogs_show_msgbox_with_secondary(GTK_MESSAGE_ERROR, _("Error saving file."), errmsg);
+			utils_beep();
+			g_free(errmsg);
+		}
+		doc->priv->file_disk_status = FILE_OK;
+		save_job_free(job);
+		return FALSE;
+	}
 
 	/* now the file is on disk, set real_path */
 	if (doc->real_path == NULL)
 	{
-		doc->real_path = tm_get_real_path(locale_filename);
-		doc->priv->is_remote = utils_is_remote_path(locale_filename);
+		doc->real_path = tm_get_real_path(job->locale_filename);
+		document_index_update(doc);
+		doc->priv->is_remote = utils_is_remote_path(job->locale_filename);
 		monitor_file_setup(doc);
 	}
+
+	/* store the opened encoding for undo/redo */
+	store_saved_encoding(doc);
+
+	/* ignore the following things if we are quitting */
+	if (! main_status.quitting)
+	{
+		sci_set_savepoint(doc->editor->sci);
+
+		if (file_prefs.disk_check_timeout > 0)
+			document_update_timestamp(doc, job->locale_filename);
+
+		/* update filetype-related things */
+		document_set_filetype(doc, doc->file_type);
+
+		document_update_tab_label(doc);
+
+		msgwin_status_add(_("File %s saved."), doc->file_name);
+		ui_update_statusbar(doc, -1);
+#ifdef HAVE_VTE
+		vte_cwd((doc->real_path != NULL) ? doc->real_path : doc->file_name, FALSE);
+#endif
+	}
+	save_job_free(job);
+
+	g_signal_emit_by_name(geany_object, "document-save", doc);
+
+	return TRUE;
+}
+
+
+static gboolean on_save_job_done(gpointer data)
+{
+	document_wait_for_save(data);
+	return FALSE;
+}
+
+
+static gpointer save_job_thread(gpointer data)
+{
+	SaveJob *job = data;
+
+	save_job_run(job);
+	job->idle_id = g_idle_add(on_save_job_done, job->doc);
 	return NULL;
 }
 
 
-/**
- *  Saves the document.
- *  Also shows the Save As dialog if necessary.
- *  If the file is not modified, this function may do nothing unless @a force is set to @c TRUE.
- *
- *  Saving may include replacing tabs by spaces,
- *  stripping trailing spaces and adding a final new line at the end of the file, depending
- *  on user preferences. Then the @c "document-before-save" signal is emitted,
- *  allowing plugins to modify the document before it is saved, and data is
- *  actually written to disk.
- *
- *  On successful saving:
- *  - GeanyDocument::real_path is set.
- *  - The filetype is set again or auto-detected if it wasn't set yet.
- *  - The @c "document-save" signal is emitted for plugins.
- *
- *  @warning You should ensure @c doc->file_name has an absolute path unless you want the
- *  Save As dialog to be shown. A @c NULL value also shows the dialog. This behaviour was
- *  added in Geany 1.22.
- *
- *  @param doc The document to save.
- *  @param force Whether to save the file even if it is not modified.
- *
- *  @return @c TRUE if the file was saved or @c FALSE if the file could not or should not be saved.
- **/
-gboolean document_save_file(GeanyDocument *doc, gboolean force)
+/* Makes the text of doc read-only until the matching document_release_buffer(), for users
+ * which read it in the background, e.g. a save or word count running in a thread, or wait
+ * for a result replacing part of it. Holds are counted, so users don't have to know about
+ * each other. */
+void document_hold_buffer(GeanyDocument *doc)
 {
-	gchar *errmsg;
-	gchar *data;
-	gsize len;
-	gchar *locale_filename;
+	if (doc->priv->buffer_holds++ == 0)
+		sci_set_readonly(doc->editor->sci, TRUE);
+}
+
+
+void document_release_buffer(GeanyDocument *doc)
+{
+	g_return_if_fail(doc->priv->buffer_holds > 0);
+
+	if (--doc->priv->buffer_holds == 0)
+		sci_set_readonly(doc->editor->sci, doc->readonly);
+}
+
+
+/* Returns: whether the text of doc must not be changed now, see document_hold_buffer() */
+gboolean document_buffer_is_held(GeanyDocument *doc)
+{
+	return doc->priv->buffer_holds > 0;
+}
+
+
+/* Finishes a save running in the background, if any. This must be called before the text
+ * of the document can be changed again or the document is closed. */
+void document_wait_for_save(GeanyDocument *doc)
+{
+	SaveJob *job = doc->priv->save_job;
+
+	if (job == NULL)
+		return;
+
+	g_thread_join(job->thread);
+	/* the thread added the source before exiting */
+	if (job->idle_id != 0)
+		g_source_remove(job->idle_id);
+
+	doc->priv->save_job = NULL;
+	document_release_buffer(doc);
+	save_job_finish(job);
+}
+
+
+static gboolean save_job_start_thread(SaveJob *job)
+{
+	GError *error = NULL;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	job->thread = g_thread_try_new("save", save_job_thread, job, &error);
+#else
+	job->thread = g_thread_create(save_job_thread, job, TRUE, &error);
+#endif
+	if (job->thread == NULL)
+	{
+		geany_debug("Could not create save thread: %s", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+static gboolean save_file(GeanyDocument *doc, gboolean force, gboolean background)
+{
+	SaveJob *job;
+	ScintillaObject *sci;
+	gint len;
 	const GeanyFilePrefs *fp;
 
 	g_return_val_if_fail(doc != NULL, FALSE);
 
+	document_wait_for_save(doc);
+	/* plugins may have set file_name directly */
+	document_index_update(doc);
+
 	if (document_need_save_as(doc))
 	{
 		/* ensure doc is the current tab before showing the dialog */
@@ -1716,109 +2291,111 @@ gboolean document_save_file(GeanyDocument *doc, gboolean force)
 	if (! force && (! doc->changed || doc->readonly))
 		return FALSE;
 
+	sci = doc->editor->sci;
 	fp = project_get_file_prefs();
-	/* replaces tabs by spaces but only if the current file is not a Makefile */
-	if (fp->replace_tabs && doc->file_type->id != GEANY_FILETYPES_MAKE)
-		editor_replace_tabs(doc->editor);
-	/* strip trailing spaces */
-	if (fp->strip_trailing_spaces)
-		editor_strip_trailing_spaces(doc->editor);
-	/* ensure the file has a newline at the end */
-	if (fp->final_new_line)
-		editor_ensure_final_newline(doc->editor);
-	/* ensure newlines are consistent */
-	if (fp->ensure_convert_new_lines)
-		sci_convert_eols(doc->editor->sci, sci_get_eol_mode(doc->editor->sci));
+	/* replace tabs by spaces (but only if the current file is not a Makefile), strip trailing
+	 * spaces, ensure the file has a newline at the end and newlines are consistent */
+	editor_normalize_whitespace(doc->editor,
+		fp->replace_tabs && doc->file_type->id != GEANY_FILETYPES_MAKE,
+		fp->strip_trailing_spaces, fp->final_new_line, fp->ensure_convert_new_lines);
 
 	/* notify plugins which may wish to modify the document before it's saved */
 	g_signal_emit_by_name(geany_object, "document-before-save", doc);
 
-	len = sci_get_length(doc->editor->sci) + 1;
-	if (doc->has_bom && encodings_is_unicode_charset(doc->encoding))
-	{	/* always write a UTF-8 BOM because in this moment the text itself is still in UTF-8
-		 * encoding, it will be converted to doc->encoding below and this conversion
-		 * also changes the BOM */
-		data = (gchar*) g_malloc(len + 3);	/* 3 chars for BOM */
-		data[0] = (gchar) 0xef;
-		data[1] = (gchar) 0xbb;
-		data[2] = (gchar) 0xbf;
-		sci_get_text(doc->editor->sci, len, data + 3);
-		len += 3;
-	}
-	else
-	{
-		data = (gchar*) g_malloc(len);
-		sci_get_text(doc->editor->sci, len, data);
-	}
-
+	job = g_new0(SaveJob, 1);
+	job->doc = doc;
+	job->locale_filename = utils_get_locale_from_utf8(doc->file_name);
+	job->safe = file_prefs.use_safe_file_saving;
+	job->use_gio = file_prefs.use_gio_unsafe_file_saving;
+	job->gio_backup = file_prefs.gio_unsafe_save_backup;
+	/* always write a UTF-8 BOM because the text itself is still in UTF-8 encoding,
+	 * it is converted to doc->encoding below and this conversion also changes the BOM */
+	job->bom = doc->has_bom && encodings_is_unicode_charset(doc->encoding);
 	/* save in original encoding, skip when it is already UTF-8 or has the encoding "None" */
 	if (doc->encoding != NULL && ! utils_str_equal(doc->encoding, "UTF-8") &&
 		! utils_str_equal(doc->encoding, encodings[GEANY_ENCODING_NONE].charset))
-	{
-		if (! save_convert_to_encoding(doc, &data, &len))
-		{
-			g_free(data);
-			return FALSE;
-		}
-	}
-	else
-	{
-		len = strlen(data);
-	}
-
-	locale_filename = utils_get_locale_from_utf8(doc->file_name);
+		job->encoding = g_strdup(doc->encoding);
 
 	/* ignore file changed notification when the file is written */
 	doc->priv->file_disk_status = FILE_IGNORE;
 
-	/* actually write the content of data to the file on disk */
-	errmsg = save_doc(doc, locale_filename, data, len);
-	g_free(data);
-
-	if (errmsg != NULL)
-	{
-		ui_set_statusbar(TRUE, _("Error saving file (%s)."), errmsg);
-
-		if (!file_prefs.use_safe_file_saving)
+	len = sci_get_length(sci);
+	/* other holders of the buffer may read it in a thread, the gap must not move then */
+	if (background && file_prefs.background_save_size > 0 && ! main_status.quitting &&
+		len >= file_prefs.background_save_size * 1024 && ! document_buffer_is_held(doc))
+	{
+		/* Move the gap to the end, so that other users of SCI_GETCHARACTERPOINTER, like
+		 * the tag parser, don't move the text while it is written. Holding the buffer
+		 * keeps it unchanged until the save has finished. */
+		job->segments[0] = (const gchar *) scintilla_send_message(sci,
+			SCI_GETCHARACTERPOINTER, 0, 0);
+		job->segment_lens[0] = len;
+		job->segments[1] = job->segments[0] + len;
+		document_hold_buffer(doc);
+
+		if (save_job_start_thread(job))
 		{
-			SETPTR(errmsg,
-				g_strdup_printf(_("%s\n\nThe file on disk may now be truncated!"), errmsg));
+			doc->priv->save_job = job;
+			ui_set_statusbar(FALSE, _("Saving %s..."), DOC_FILENAME(doc));
+			return TRUE;
 		}
-		dialogs_show_msgbox_with_secondary(GTK_MESSAGE_ERROR, _("Error saving file."), errmsg);
-		doc->priv->file_disk_status = FILE_OK;
-		utils_beep();
-		g_free(locale_filename);
-		g_free(errmsg);
-		return FALSE;
+		document_release_buffer(doc);
 	}
-
-	/* store the opened encoding for undo/redo */
-	store_saved_encoding(doc);
-
-	/* ignore the following things if we are quitting */
-	if (! main_status.quitting)
+	else
 	{
-		sci_set_savepoint(doc->editor->sci);
+		gint gap = scintilla_send_message(sci, SCI_GETGAPPOSITION, 0, 0);
 
-		if (file_prefs.disk_check_timeout > 0)
-			document_update_timestamp(doc, locale_filename);
+		/* the text before and after the gap, getting these doesn't move the gap */
+		job->segments[0] = (const gchar *) scintilla_send_message(sci, SCI_GETRANGEPOINTER, 0, gap);
+		job->segment_lens[0] = gap;
+		job->segments[1] = (const gchar *) scintilla_send_message(sci, SCI_GETRANGEPOINTER,
+			gap, len - gap);
+		job->segment_lens[1] = len - gap;
+	}
 
-		/* update filetype-related things */
-		document_set_filetype(doc, doc->file_type);
+	/* actually write the text to the file on disk */
+	save_job_run(job);
+	return save_job_finish(job);
+}
 
-		document_update_tab_label(doc);
 
-		msgwin_status_add(_("File %s saved."), doc->file_name);
-		ui_update_statusbar(doc, -1);
-#ifdef HAVE_VTE
-		vte_cwd((doc->real_path != NULL) ? doc->real_path : doc->file_name, FALSE);
-#endif
-	}
-	g_free(locale_filename);
+/**
+ *  Saves the document.
+ *  Also shows the Save As dialog if necessary.
+ *  If the file is not modified, this function may do nothing unless @a force is set to @c TRUE.
+ *
+ *  Saving may include replacing tabs by spaces,
+ *  stripping trailing spaces and adding a final new line at the end of the file, depending
+ *  on user preferences. Then the @c "document-before-save" signal is emitted,
+ *  allowing plugins to modify the document before it is saved, and data is
+ *  actually written to disk.
+ *
+ *  On successful saving:
+ *  - GeanyDocument::real_path is set.
+ *  - The filetype is set again or auto-detected if it wasn't set yet.
+ *  - The @c "document-save" signal is emitted for plugins.
+ *
+ *  @warning You should ensure @c doc->file_name has an absolute path unless you want the
+ *  Save As dialog to be shown. A @c NULL value also shows the dialog. This behaviour was
+ *  added in Geany 1.22.
+ *
+ *  @param doc The document to save.
+ *  @param force Whether to save the file even if it is not modified.
+ *
+ *  @return @c TRUE if the file was saved or @c FALSE if the file could not or should not be saved.
+ **/
+gboolean document_save_file(GeanyDocument *doc, gboolean force)
+{
+	return save_file(doc, force, FALSE);
+}
 
-	g_signal_emit_by_name(geany_object, "document-save", doc);
 
-	return TRUE;
+/* Like document_save_file(), but large files are written in a worker thread. The document
+ * is read-only until then and TRUE means the save was started; the "document-save" signal
+ * is emitted when it has finished. */
+gboolean document_save_file_in_background(GeanyDocument *doc, gboolean force)
+{
+	return save_file(doc, force, TRUE);
 }
 
 
@@ -2225,6 +2802,45 @@ gint document_replace_all(GeanyDocument *doc, const gchar *find_text, const gcha
 }
 
 
+/* Like document_replace_all(), but replaces matches found before with
+ * search_replace_matches(), in one undo action. The matches are freed.
+ * Returns: the number of replacements made. */
+gint document_replace_matches(GeanyDocument *doc, GSList *matches, const gchar *replace_text,
+		const gchar *original_find_text, const gchar *original_replace_text)
+{
+	ScintillaObject *sci;
+	gint count = 0, last_start;
+
+	g_return_val_if_fail(doc != NULL && replace_text != NULL, 0);
+
+	sci = doc->editor->sci;
+	document_wait_for_save(doc);
+	if (doc->readonly || document_buffer_is_held(doc))
+	{
+		g_slist_foreach(matches, (GFunc) geany_match_info_free, NULL);
+		g_slist_free(matches);
+	}
+	else if (matches != NULL)
+	{
+		/* only send the notifications editor.c handles, e.g. not those before each
+		 * insertion and deletion */
+		scintilla_send_message(sci, SCI_SETMODEVENTMASK,
+			SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT | SC_MOD_CHANGEFOLD, 0);
+		sci_start_undo_action(sci);
+		count = search_replace_matches(sci, matches, replace_text, &last_start, NULL);
+		sci_end_undo_action(sci);
+		scintilla_send_message(sci, SCI_SETMODEVENTMASK, SC_MODEVENTMASKALL, 0);
+
+		/* scroll last match in view, will destroy the existing selection */
+		if (count > 0)
+			sci_goto_pos(sci, last_start, TRUE);
+	}
+
+	show_replace_summary(doc, count, original_find_text, original_replace_text);
+	return count;
+}
+
+
 /*
  * Parses or re-parses the document's buffer and updates the type
  * keywords and symbol list.
@@ -2235,6 +2851,8 @@ void document_update_tags(GeanyDocument *doc)
 {
 	guchar *buffer_ptr;
 	gsize len;
+	gint64 trace_start;
+	gchar *key;
 
 	g_return_if_fail(DOC_VALID(doc));
 	g_return_if_fail(app->tm_workspace != NULL);
@@ -2259,6 +2877,7 @@ void document_update_tags(GeanyDocument *doc)
 		name = tm_source_file_get_lang_name(doc->file_type->lang);
 		doc->tm_file = tm_source_file_new(locale_filename, FALSE, name);
 		g_free(locale_filename);
+		SETPTR(doc->priv->tags_key, NULL);
 
 		if (doc->tm_file && !tm_workspace_add_object(doc->tm_file))
 		{
@@ -2283,6 +2902,8 @@ void document_update_tags(GeanyDocument *doc)
 	if (len < 1)
 	{
 		tm_tags_array_free(doc->tm_file->tags_array, FALSE);
+		SETPTR(doc->priv->tags_key, NULL);
+		finder_invalidate_tags(doc->tm_file);
 		sidebar_update_tag_list(doc, FALSE);
 		return;
 	}
@@ -2290,9 +2911,24 @@ void document_update_tags(GeanyDocument *doc)
 	/* Parse Scintilla's buffer directly using TagManager
 	 * Note: this buffer *MUST NOT* be modified */
 	buffer_ptr = (guchar *) scintilla_send_message(doc->editor->sci, SCI_GETCHARACTERPOINTER, 0, 0);
-	tm_source_file_buffer_update(doc->tm_file, buffer_ptr, len, TRUE);
 
+	/* skip parsing if the tags are up to date, e.g. after saving, or cached from an
+	 * earlier parse of the same contents */
+	key = tagcache_get_key(doc->tm_file->file_name, doc->file_type->lang, buffer_ptr, len);
+	if (g_strcmp0(key, doc->priv->tags_key) != 0)
+	{
+		if (! tagcache_load(doc->tm_file, key))
+			tm_source_file_buffer_update(doc->tm_file, buffer_ptr, len, TRUE);
+		finder_invalidate_tags(doc->tm_file);
+	}
+	/* only cache what is on disk, edits would just fill the cache */
+	if (! doc->changed)
+		tagcache_save(doc->tm_file, key);
+	SETPTR(doc->priv->tags_key, key);
+
+	trace_start = trace_begin();
 	sidebar_update_tag_list(doc, TRUE);
+	trace_end(TRACE_SIDEBAR, trace_start);
 	document_highlight_tags(doc);
 }
 
@@ -2353,7 +2989,12 @@ static gboolean on_document_update_tag_list_idle(gpointer data)
 		return FALSE;
 
 	if (! main_status.quitting)
+	{
+		gint64 trace_start = trace_begin();
+
 		document_update_tags(doc);
+		trace_end(TRACE_TAG_UPDATE, trace_start);
+	}
 
 	doc->priv->tag_list_update_source = 0;
 
@@ -2367,6 +3008,16 @@ void document_update_tag_list_in_idle(GeanyDocument *doc)
 	if (editor_prefs.autocompletion_update_freq <= 0 || ! filetype_has_tags(doc->file_type))
 		return;
 
+	/* while tag updates are deferred, e.g. for many replacements, one pending update
+	 * is enough, it runs when idle */
+	if (defer_tag_updates > 0)
+	{
+		if (doc->priv->tag_list_update_source == 0)
+			doc->priv->tag_list_update_source = g_idle_add_full(G_PRIORITY_LOW,
+				on_document_update_tag_list_idle, doc, NULL);
+		return;
+	}
+
 	/* prevent "stacking up" callback handlers, we only need one to run soon */
 	if (doc->priv->tag_list_update_source != 0)
 		g_source_remove(doc->priv->tag_list_update_source);
@@ -2376,6 +3027,15 @@ void document_update_tag_list_in_idle(GeanyDocument *doc)
 }
 
 
+/* Defers parsing the tags of the documents opened until the matching call with FALSE,
+ * so that opening many files at once doesn't wait for the parsers. */
+void document_defer_tag_updates(gboolean defer)
+{
+	defer_tag_updates += defer ? 1 : -1;
+	g_return_if_fail(defer_tag_updates >= 0);
+}
+
+
 static void document_load_config(GeanyDocument *doc, GeanyFiletype *type,
 		gboolean filetype_changed)
 {
@@ -2386,6 +3046,7 @@ static void document_load_config(GeanyDocument *doc, GeanyFiletype *type,
 	if (filetype_changed)
 	{
 		doc->file_type = type;
+		filetypes_load_icon(type);
 
 		/* delete tm file object to force creation of a new one */
 		if (doc->tm_file != NULL)
@@ -2404,7 +3065,16 @@ static void document_load_config(GeanyDocument *doc, GeanyFiletype *type,
 		doc->priv->symbol_list_sort_mode = type->priv->symbol_list_sort_mode;
 	}
 
-	document_update_tags(doc);
+	if (defer_tag_updates > 0 && doc->file_name != NULL && doc->file_type != NULL &&
+		filetype_has_tags(doc->file_type))
+	{
+		if (doc->priv->tag_list_update_source != 0)
+			g_source_remove(doc->priv->tag_list_update_source);
+		doc->priv->tag_list_update_source = g_idle_add_full(G_PRIORITY_LOW,
+			on_document_update_tag_list_idle, doc, NULL);
+	}
+	else
+		document_update_tags(doc);
 }
 
 
@@ -2919,6 +3589,9 @@ static void force_close_all(void)
 	}
 	main_status.closing_all = TRUE;
 
+	/* don't reopen session files which were not restored yet */
+	configuration_cancel_pending_session_files();
+
 	foreach_document(i)
 	{
 		document_close(documents[i]);
@@ -2989,6 +3662,7 @@ static gboolean monitor_resave_missing_file(GeanyDocument *doc)
 		document_set_text_changed(doc, TRUE);
 		/* don't prompt more than once */
 		SETPTR(doc->real_path, NULL);
+		document_index_update(doc);
 	}
 
 	return want_reload;
@@ -66,6 +66,7 @@ typedef struct GeanyFilePrefs
 	gboolean		use_gio_unsafe_file_saving; /* whether to use GIO as the unsafe backend */
 	gchar			*extract_filetype_regex;	/* regex to extract filetype on opening */
 	gboolean		tab_close_switch_to_mru;
+	gint			background_save_size;	/* minimum size in KiB to save in a thread, 0 to disable */
 }
 GeanyFilePrefs;
 
@@ -229,6 +230,9 @@ gint document_find_text(GeanyDocument *doc, const gchar *text, const gchar *orig
 gint document_replace_text(GeanyDocument *doc, const gchar *find_text, const gchar *original_find_text,
 		const gchar *replace_text, gint flags, gboolean search_backwards);
 
+gint document_replace_matches(GeanyDocument *doc, GSList *matches, const gchar *replace_text,
+		const gchar *original_find_text, const gchar *original_replace_text);
+
 gint document_replace_all(GeanyDocument *doc, const gchar *find_text, const gchar *replace_text,
 		const gchar *original_find_text, const gchar *original_replace_text, gint flags);
 
@@ -239,6 +243,8 @@ void document_update_tags(GeanyDocument *doc);
 
 void document_update_tag_list_in_idle(GeanyDocument *doc);
 
+void document_defer_tag_updates(gboolean defer);
+
 void document_highlight_tags(GeanyDocument *doc);
 
 void document_set_encoding(GeanyDocument *doc, const gchar *new_encoding);
@@ -269,6 +275,16 @@ gchar *document_get_basename_for_display(GeanyDocument *doc, gint length);
 
 gboolean document_need_save_as(GeanyDocument *doc);
 
+gboolean document_save_file_in_background(GeanyDocument *doc, gboolean force);
+
+void document_wait_for_save(GeanyDocument *doc);
+
+void document_hold_buffer(GeanyDocument *doc);
+
+void document_release_buffer(GeanyDocument *doc);
+
+gboolean document_buffer_is_held(GeanyDocument *doc);
+
 gboolean document_detect_indent_type(GeanyDocument *doc, GeanyIndentType *type_);
 
 gboolean document_detect_indent_width(GeanyDocument *doc, gint *width_);
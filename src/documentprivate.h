@@ -83,6 +83,15 @@ typedef struct GeanyDocumentPrivate
 	time_t			 mtime;
 	/* ID of the idle callback updating the tag list */
 	guint			 tag_list_update_source;
+	/* tag cache key of the buffer the current tags were parsed from, see tagcache.c */
+	gchar			*tags_key;
+	/* Save running in a worker thread, see document_wait_for_save() */
+	struct SaveJob	*save_job;
+	/* number of users which need the text to stay unchanged, see document_hold_buffer() */
+	gint			 buffer_holds;
+	/* file_name and real_path as stored in the lookup index, see document_index_update() */
+	gchar			*indexed_file_name;
+	gchar			*indexed_real_path;
 }
 GeanyDocumentPrivate;
 
@@ -60,6 +60,7 @@
 #include "projectprivate.h"
 #include "main.h"
 #include "highlighting.h"
+#include "trace.h"
 #include "gtkcompat.h"
 
 
@@ -520,6 +521,7 @@ static void on_update_ui(GeanyEditor *editor, G_GNUC_UNUSED SCNotification *nt)
 {
 	ScintillaObject *sci = editor->sci;
 	gint pos = sci_get_current_position(sci);
+	gint64 trace_start;
 
 	/* since Scintilla 2.24, SCN_UPDATEUI is also sent on scrolling though we don't need to handle
 	 * this and so ignore every SCN_UPDATEUI events except for content and selection changes */
@@ -530,9 +532,13 @@ static void on_update_ui(GeanyEditor *editor, G_GNUC_UNUSED SCNotification *nt)
 	ui_update_popup_reundo_items(editor->document);
 
 	/* brace highlighting */
+	trace_start = trace_begin();
 	editor_highlight_braces(editor, pos);
+	trace_end(TRACE_BRACE_MATCH, trace_start);
 
+	trace_start = trace_begin();
 	ui_update_statusbar(editor->document, pos);
+	trace_end(TRACE_STATUSBAR, trace_start);
 
 #if 0
 	/** experimental code for inverting selections */
@@ -822,7 +828,12 @@ static void on_char_added(GeanyEditor *editor, SCNotification *nt)
 			if (! editor_start_auto_complete(editor, pos, FALSE))
 				request_reshowing_calltip(nt);
 #else
+		{
+			gint64 trace_start = trace_begin();
+
 			editor_start_auto_complete(editor, pos, FALSE);
+			trace_end(TRACE_AUTOCOMPLETE, trace_start);
+		}
 #endif
 	}
 	check_line_breaking(editor, pos);
@@ -1020,6 +1031,7 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 {
 	ScintillaObject *sci = editor->sci;
 	GeanyDocument *doc = editor->document;
+	gint64 trace_start = trace_begin();
 
 	switch (nt->nmhdr.code)
 	{
@@ -1144,6 +1156,7 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 			sci_set_line_numbers(sci, editor_prefs.show_linenumber_margin, 0);
 			break;
 	}
+	trace_end(TRACE_EDITOR_NOTIFY, trace_start);
 	/* we always return FALSE here to let plugins handle the event too */
 	return FALSE;
 }
@@ -4312,40 +4325,175 @@ void editor_fold_all(GeanyEditor *editor)
 }
 
 
-void editor_replace_tabs(GeanyEditor *editor)
+/* A replacement of the text between start and end, the new text is stored in a shared buffer */
+typedef struct
 {
-	gint search_pos, pos_in_line, current_tab_true_length;
-	gint tab_len;
-	gchar *tab_str;
-	struct Sci_TextToFind ttf;
+	gint	start;
+	gint	end;
+	gsize	text_offset;
+	gsize	text_len;
+}
+WhitespaceEdit;
+
+
+/* Rewrites one line of text (without its line ending) into buf according to the flags */
+static void normalize_line(GString *buf, const gchar *text, gint len, gint tab_width,
+		gboolean replace_tabs, gboolean strip_trailing_spaces)
+{
+	gint i, col = 0;
+
+	for (i = 0; i < len; i++)
+	{
+		gchar c = text[i];
+
+		if (c == '\t')
+		{
+			gint n = tab_width - (col % tab_width);
+
+			if (replace_tabs)
+			{
+				gint j;
+
+				for (j = 0; j < n; j++)
+					g_string_append_c(buf, ' ');
+			}
+			else
+				g_string_append_c(buf, c);
+			col += n;
+		}
+		else
+		{
+			g_string_append_c(buf, c);
+			/* count characters, not UTF-8 continuation bytes */
+			if ((c & 0xC0) != 0x80)
+				col++;
+		}
+	}
+	if (strip_trailing_spaces)
+	{
+		while (buf->len > 0 && (buf->str[buf->len - 1] == ' ' || buf->str[buf->len - 1] == '\t'))
+			g_string_truncate(buf, buf->len - 1);
+	}
+}
+
+
+/* Replaces tabs by spaces, strips trailing spaces, adds a final new line and converts the
+ * line endings in a single pass over the text. Only the changed part of each line is replaced,
+ * from the end of the document backwards, all in one undo action. */
+void editor_normalize_whitespace(GeanyEditor *editor, gboolean replace_tabs,
+		gboolean strip_trailing_spaces, gboolean ensure_final_newline, gboolean convert_eols)
+{
+	ScintillaObject *sci;
+	const gchar *text;
+	const gchar *eol;
+	gint len, pos, tab_width;
+	gsize eol_len;
+	GArray *edits;
+	GString *buf;
+	GString *line = g_string_sized_new(256);
+	guint i;
 
 	g_return_if_fail(editor != NULL);
 
-	sci_start_undo_action(editor->sci);
-	tab_len = sci_get_tab_width(editor->sci);
-	ttf.chrg.cpMin = 0;
-	ttf.chrg.cpMax = sci_get_length(editor->sci);
-	ttf.lpstrText = (gchar*) "\t";
+	sci = editor->sci;
+	/* Diff hunks should keep trailing spaces */
+	if (sci_get_lexer(sci) == SCLEX_DIFF)
+		strip_trailing_spaces = FALSE;
+	if (! replace_tabs && ! strip_trailing_spaces && ! ensure_final_newline && ! convert_eols)
+		return;
 
+	tab_width = MAX(sci_get_tab_width(sci), 1);
+	eol = editor_get_eol_char(editor);
+	eol_len = strlen(eol);
+	edits = g_array_new(FALSE, FALSE, sizeof(WhitespaceEdit));
+	buf = g_string_new(NULL);
+
+	/* the text isn't changed before all edits are known */
+	len = sci_get_length(sci);
+	text = (const gchar *) SSM(sci, SCI_GETCHARACTERPOINTER, 0, 0);
+
+	pos = 0;
 	while (TRUE)
 	{
-		search_pos = sci_find_text(editor->sci, SCFIND_MATCHCASE, &ttf);
-		if (search_pos == -1)
+		gint line_start = pos;
+		gint content_end, line_end;
+		gsize prefix, suffix, old_len;
+
+		while (pos < len && text[pos] != '\r' && text[pos] != '\n')
+			pos++;
+		content_end = pos;
+		if (pos < len && text[pos] == '\r')
+			pos++;
+		if (pos < len && text[pos] == '\n')
+			pos++;
+		line_end = pos;
+
+		g_string_truncate(line, 0);
+		normalize_line(line, text + line_start, content_end - line_start, tab_width,
+			replace_tabs, strip_trailing_spaces);
+
+		if (line_end > content_end)
+		{
+			if (convert_eols)
+				g_string_append_len(line, eol, eol_len);
+			else
+				g_string_append_len(line, text + content_end, line_end - content_end);
+		}
+		else if (ensure_final_newline && (line->len > 0 || line_start == 0))
+			g_string_append_len(line, eol, eol_len);
+
+		/* only replace what differs between the old and the new line */
+		old_len = line_end - line_start;
+		for (prefix = 0; prefix < old_len && prefix < line->len; prefix++)
+		{
+			if (text[line_start + prefix] != line->str[prefix])
+				break;
+		}
+		for (suffix = 0; suffix < old_len - prefix && suffix < line->len - prefix; suffix++)
+		{
+			if (text[line_end - suffix - 1] != line->str[line->len - suffix - 1])
+				break;
+		}
+		if (prefix + suffix < old_len || prefix + suffix < line->len)
+		{
+			WhitespaceEdit edit;
+
+			edit.start = line_start + prefix;
+			edit.end = line_end - suffix;
+			edit.text_offset = buf->len;
+			edit.text_len = line->len - prefix - suffix;
+			g_string_append_len(buf, line->str + prefix, edit.text_len);
+			g_array_append_val(edits, edit);
+		}
+
+		if (line_end == content_end)
 			break;
+	}
 
-		pos_in_line = sci_get_col_from_position(editor->sci, search_pos);
-		current_tab_true_length = tab_len - (pos_in_line % tab_len);
-		tab_str = g_strnfill(current_tab_true_length, ' ');
-		sci_set_target_start(editor->sci, search_pos);
-		sci_set_target_end(editor->sci, search_pos + 1);
-		sci_replace_target(editor->sci, tab_str, FALSE);
-		/* next search starts after replacement */
-		ttf.chrg.cpMin = search_pos + current_tab_true_length - 1;
-		/* update end of range now text has changed */
-		ttf.chrg.cpMax += current_tab_true_length - 1;
-		g_free(tab_str);
+	if (edits->len > 0)
+	{
+		sci_start_undo_action(sci);
+		/* going backwards keeps the positions of the remaining edits valid */
+		for (i = edits->len; i-- > 0;)
+		{
+			WhitespaceEdit *edit = &g_array_index(edits, WhitespaceEdit, i);
+
+			sci_set_target_start(sci, edit->start);
+			sci_set_target_end(sci, edit->end);
+			SSM(sci, SCI_REPLACETARGET, edit->text_len, (sptr_t) (buf->str + edit->text_offset));
+		}
+		sci_end_undo_action(sci);
 	}
-	sci_end_undo_action(editor->sci);
+
+	g_array_free(edits, TRUE);
+	g_string_free(buf, TRUE);
+	g_string_free(line, TRUE);
+}
+
+
+void editor_replace_tabs(GeanyEditor *editor)
+{
+	editor_normalize_whitespace(editor, TRUE, FALSE, FALSE, FALSE);
 }
 
 
@@ -4427,16 +4575,7 @@ void editor_strip_line_trailing_spaces(GeanyEditor *editor, gint line)
 
 void editor_strip_trailing_spaces(GeanyEditor *editor)
 {
-	gint max_lines = sci_get_line_count(editor->sci);
-	gint line;
-
-	sci_start_undo_action(editor->sci);
-
-	for (line = 0; line < max_lines; line++)
-	{
-		editor_strip_line_trailing_spaces(editor, line);
-	}
-	sci_end_undo_action(editor->sci);
+	editor_normalize_whitespace(editor, FALSE, TRUE, FALSE, FALSE);
 }
 
 
@@ -4672,6 +4811,23 @@ static gboolean on_editor_draw(GtkWidget *widget, cairo_t *cr, gpointer user_dat
 #endif
 
 
+/* start time of the current repaint, only used when tracing */
+static gint64 paint_trace_start = 0;
+
+static gboolean on_editor_paint_trace_begin(GtkWidget *widget, gpointer event, gpointer user_data)
+{
+	paint_trace_start = trace_begin();
+	return FALSE;
+}
+
+
+static gboolean on_editor_paint_trace_end(GtkWidget *widget, gpointer event, gpointer user_data)
+{
+	trace_end(TRACE_PAINT, paint_trace_start);
+	return FALSE;
+}
+
+
 static void setup_sci_keys(ScintillaObject *sci)
 {
 	/* disable some Scintilla keybindings to be able to redefine them cleanly */
@@ -4800,6 +4956,18 @@ static ScintillaObject *create_new_sci(GeanyEditor *editor)
 #else
 		g_signal_connect(sci, "expose-event", G_CALLBACK(on_editor_expose_event), editor);
 #endif
+		if (trace_enabled)
+		{
+			/* time Scintilla's own drawing, which runs between these two handlers */
+#if GTK_CHECK_VERSION(3, 0, 0)
+			const gchar *signal = "draw";
+#else
+			const gchar *signal = "expose-event";
+#endif
+
+			g_signal_connect(sci, signal, G_CALLBACK(on_editor_paint_trace_begin), NULL);
+			g_signal_connect_after(sci, signal, G_CALLBACK(on_editor_paint_trace_end), NULL);
+		}
 	}
 	return sci;
 }
@@ -287,6 +287,9 @@ void editor_strip_trailing_spaces(GeanyEditor *editor);
 
 void editor_ensure_final_newline(GeanyEditor *editor);
 
+void editor_normalize_whitespace(GeanyEditor *editor, gboolean replace_tabs,
+		gboolean strip_trailing_spaces, gboolean ensure_final_newline, gboolean convert_eols);
+
 void editor_insert_color(GeanyEditor *editor, const gchar *colour);
 
 const GeanyIndentPrefs *editor_get_indent_prefs(GeanyEditor *editor);
@@ -43,6 +43,7 @@
 #include "sciwrappers.h"
 #include "ui_utils.h"
 #include "symbols.h"
+#include "trace.h"
 
 #include <stdlib.h>
 
@@ -65,6 +66,11 @@ static void create_radio_menu_item(GtkWidget *menu, GeanyFiletype *ftype);
 static gchar *filetypes_get_conf_extension(const GeanyFiletype *ft);
 static void read_filetype_config(void);
 
+/* incremented whenever filetypes.common is (re)loaded, as all stylesets depend on it */
+static guint common_config_generation = 0;
+/* whether filetype icons can be loaded, i.e. GTK is initialized */
+static gboolean load_icons = FALSE;
+
 
 enum TitleType
 {
@@ -763,16 +769,11 @@ static void create_set_filetype_menu(void)
 
 void filetypes_init()
 {
-	GSList *node;
-
 	filetypes_init_types();
 
-	/* this has to be here as GTK isn't initialized in filetypes_init_types(). */
-	foreach_slist(node, filetypes_by_title)
-	{
-		GeanyFiletype *ft = node->data;
-		ft->icon = ui_get_mime_icon(ft->mime_type, GTK_ICON_SIZE_MENU);
-	}
+	/* this has to be here as GTK isn't initialized in filetypes_init_types().
+	 * Icons are loaded by filetypes_load_icon() when a filetype is first used. */
+	load_icons = TRUE;
 	create_set_filetype_menu();
 	setup_config_file_menus();
 }
@@ -1156,9 +1157,11 @@ static void filetype_free(gpointer data, G_GNUC_UNUSED gpointer user_data)
 	if (ft->icon)
 		g_object_unref(ft->icon);
 	g_strfreev(ft->pattern);
+	g_free(ft->priv->config_stamp);
 
 	if (ft->priv->error_regex)
 		g_regex_unref(ft->priv->error_regex);
+	g_free(ft->priv->last_error_pattern);
 	g_slist_foreach(ft->priv->tag_files, (GFunc) g_free, NULL);
 	g_slist_free(ft->priv->tag_files);
 
@@ -1344,10 +1347,12 @@ static void add_group_keys(GKeyFile *kf, const gchar *group, GeanyFiletype *ft)
 }
 
 
-static void copy_ft_groups(GKeyFile *kf)
+/* Returns whether any groups were copied from another filetype. */
+static gboolean copy_ft_groups(GKeyFile *kf)
 {
 	gchar **groups = g_key_file_get_groups(kf, NULL);
 	gchar **ptr;
+	gboolean copied = FALSE;
 
 	foreach_strv(ptr, groups)
 	{
@@ -1371,10 +1376,12 @@ static void copy_ft_groups(GKeyFile *kf)
 			add_group_keys(kf, group, ft);
 			/* move old group keys (foo=bar) to proper group name (foo) */
 			copy_keys(kf, group, kf, old_group);
+			copied = TRUE;
 		}
 		g_free(old_group);
 	}
 	g_strfreev(groups);
+	return copied;
 }
 
 
@@ -1396,14 +1403,54 @@ static void load_system_keyfile(GKeyFile *key_file, const gchar *file, GKeyFileF
 }
 
 
+/* Returns a string describing the state of everything @a ft's configuration is read from.
+ * If it is the same when reloading, the configuration doesn't need to be parsed again. */
+static gchar *get_config_stamp(GeanyFiletype *ft)
+{
+	GString *stamp = g_string_new(NULL);
+	gchar *f;
+
+	f = filetypes_get_filename(ft, FALSE);
+	utils_append_file_stamp(stamp, f);
+	SETPTR(f, filetypes_get_filename(ft, TRUE));
+	utils_append_file_stamp(stamp, f);
+	g_free(f);
+
+	if (ft->id == GEANY_FILETYPES_NONE)
+		highlighting_append_color_scheme_stamp(stamp);
+	else
+		g_string_append_printf(stamp, "%u", common_config_generation);
+
+	return g_string_free(stamp, FALSE);
+}
+
+
+static gboolean config_changed(GeanyFiletype *ft)
+{
+	gchar *stamp;
+	gboolean changed;
+
+	/* configuration copied from other filetypes isn't tracked */
+	if (ft->priv->config_stamp == NULL)
+		return TRUE;
+
+	stamp = get_config_stamp(ft);
+	changed = ! utils_str_equal(stamp, ft->priv->config_stamp);
+	g_free(stamp);
+	return changed;
+}
+
+
 /* Load the configuration file for the associated filetype id.
  * This should only be called when the filetype is needed, to save loading
- * 20+ configuration files all at once. */
+ * 20+ configuration files all at once.
+ * When reloading, filetypes whose configuration files haven't changed are skipped. */
 void filetypes_load_config(guint ft_id, gboolean reload)
 {
 	GKeyFile *config, *config_home;
 	GeanyFiletypePrivate *pft;
 	GeanyFiletype *ft;
+	gboolean copied_groups;
 
 	g_return_if_fail(ft_id < filetypes_array->len);
 
@@ -1417,8 +1464,12 @@ void filetypes_load_config(guint ft_id, gboolean reload)
 	/* when not reloading, load the settings only once */
 	if (G_LIKELY(! reload && pft->keyfile_loaded))
 		return;
+
+	if (reload && ! config_changed(ft))
+		return;
 	pft->keyfile_loaded = TRUE;
 
+	trace_startup_begin("filetype config %s", ft->name);
 	config = g_key_file_new();
 	config_home = g_key_file_new();
 	{
@@ -1433,14 +1484,32 @@ void filetypes_load_config(guint ft_id, gboolean reload)
 		g_free(f);
 	}
 	/* Copy keys for any groups with [group=C] from system keyfile */
-	copy_ft_groups(config);
-	copy_ft_groups(config_home);
+	copied_groups = copy_ft_groups(config);
+	copied_groups |= copy_ft_groups(config_home);
 
 	load_settings(ft_id, config, config_home);
 	highlighting_init_styles(ft_id, config, config_home);
 
 	g_key_file_free(config);
 	g_key_file_free(config_home);
+
+	if (ft_id == GEANY_FILETYPES_NONE)
+		common_config_generation++;
+	/* take the stamp after loading as filetypes.common may have just been loaded too */
+	SETPTR(pft->config_stamp, copied_groups ? NULL : get_config_stamp(ft));
+	trace_startup_end();
+}
+
+
+/* Loads the icon for @a ft, if not already done.
+ * This is done when a filetype is first used rather than for all filetypes at startup,
+ * as looking up MIME type icons is relatively slow. */
+void filetypes_load_icon(GeanyFiletype *ft)
+{
+	g_return_if_fail(ft != NULL);
+
+	if (ft->icon == NULL && load_icons)
+		ft->icon = ui_get_mime_icon(ft->mime_type, GTK_ICON_SIZE_MENU);
 }
 
 
@@ -1560,10 +1629,12 @@ GeanyFiletype *filetypes_lookup_by_name(const gchar *name)
 }
 
 
-static void compile_regex(GeanyFiletype *ft, gchar *regstr)
+/* The regex is matched against every line of build output, so it is optimized and kept
+ * until the pattern changes, also when it is invalid so that the error is shown once. */
+static void compile_regex(GeanyFiletype *ft, const gchar *regstr)
 {
 	GError *error = NULL;
-	GRegex *regex = g_regex_new(regstr, 0, 0, &error);
+	GRegex *regex = g_regex_new(regstr, G_REGEX_OPTIMIZE, 0, &error);
 
 	if (!regex)
 	{
@@ -1574,6 +1645,7 @@ static void compile_regex(GeanyFiletype *ft, gchar *regstr)
 	if (ft->priv->error_regex)
 		g_regex_unref(ft->priv->error_regex);
 	ft->priv->error_regex = regex;
+	SETPTR(ft->priv->last_error_pattern, g_strdup(regstr));
 }
 
 
@@ -1602,11 +1674,10 @@ gboolean filetypes_parse_error_message(GeanyFiletype *ft, const gchar *message,
 	if (G_UNLIKELY(EMPTY(regstr)))
 		return FALSE;
 
-	if (!ft->priv->error_regex || regstr != ft->priv->last_error_pattern)
-	{
+	/* the pattern string can be replaced when the build settings change, so compare
+	 * its contents */
+	if (! utils_str_equal(regstr, ft->priv->last_error_pattern))
 		compile_regex(ft, regstr);
-		ft->priv->last_error_pattern = regstr;
-	}
 	if (!ft->priv->error_regex)
 		return FALSE;
 
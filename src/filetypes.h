@@ -202,6 +202,8 @@ void filetypes_free_types(void);
 
 void filetypes_load_config(guint ft_id, gboolean reload);
 
+void filetypes_load_icon(GeanyFiletype *ft);
+
 void filetypes_save_commands(GeanyFiletype *ft);
 
 void filetypes_select_radio_item(const GeanyFiletype *ft);
@@ -28,13 +28,14 @@ typedef struct GeanyFiletypePrivate
 {
 	GtkWidget	*menu_item;			/* holds a pointer to the menu item for this filetype */
 	gboolean	keyfile_loaded;
-	GRegex		*error_regex;
+	GRegex		*error_regex;		/* compiled last_error_pattern, NULL if it is invalid */
 	gchar		*last_error_pattern;
 	gboolean	custom;
 	gint		symbol_list_sort_mode;
 	gboolean	xml_indent_tags; /* XML tag autoindentation, for HTML and XML filetypes */
 	GSList		*tag_files;
 	gboolean	warn_color_scheme;
+	gchar		*config_stamp;	/* state of the config files when last loaded, see get_config_stamp() */
 }
 GeanyFiletypePrivate;
 
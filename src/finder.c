@@ -0,0 +1,908 @@
+/*
+ *      finder.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The Go to Anything dialog, which fuzzy matches what is typed against the open documents,
+ * the files of the project index and the symbols of the workspace. The symbols of the global
+ * tags files are left out, they have no location to go to.
+ *
+ * The candidates are copied from the tag manager into segments, one for each source file
+ * and one for the files. The segments are kept between uses of the
+ * dialog and a segment is only built again when the tags of its source file changed (see
+ * finder_invalidate_tags()). Segments are reference counted and never modified, so a worker
+ * thread can score them while the main thread goes on. The worker keeps the best matches in
+ * a bounded heap and passes them back in an idle callback; a newer query makes it stop.
+ */
+
+#include <string.h>
+
+#include <gdk/gdkkeysyms.h>
+
+#include "geany.h"
+#include "finder.h"
+#include "document.h"
+#include "geanyobject.h"
+#include "navqueue.h"
+#include "project.h"
+#include "projectindex.h"
+#include "support.h"
+#include "ui_utils.h"
+#include "utils.h"
+#include "gtkcompat.h"
+
+
+#define FINDER_MAX_RESULTS 100
+/* number of candidates scored between checks for a newer query, a power of two */
+#define FINDER_CHECK_INTERVAL 4096
+
+/* scores of the characters of a match */
+#define SCORE_MATCH 16
+#define SCORE_CONSECUTIVE 8
+#define SCORE_START 12			/* at the start of the name */
+#define SCORE_BOUNDARY 10		/* after a separator */
+#define SCORE_CAMEL_CASE 8		/* an upper case letter after a lower case one */
+#define SCORE_BASENAME 6		/* in the last path component */
+#define SCORE_GAP 1				/* penalty for each character skipped inside the match */
+#define SCORE_OPEN_DOCUMENT 24	/* bonus for each open document */
+
+
+typedef enum
+{
+	FINDER_KIND_FILE,
+	FINDER_KIND_TAG
+}
+FinderKind;
+
+enum
+{
+	FINDER_COLUMN_MARKUP,
+	FINDER_COLUMN_DETAIL,
+	FINDER_COLUMN_FILE,
+	FINDER_COLUMN_LINE,
+	FINDER_N_COLUMNS
+};
+
+typedef struct FinderItem
+{
+	const gchar	*name;		/* UTF-8, what the query is matched against */
+	const gchar	*detail;	/* shown next to the name */
+	const gchar	*file;		/* locale encoded file to open */
+	guint64		 mask;		/* characters in name, see get_char_mask() */
+	guint		 name_len;
+	guint		 basename_offset;
+	gint		 line;
+	gint		 bonus;
+	FinderKind	 kind;
+}
+FinderItem;
+
+typedef struct FinderSegment
+{
+	volatile gint	 refcount;
+	guint			 n_tags;	/* length of the tags array this was built from */
+	guint			 serial;	/* the last update of the index which used this */
+	GArray			*items;		/* FinderItem */
+	GStringChunk	*strings;
+}
+FinderSegment;
+
+typedef struct FinderMatch
+{
+	gint				 score;
+	const FinderItem	*item;
+}
+FinderMatch;
+
+typedef struct FinderQuery
+{
+	gint			 generation;
+	gchar			*text;			/* lower case */
+	GPtrArray		*segments;		/* references, the files first */
+	FinderMatch		*matches;		/* best first */
+	guint			 n_matches;
+}
+FinderQuery;
+
+
+static struct
+{
+	GtkWidget		*dialog;
+	GtkWidget		*entry;
+	GtkWidget		*tree;
+	GtkListStore	*store;
+}
+finder_ui = {NULL, NULL, NULL, NULL};
+
+static FinderSegment *files_segment = NULL;
+static GHashTable *tag_segments = NULL;	/* TMWorkObject -> FinderSegment */
+static GHashTable *stale_files = NULL;	/* TMWorkObject's whose tags changed */
+static GPtrArray *index_segments = NULL;	/* the segments of the last update, not referenced */
+static guint index_serial = 0;
+static gboolean files_changed = TRUE;
+static guint files_generation = 0;
+
+static GThreadPool *query_pool = NULL;
+static volatile gint query_generation = 0;
+
+
+static FinderSegment *segment_new(guint n_tags)
+{
+	FinderSegment *segment = g_new0(FinderSegment, 1);
+
+	segment->refcount = 1;
+	segment->n_tags = n_tags;
+	segment->items = g_array_new(FALSE, FALSE, sizeof(FinderItem));
+	segment->strings = g_string_chunk_new(4096);
+	return segment;
+}
+
+
+static FinderSegment *segment_ref(FinderSegment *segment)
+{
+	g_atomic_int_inc(&segment->refcount);
+	return segment;
+}
+
+
+/* can be called from the worker thread */
+static void segment_unref(gpointer data)
+{
+	FinderSegment *segment = data;
+
+	if (segment != NULL && g_atomic_int_dec_and_test(&segment->refcount))
+	{
+		g_array_free(segment->items, TRUE);
+		g_string_chunk_free(segment->strings);
+		g_free(segment);
+	}
+}
+
+
+static guint get_char_bit(guchar c)
+{
+	c = g_ascii_tolower(c);
+	if (c >= 'a' && c <= 'z')
+		return c - 'a';
+	if (c >= '0' && c <= '9')
+		return 26 + c - '0';
+	if (c >= 0x80)
+		return 63;
+	return 36 + c % 27;
+}
+
+
+/* Returns a set of the characters of str, ignoring case. A candidate can only match if it
+ * has all characters of the query, which is much cheaper to check than the match itself. */
+static guint64 get_char_mask(const gchar *str)
+{
+	guint64 mask = 0;
+
+	for (; *str != 0; str++)
+		mask |= G_GUINT64_CONSTANT(1) << get_char_bit((guchar) *str);
+	return mask;
+}
+
+
+static void add_item(FinderSegment *segment, const gchar *name, const gchar *detail,
+		const gchar *file, gint line, gint bonus, FinderKind kind)
+{
+	FinderItem item;
+	const gchar *base_name;
+
+	item.name = g_string_chunk_insert_const(segment->strings, name);
+	item.detail = (detail != NULL) ? g_string_chunk_insert_const(segment->strings, detail) : "";
+	item.file = (file != NULL) ? g_string_chunk_insert_const(segment->strings, file) : NULL;
+	item.mask = get_char_mask(name);
+	item.name_len = strlen(name);
+	base_name = (kind == FINDER_KIND_FILE) ? strrchr(item.name, G_DIR_SEPARATOR) : NULL;
+	item.basename_offset = (base_name != NULL) ? (guint) (base_name + 1 - item.name) : 0;
+	item.line = line;
+	item.bonus = bonus;
+	item.kind = kind;
+	g_array_append_val(segment->items, item);
+}
+
+
+typedef struct FilesData
+{
+	FinderSegment	*segment;
+	GHashTable		*added;		/* locale encoded paths */
+	gchar			*base_path;	/* UTF-8 with a trailing separator, or NULL */
+}
+FilesData;
+
+static void add_file(gpointer data, gpointer user_data)
+{
+	const gchar *locale_path = data;
+	FilesData *fd = user_data;
+	const FinderItem *item;
+	gchar *utf8_path;
+	const gchar *name;
+	gint bonus;
+
+	if (g_hash_table_lookup(fd->added, locale_path) != NULL)
+		return;
+
+	utf8_path = utils_get_utf8_from_locale(locale_path);
+	name = utf8_path;
+	/* files below the base path of the project are shown relative to it */
+	if (fd->base_path != NULL && g_str_has_prefix(utf8_path, fd->base_path))
+		name += strlen(fd->base_path);
+	/* open documents rank higher */
+	bonus = (document_find_by_real_path(locale_path) != NULL) ? SCORE_OPEN_DOCUMENT : 0;
+
+	add_item(fd->segment, name, NULL, locale_path, 0, bonus, FINDER_KIND_FILE);
+	item = &g_array_index(fd->segment->items, FinderItem, fd->segment->items->len - 1);
+	g_hash_table_insert(fd->added, (gpointer) item->file, (gpointer) item->file);
+	g_free(utf8_path);
+}
+
+
+static void update_files_segment(void)
+{
+	FilesData fd;
+	guint i;
+
+	if (! files_changed && files_generation == projectindex_get_generation())
+		return;
+
+	fd.segment = segment_new(0);
+	fd.added = g_hash_table_new(g_str_hash, g_str_equal);
+	fd.base_path = project_get_base_path();
+	if (fd.base_path != NULL && ! g_str_has_suffix(fd.base_path, G_DIR_SEPARATOR_S))
+		SETPTR(fd.base_path, g_strconcat(fd.base_path, G_DIR_SEPARATOR_S, NULL));
+
+	foreach_document(i)
+	{
+		if (documents[i]->real_path != NULL)
+			add_file(documents[i]->real_path, &fd);
+	}
+	projectindex_foreach_file(add_file, &fd);
+
+	g_hash_table_destroy(fd.added);
+	g_free(fd.base_path);
+	segment_unref(files_segment);
+	files_segment = fd.segment;
+	files_changed = FALSE;
+	files_generation = projectindex_get_generation();
+}
+
+
+/* file_name is the locale encoded file of the tags */
+static FinderSegment *build_tag_segment(const GPtrArray *tags, const gchar *file_name)
+{
+	FinderSegment *segment = segment_new(tags->len);
+	gchar *utf8_base_name = g_path_get_basename(file_name);
+	GString *detail = g_string_new(NULL);
+	guint i;
+
+	SETPTR(utf8_base_name, utils_get_utf8_from_locale(utf8_base_name));
+	for (i = 0; i < tags->len; i++)
+	{
+		TMTag *tag = tags->pdata[i];
+		const gchar *type_name;
+
+		if (tag->type == tm_tag_undef_t || tag->type == tm_tag_file_t || EMPTY(tag->name))
+			continue;
+
+		type_name = tm_tag_type_name(tag);
+		g_string_assign(detail, (type_name != NULL) ? type_name : "");
+		if (! EMPTY(tag->atts.entry.scope))
+			g_string_append_printf(detail, " %s %s", _("in"), tag->atts.entry.scope);
+		g_string_append_printf(detail, " - %s:%lu", utf8_base_name, tag->atts.entry.line);
+		add_item(segment, tag->name, detail->str, file_name, (gint) tag->atts.entry.line,
+			0, FINDER_KIND_TAG);
+	}
+	g_string_free(detail, TRUE);
+	g_free(utf8_base_name);
+	return segment;
+}
+
+
+static void add_tag_segment(TMWorkObject *source_file)
+{
+	FinderSegment *segment;
+
+	/* inactive files of the project index are open and have their own source file */
+	if (source_file->tags_array == NULL || TM_SOURCE_FILE(source_file)->inactive)
+		return;
+
+	segment = g_hash_table_lookup(tag_segments, source_file);
+	if (segment != NULL && segment->serial == index_serial)
+		return;	/* already added */
+	if (segment == NULL || segment->n_tags != source_file->tags_array->len ||
+		g_hash_table_lookup(stale_files, source_file) != NULL)
+	{
+		segment = build_tag_segment(source_file->tags_array, source_file->file_name);
+		g_hash_table_replace(tag_segments, source_file, segment);
+	}
+	segment->serial = index_serial;
+	g_ptr_array_add(index_segments, segment);
+}
+
+
+/* Brings the segments up to date with the workspace, only rebuilding those which changed */
+static void update_index(void)
+{
+	const TMWorkspace *workspace = tm_get_workspace();
+	GHashTableIter iter;
+	gpointer value;
+	guint i, j;
+
+	index_serial++;
+	g_ptr_array_set_size(index_segments, 0);
+
+	update_files_segment();
+	g_ptr_array_add(index_segments, files_segment);
+
+	for (i = 0; workspace->work_objects != NULL && i < workspace->work_objects->len; i++)
+	{
+		TMWorkObject *wo = workspace->work_objects->pdata[i];
+
+		if (IS_TM_PROJECT(wo))
+		{
+			GPtrArray *file_list = TM_PROJECT(wo)->file_list;
+
+			for (j = 0; file_list != NULL && j < file_list->len; j++)
+				add_tag_segment(file_list->pdata[j]);
+		}
+		else
+			add_tag_segment(wo);
+	}
+	/* forget the source files which are gone */
+	g_hash_table_iter_init(&iter, tag_segments);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+	{
+		FinderSegment *segment = value;
+
+		if (segment->serial != index_serial)
+			g_hash_table_iter_remove(&iter);
+	}
+	g_hash_table_remove_all(stale_files);
+}
+
+
+/* Finds the shortest match of query in name which ends where the first match ends, query
+ * is lower case and name is compared ignoring the case of ASCII letters.
+ * Returns: whether name matches, with start and end set to the first and last matching
+ * characters. */
+static gboolean find_match(const gchar *name, const gchar *query, gsize query_len,
+		const gchar **start, const gchar **end)
+{
+	const gchar *p;
+	gsize i = 0;
+
+	for (p = name; *p != 0; p++)
+	{
+		if (g_ascii_tolower(*p) == query[i] && ++i == query_len)
+			break;
+	}
+	if (*p == 0)
+		return FALSE;
+	*end = p;
+
+	for (; ; p--)
+	{
+		if (g_ascii_tolower(*p) == query[i - 1] && --i == 0)
+			break;
+	}
+	*start = p;
+	return TRUE;
+}
+
+
+static gint get_boundary_bonus(const gchar *name, const gchar *p)
+{
+	if (p == name)
+		return SCORE_START;
+	if (strchr("/\\_-. :", p[-1]) != NULL)
+		return SCORE_BOUNDARY;
+	if (g_ascii_islower(p[-1]) && g_ascii_isupper(*p))
+		return SCORE_CAMEL_CASE;
+	return 0;
+}
+
+
+/* Returns: the score of item for query, or G_MININT if it doesn't match. */
+static gint score_item(const FinderItem *item, const gchar *query, gsize query_len)
+{
+	const gchar *name = item->name;
+	const gchar *basename = name + item->basename_offset;
+	const gchar *start, *end, *p;
+	gint score = item->bonus - (gint) (item->name_len >> 3);
+	gboolean consecutive = FALSE;
+	gsize i = 0;
+
+	if (! find_match(name, query, query_len, &start, &end))
+		return G_MININT;
+
+	for (p = start; p <= end; p++)
+	{
+		if (i < query_len && g_ascii_tolower(*p) == query[i])
+		{
+			score += SCORE_MATCH + get_boundary_bonus(name, p);
+			if (consecutive)
+				score += SCORE_CONSECUTIVE;
+			if (p >= basename)
+				score += SCORE_BASENAME;
+			consecutive = TRUE;
+			i++;
+		}
+		else
+		{
+			score -= SCORE_GAP;
+			consecutive = FALSE;
+		}
+	}
+	return score;
+}
+
+
+static gboolean match_is_better(const FinderMatch *a, const FinderMatch *b)
+{
+	if (a->score != b->score)
+		return a->score > b->score;
+	return a->item->name_len < b->item->name_len;
+}
+
+
+static gint compare_matches(gconstpointer a, gconstpointer b)
+{
+	if (match_is_better(a, b))
+		return -1;
+	return match_is_better(b, a) ? 1 : 0;
+}
+
+
+/* Adds match to a heap of the FINDER_MAX_RESULTS best matches, with the worst at the top */
+static void push_match(FinderMatch *heap, guint *n_matches, const FinderMatch *match)
+{
+	guint i, child;
+
+	if (*n_matches < FINDER_MAX_RESULTS)
+	{
+		for (i = (*n_matches)++; i > 0; i = (i - 1) / 2)
+		{
+			if (! match_is_better(&heap[(i - 1) / 2], match))
+				break;
+			heap[i] = heap[(i - 1) / 2];
+		}
+		heap[i] = *match;
+		return;
+	}
+	if (! match_is_better(match, &heap[0]))
+		return;
+
+	/* replace the worst match */
+	for (i = 0; (child = 2 * i + 1) < *n_matches; i = child)
+	{
+		if (child + 1 < *n_matches && match_is_better(&heap[child], &heap[child + 1]))
+			child++;
+		if (match_is_better(&heap[child], match))
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = *match;
+}
+
+
+static void free_query(FinderQuery *query)
+{
+	g_ptr_array_foreach(query->segments, (GFunc) segment_unref, NULL);
+	g_ptr_array_free(query->segments, TRUE);
+	g_free(query->matches);
+	g_free(query->text);
+	g_free(query);
+}
+
+
+static void show_matches(FinderQuery *query);
+
+static gboolean on_query_done(gpointer data)
+{
+	FinderQuery *query = data;
+
+	if (query->generation == g_atomic_int_get(&query_generation) && finder_ui.dialog != NULL)
+		show_matches(query);
+	free_query(query);
+	return FALSE;
+}
+
+
+/* Scores all candidates for a query, in the worker thread */
+static void run_query(gpointer data, gpointer user_data)
+{
+	FinderQuery *query = data;
+	gsize query_len = strlen(query->text);
+	guint64 query_mask = get_char_mask(query->text);
+	guint i, j, n_scored = 0;
+
+	query->matches = g_new(FinderMatch, FINDER_MAX_RESULTS);
+	for (i = 0; i < query->segments->len; i++)
+	{
+		FinderSegment *segment = query->segments->pdata[i];
+
+		for (j = 0; j < segment->items->len; j++)
+		{
+			const FinderItem *item = &g_array_index(segment->items, FinderItem, j);
+			FinderMatch match;
+
+			if ((++n_scored & (FINDER_CHECK_INTERVAL - 1)) == 0 &&
+				query->generation != g_atomic_int_get(&query_generation))
+			{
+				free_query(query);
+				return;
+			}
+			if (query_len == 0)
+			{
+				/* without a query only list the files, open documents first */
+				if (item->kind != FINDER_KIND_FILE)
+					continue;
+				match.score = item->bonus;
+			}
+			else
+			{
+				if ((query_mask & ~item->mask) != 0)
+					continue;
+				match.score = score_item(item, query->text, query_len);
+				if (match.score == G_MININT)
+					continue;
+			}
+			match.item = item;
+			push_match(query->matches, &query->n_matches, &match);
+		}
+	}
+	qsort(query->matches, query->n_matches, sizeof(FinderMatch), compare_matches);
+	g_idle_add(on_query_done, query);
+}
+
+
+static void start_query(void)
+{
+	FinderQuery *query = g_new0(FinderQuery, 1);
+	guint i;
+
+	g_atomic_int_inc(&query_generation);
+	query->generation = g_atomic_int_get(&query_generation);
+	query->text = g_ascii_strdown(gtk_entry_get_text(GTK_ENTRY(finder_ui.entry)), -1);
+	query->segments = g_ptr_array_sized_new(index_segments->len);
+	for (i = 0; i < index_segments->len; i++)
+		g_ptr_array_add(query->segments, segment_ref(index_segments->pdata[i]));
+
+	if (query_pool != NULL)
+		g_thread_pool_push(query_pool, query, NULL);
+	else
+		run_query(query, NULL);
+}
+
+
+static void append_escaped_char(GString *str, gchar c)
+{
+	switch (c)
+	{
+		case '&': g_string_append(str, "&amp;"); break;
+		case '<': g_string_append(str, "&lt;"); break;
+		case '>': g_string_append(str, "&gt;"); break;
+		default: g_string_append_c(str, c);
+	}
+}
+
+
+/* Returns name as markup with the matched characters in bold */
+static gchar *get_match_markup(const gchar *name, const gchar *query)
+{
+	GString *str = g_string_sized_new(strlen(name) + 32);
+	gsize query_len = strlen(query);
+	const gchar *start = NULL, *end = NULL, *p;
+	gsize i = 0;
+
+	if (query_len > 0)
+		find_match(name, query, query_len, &start, &end);
+
+	for (p = name; *p != 0; p++)
+	{
+		/* don't split multibyte characters */
+		if (start != NULL && p >= start && p <= end && i < query_len &&
+			g_ascii_tolower(*p) == query[i])
+		{
+			i++;
+			if ((guchar) *p < 0x80)
+			{
+				g_string_append(str, "<b>");
+				append_escaped_char(str, *p);
+				g_string_append(str, "</b>");
+				continue;
+			}
+		}
+		append_escaped_char(str, *p);
+	}
+	return g_string_free(str, FALSE);
+}
+
+
+static void show_matches(FinderQuery *query)
+{
+	GtkTreePath *path;
+	guint i;
+
+	gtk_list_store_clear(finder_ui.store);
+	for (i = 0; i < query->n_matches; i++)
+	{
+		const FinderItem *item = query->matches[i].item;
+		gchar *markup = get_match_markup(item->name, query->text);
+
+		gtk_list_store_insert_with_values(finder_ui.store, NULL, -1,
+			FINDER_COLUMN_MARKUP, markup,
+			FINDER_COLUMN_DETAIL, item->detail,
+			FINDER_COLUMN_FILE, item->file,
+			FINDER_COLUMN_LINE, item->line,
+			-1);
+		g_free(markup);
+	}
+	if (query->n_matches > 0)
+	{
+		path = gtk_tree_path_new_first();
+		gtk_tree_view_set_cursor(GTK_TREE_VIEW(finder_ui.tree), path, NULL, FALSE);
+		gtk_tree_path_free(path);
+	}
+}
+
+
+static void activate_row(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	gchar *file;
+	gint line;
+
+	gtk_tree_model_get(model, iter, FINDER_COLUMN_FILE, &file, FINDER_COLUMN_LINE, &line, -1);
+	gtk_widget_hide(finder_ui.dialog);
+
+	if (file != NULL)
+	{
+		GeanyDocument *old_doc = document_get_current();
+		GeanyDocument *doc = document_open_file(file, FALSE, NULL, NULL);
+
+		if (doc != NULL && line > 0)
+			navqueue_goto_line(old_doc, doc, line);
+	}
+	g_free(file);
+}
+
+
+static void on_entry_activate(GtkEntry *entry, gpointer user_data)
+{
+	GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(finder_ui.tree));
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+
+	if (gtk_tree_selection_get_selected(selection, &model, &iter))
+		activate_row(model, &iter);
+}
+
+
+static void on_row_activated(GtkTreeView *tree, GtkTreePath *path, GtkTreeViewColumn *column,
+		gpointer user_data)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeIter iter;
+
+	if (gtk_tree_model_get_iter(model, &iter, path))
+		activate_row(model, &iter);
+}
+
+
+static void move_selection(gint step)
+{
+	GtkTreeView *tree = GTK_TREE_VIEW(finder_ui.tree);
+	GtkTreeModel *model = GTK_TREE_MODEL(finder_ui.store);
+	GtkTreeIter iter;
+	GtkTreePath *path;
+	gint n_rows = gtk_tree_model_iter_n_children(model, NULL);
+	gint pos = 0;
+
+	if (n_rows == 0)
+		return;
+
+	if (gtk_tree_selection_get_selected(gtk_tree_view_get_selection(tree), NULL, &iter))
+	{
+		path = gtk_tree_model_get_path(model, &iter);
+		pos = gtk_tree_path_get_indices(path)[0] + step;
+		gtk_tree_path_free(path);
+	}
+	pos = CLAMP(pos, 0, n_rows - 1);
+	path = gtk_tree_path_new_from_indices(pos, -1);
+	gtk_tree_view_set_cursor(tree, path, NULL, FALSE);
+	gtk_tree_view_scroll_to_cell(tree, path, NULL, FALSE, 0, 0);
+	gtk_tree_path_free(path);
+}
+
+
+/* the entry keeps the focus while the selection is moved */
+static gboolean on_entry_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+	switch (event->keyval)
+	{
+		case GDK_Up:
+		case GDK_KP_Up:
+			move_selection(-1);
+			return TRUE;
+		case GDK_Down:
+		case GDK_KP_Down:
+			move_selection(1);
+			return TRUE;
+		case GDK_Page_Up:
+		case GDK_KP_Page_Up:
+			move_selection(-10);
+			return TRUE;
+		case GDK_Page_Down:
+		case GDK_KP_Page_Down:
+			move_selection(10);
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+static void on_entry_changed(GtkEditable *editable, gpointer user_data)
+{
+	start_query();
+}
+
+
+static void create_dialog(void)
+{
+	GtkWidget *vbox, *scrollwin;
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
+
+	finder_ui.dialog = gtk_dialog_new_with_buttons(_("Go to Anything"),
+		GTK_WINDOW(main_widgets.window), GTK_DIALOG_DESTROY_WITH_PARENT, NULL);
+	gtk_window_set_default_size(GTK_WINDOW(finder_ui.dialog), 550, 350);
+	vbox = ui_dialog_vbox_new(GTK_DIALOG(finder_ui.dialog));
+	gtk_widget_set_name(finder_ui.dialog, "GeanyDialog");
+
+	finder_ui.entry = gtk_entry_new();
+	gtk_box_pack_start(GTK_BOX(vbox), finder_ui.entry, FALSE, FALSE, 0);
+
+	finder_ui.store = gtk_list_store_new(FINDER_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING,
+		G_TYPE_STRING, G_TYPE_INT);
+	finder_ui.tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(finder_ui.store));
+	g_object_unref(finder_ui.store);
+	gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(finder_ui.tree), FALSE);
+
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_START, NULL);
+	column = gtk_tree_view_column_new_with_attributes(NULL, renderer,
+		"markup", FINDER_COLUMN_MARKUP, NULL);
+	gtk_tree_view_column_set_expand(column, TRUE);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(finder_ui.tree), column);
+
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, "sensitive", FALSE, NULL);
+	column = gtk_tree_view_column_new_with_attributes(NULL, renderer,
+		"text", FINDER_COLUMN_DETAIL, NULL);
+	gtk_tree_view_column_set_expand(column, TRUE);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(finder_ui.tree), column);
+
+	scrollwin = gtk_scrolled_window_new(NULL, NULL);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrollwin),
+		GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+	gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(scrollwin), GTK_SHADOW_IN);
+	gtk_container_add(GTK_CONTAINER(scrollwin), finder_ui.tree);
+	gtk_box_pack_start(GTK_BOX(vbox), scrollwin, TRUE, TRUE, 0);
+
+	g_signal_connect(finder_ui.entry, "changed", G_CALLBACK(on_entry_changed), NULL);
+	g_signal_connect(finder_ui.entry, "activate", G_CALLBACK(on_entry_activate), NULL);
+	g_signal_connect(finder_ui.entry, "key-press-event", G_CALLBACK(on_entry_key_press), NULL);
+	g_signal_connect(finder_ui.tree, "row-activated", G_CALLBACK(on_row_activated), NULL);
+	g_signal_connect(finder_ui.dialog, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+	g_signal_connect(finder_ui.dialog, "destroy", G_CALLBACK(gtk_widget_destroyed),
+		&finder_ui.dialog);
+
+	gtk_widget_show_all(vbox);
+}
+
+
+void finder_show(void)
+{
+	if (finder_ui.dialog == NULL)
+		create_dialog();
+	if (query_pool == NULL)
+	{
+		GError *error = NULL;
+
+		query_pool = g_thread_pool_new(run_query, NULL, 1, FALSE, &error);
+		if (query_pool == NULL)
+		{
+			/* score in the main thread then */
+			geany_debug("Could not create finder thread: %s", error->message);
+			g_error_free(error);
+		}
+	}
+
+	update_index();
+	gtk_list_store_clear(finder_ui.store);
+	gtk_window_present(GTK_WINDOW(finder_ui.dialog));
+	gtk_widget_grab_focus(finder_ui.entry);
+	gtk_editable_select_region(GTK_EDITABLE(finder_ui.entry), 0, -1);
+	start_query();
+}
+
+
+/* Should be called whenever the tags of source_file changed, so that they are copied again
+ * the next time the dialog is shown. */
+void finder_invalidate_tags(TMWorkObject *source_file)
+{
+	if (stale_files != NULL)
+		g_hash_table_insert(stale_files, source_file, source_file);
+}
+
+
+static void on_document_changed(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+	files_changed = TRUE;
+}
+
+
+static void on_project_open(GObject *obj, GKeyFile *config, gpointer user_data)
+{
+	files_changed = TRUE;
+}
+
+
+static void on_project_close(GObject *obj, gpointer user_data)
+{
+	files_changed = TRUE;
+}
+
+
+void finder_init(void)
+{
+	tag_segments = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, segment_unref);
+	stale_files = g_hash_table_new(g_direct_hash, g_direct_equal);
+	index_segments = g_ptr_array_new();
+
+	g_signal_connect(geany_object, "document-open", G_CALLBACK(on_document_changed), NULL);
+	g_signal_connect(geany_object, "document-save", G_CALLBACK(on_document_changed), NULL);
+	g_signal_connect(geany_object, "document-close", G_CALLBACK(on_document_changed), NULL);
+	g_signal_connect(geany_object, "project-open", G_CALLBACK(on_project_open), NULL);
+	g_signal_connect(geany_object, "project-close", G_CALLBACK(on_project_close), NULL);
+}
+
+
+void finder_finalize(void)
+{
+	if (query_pool != NULL)
+	{
+		/* make a running query stop */
+		g_atomic_int_inc(&query_generation);
+		g_thread_pool_free(query_pool, TRUE, TRUE);
+		query_pool = NULL;
+	}
+	if (finder_ui.dialog != NULL)
+		gtk_widget_destroy(finder_ui.dialog);
+
+	g_hash_table_destroy(tag_segments);
+	g_hash_table_destroy(stale_files);
+	g_ptr_array_free(index_segments, TRUE);
+	segment_unref(files_segment);
+	tag_segments = stale_files = NULL;
+	index_segments = NULL;
+	files_segment = NULL;
+}
@@ -0,0 +1,35 @@
+/*
+ *      finder.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef GEANY_FINDER_H
+#define GEANY_FINDER_H 1
+
+
+void finder_init(void);
+
+void finder_finalize(void);
+
+void finder_show(void);
+
+void finder_invalidate_tags(TMWorkObject *source_file);
+
+
+#endif
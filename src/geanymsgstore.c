@@ -0,0 +1,438 @@
+/*
+ *      geanymsgstore.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A list model for the Compiler and Messages tabs, which can hold a lot of lines.
+ * Unlike GtkListStore, there is no tree node, GValue or copy of a color per row:
+ * the text of the lines is appended to large blocks and each row only has a small
+ * record pointing into them. Values are made when they are asked for, without copying.
+ * Optionally, the oldest lines are removed when there are more than a maximum number.
+ */
+
+
+#include <string.h>
+
+#include "geany.h"
+#include "geanymsgstore.h"
+
+
+/* size of the blocks the text is stored in, longer lines get a block of their own */
+#define TEXT_BLOCK_SIZE (64 * 1024)
+
+
+typedef struct
+{
+	const gchar	*text;		/* points into a TextBlock */
+	gpointer	 doc;
+	gint		 line;
+	gint		 msg_color;
+} MsgLine;
+
+typedef struct
+{
+	guint	last_serial;	/* serial of the last line stored in the block */
+	gsize	used;
+	gsize	size;
+	/* the text follows */
+} TextBlock;
+
+struct _GeanyMsgStoreClass
+{
+	GObjectClass parent_class;
+};
+
+/* Every line gets a serial number, which is what iters hold, so that they stay valid
+ * when lines are appended or the oldest ones are removed. */
+struct _GeanyMsgStore
+{
+	GObject parent;
+	gint stamp;
+	GArray *lines;			/* MsgLine */
+	guint dead;				/* number of removed lines still at the start of lines */
+	guint first_serial;		/* serial of the first row */
+	guint max_lines;		/* 0 for no limit */
+	GQueue blocks;			/* TextBlock, the last one is appended to */
+	GeanyMsgStoreColorFunc get_color;
+};
+
+
+static void geany_msg_store_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(GeanyMsgStore, geany_msg_store, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, geany_msg_store_tree_model_init))
+
+
+static guint get_n_rows(GeanyMsgStore *store)
+{
+	return store->lines->len - store->dead;
+}
+
+
+static MsgLine *get_line(GeanyMsgStore *store, guint row)
+{
+	return &g_array_index(store->lines, MsgLine, store->dead + row);
+}
+
+
+static void set_iter(GeanyMsgStore *store, GtkTreeIter *iter, guint row)
+{
+	iter->stamp = store->stamp;
+	iter->user_data = GUINT_TO_POINTER(store->first_serial + row);
+}
+
+
+/* Returns the row of iter, or -1 if it is invalid */
+static gint get_iter_row(GeanyMsgStore *store, GtkTreeIter *iter)
+{
+	guint row;
+
+	g_return_val_if_fail(iter->stamp == store->stamp, -1);
+
+	row = GPOINTER_TO_UINT(iter->user_data) - store->first_serial;
+	return row < get_n_rows(store) ? (gint) row : -1;
+}
+
+
+static GtkTreeModelFlags msg_store_get_flags(GtkTreeModel *model)
+{
+	return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+
+static gint msg_store_get_n_columns(GtkTreeModel *model)
+{
+	return MSG_STORE_N_COLUMNS;
+}
+
+
+static GType msg_store_get_column_type(GtkTreeModel *model, gint column)
+{
+	switch (column)
+	{
+		case MSG_STORE_COL_LINE: return G_TYPE_INT;
+		case MSG_STORE_COL_DOC: return G_TYPE_POINTER;
+		case MSG_STORE_COL_COLOR: return GDK_TYPE_COLOR;
+		case MSG_STORE_COL_STRING: return G_TYPE_STRING;
+		case MSG_STORE_COL_MSG_COLOR: return G_TYPE_INT;
+	}
+	g_return_val_if_reached(G_TYPE_INVALID);
+}
+
+
+static gboolean msg_store_get_iter(GtkTreeModel *model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	GeanyMsgStore *store = GEANY_MSG_STORE(model);
+	gint row;
+
+	g_return_val_if_fail(gtk_tree_path_get_depth(path) > 0, FALSE);
+
+	row = gtk_tree_path_get_indices(path)[0];
+	if (row < 0 || (guint) row >= get_n_rows(store))
+		return FALSE;
+
+	set_iter(store, iter, row);
+	return TRUE;
+}
+
+
+static GtkTreePath *msg_store_get_path(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	gint row = get_iter_row(GEANY_MSG_STORE(model), iter);
+
+	g_return_val_if_fail(row >= 0, NULL);
+
+	return gtk_tree_path_new_from_indices(row, -1);
+}
+
+
+static void msg_store_get_value(GtkTreeModel *model, GtkTreeIter *iter, gint column,
+		GValue *value)
+{
+	GeanyMsgStore *store = GEANY_MSG_STORE(model);
+	gint row = get_iter_row(store, iter);
+	MsgLine *line;
+
+	g_value_init(value, msg_store_get_column_type(model, column));
+	g_return_if_fail(row >= 0);
+
+	line = get_line(store, row);
+	switch (column)
+	{
+		case MSG_STORE_COL_LINE:
+			g_value_set_int(value, line->line);
+			break;
+		case MSG_STORE_COL_DOC:
+			g_value_set_pointer(value, line->doc);
+			break;
+		case MSG_STORE_COL_COLOR:
+			g_value_set_static_boxed(value, store->get_color(line->msg_color));
+			break;
+		case MSG_STORE_COL_STRING:
+			g_value_set_static_string(value, line->text);
+			break;
+		case MSG_STORE_COL_MSG_COLOR:
+			g_value_set_int(value, line->msg_color);
+			break;
+	}
+}
+
+
+static gboolean msg_store_iter_next(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	GeanyMsgStore *store = GEANY_MSG_STORE(model);
+	gint row = get_iter_row(store, iter);
+
+	if (row < 0 || (guint) row + 1 >= get_n_rows(store))
+	{
+		iter->stamp = 0;
+		return FALSE;
+	}
+	set_iter(store, iter, row + 1);
+	return TRUE;
+}
+
+
+static gboolean msg_store_iter_nth_child(GtkTreeModel *model, GtkTreeIter *iter,
+		GtkTreeIter *parent, gint n)
+{
+	GeanyMsgStore *store = GEANY_MSG_STORE(model);
+
+	if (parent != NULL || n < 0 || (guint) n >= get_n_rows(store))
+		return FALSE;
+
+	set_iter(store, iter, n);
+	return TRUE;
+}
+
+
+static gboolean msg_store_iter_children(GtkTreeModel *model, GtkTreeIter *iter,
+		GtkTreeIter *parent)
+{
+	return msg_store_iter_nth_child(model, iter, parent, 0);
+}
+
+
+static gboolean msg_store_iter_has_child(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+
+static gint msg_store_iter_n_children(GtkTreeModel *model, GtkTreeIter *iter)
+{
+	if (iter != NULL)
+		return 0;
+	return get_n_rows(GEANY_MSG_STORE(model));
+}
+
+
+static gboolean msg_store_iter_parent(GtkTreeModel *model, GtkTreeIter *iter,
+		GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+
+static void geany_msg_store_tree_model_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags = msg_store_get_flags;
+	iface->get_n_columns = msg_store_get_n_columns;
+	iface->get_column_type = msg_store_get_column_type;
+	iface->get_iter = msg_store_get_iter;
+	iface->get_path = msg_store_get_path;
+	iface->get_value = msg_store_get_value;
+	iface->iter_next = msg_store_iter_next;
+	iface->iter_children = msg_store_iter_children;
+	iface->iter_has_child = msg_store_iter_has_child;
+	iface->iter_n_children = msg_store_iter_n_children;
+	iface->iter_nth_child = msg_store_iter_nth_child;
+	iface->iter_parent = msg_store_iter_parent;
+}
+
+
+static void free_blocks(GeanyMsgStore *store)
+{
+	TextBlock *block;
+
+	while ((block = g_queue_pop_head(&store->blocks)) != NULL)
+		g_free(block);
+}
+
+
+static void geany_msg_store_finalize(GObject *object)
+{
+	GeanyMsgStore *store = GEANY_MSG_STORE(object);
+
+	g_array_free(store->lines, TRUE);
+	free_blocks(store);
+
+	G_OBJECT_CLASS(geany_msg_store_parent_class)->finalize(object);
+}
+
+
+static void geany_msg_store_class_init(GeanyMsgStoreClass *klass)
+{
+	GObjectClass *g_object_class = G_OBJECT_CLASS(klass);
+
+	g_object_class->finalize = geany_msg_store_finalize;
+}
+
+
+static void geany_msg_store_init(GeanyMsgStore *store)
+{
+	store->stamp = g_random_int();
+	store->lines = g_array_new(FALSE, FALSE, sizeof(MsgLine));
+	g_queue_init(&store->blocks);
+}
+
+
+/* Creates a new store, get_color is called for the color of a row's msg_color. */
+GeanyMsgStore *geany_msg_store_new(GeanyMsgStoreColorFunc get_color)
+{
+	GeanyMsgStore *store = g_object_new(GEANY_MSG_STORE_TYPE, NULL);
+
+	store->get_color = get_color;
+	return store;
+}
+
+
+/* Copies text into the last block, or a new one if it doesn't fit. */
+static const gchar *store_text(GeanyMsgStore *store, const gchar *text, guint serial)
+{
+	TextBlock *block = g_queue_peek_tail(&store->blocks);
+	gsize len = strlen(text) + 1;
+	gchar *dest;
+
+	if (block == NULL || block->size - block->used < len)
+	{
+		gsize size = MAX(TEXT_BLOCK_SIZE, len);
+
+		block = g_malloc(sizeof(TextBlock) + size);
+		block->used = 0;
+		block->size = size;
+		g_queue_push_tail(&store->blocks, block);
+	}
+	dest = (gchar *) (block + 1) + block->used;
+	memcpy(dest, text, len);
+	block->used += len;
+	block->last_serial = serial;
+	return dest;
+}
+
+
+/* Removes the n oldest rows */
+static void remove_first_rows(GeanyMsgStore *store, guint n)
+{
+	GtkTreePath *path = gtk_tree_path_new_first();
+
+	while (n-- > 0)
+	{
+		store->dead++;
+		store->first_serial++;
+		gtk_tree_model_row_deleted(GTK_TREE_MODEL(store), path);
+	}
+	gtk_tree_path_free(path);
+
+	/* free the blocks which only hold removed lines, and the removed line records once
+	 * they take more space than the others */
+	while (g_queue_get_length(&store->blocks) > 1)
+	{
+		TextBlock *block = g_queue_peek_head(&store->blocks);
+
+		if (block->last_serial >= store->first_serial)
+			break;
+		g_free(g_queue_pop_head(&store->blocks));
+	}
+	if (store->dead > get_n_rows(store))
+	{
+		g_array_remove_range(store->lines, 0, store->dead);
+		store->dead = 0;
+	}
+}
+
+
+/* Appends a row and sets iter to it, if it is not NULL. text must be valid UTF-8. */
+void geany_msg_store_append(GeanyMsgStore *store, gint msg_color, gint line, gpointer doc,
+		const gchar *text, GtkTreeIter *iter)
+{
+	GtkTreeIter new_iter;
+	GtkTreePath *path;
+	MsgLine msg_line;
+	guint row;
+
+	g_return_if_fail(IS_GEANY_MSG_STORE(store));
+	g_return_if_fail(text != NULL);
+
+	/* remove the oldest eighth at once, so that this doesn't happen for every line */
+	if (store->max_lines > 0 && get_n_rows(store) >= store->max_lines)
+		remove_first_rows(store, get_n_rows(store) - store->max_lines + store->max_lines / 8 + 1);
+
+	row = get_n_rows(store);
+	msg_line.text = store_text(store, text, store->first_serial + row);
+	msg_line.doc = doc;
+	msg_line.line = line;
+	msg_line.msg_color = msg_color;
+	g_array_append_val(store->lines, msg_line);
+
+	set_iter(store, &new_iter, row);
+	path = gtk_tree_path_new_from_indices(row, -1);
+	gtk_tree_model_row_inserted(GTK_TREE_MODEL(store), path, &new_iter);
+	gtk_tree_path_free(path);
+
+	if (iter != NULL)
+		*iter = new_iter;
+}
+
+
+void geany_msg_store_clear(GeanyMsgStore *store)
+{
+	GtkTreePath *path;
+	guint n;
+
+	g_return_if_fail(IS_GEANY_MSG_STORE(store));
+
+	/* remove the rows from the end, which is cheaper for the views */
+	n = get_n_rows(store);
+	path = gtk_tree_path_new_from_indices(n, -1);
+	while (n-- > 0)
+	{
+		g_array_set_size(store->lines, store->dead + n);
+		gtk_tree_path_prev(path);
+		gtk_tree_model_row_deleted(GTK_TREE_MODEL(store), path);
+	}
+	gtk_tree_path_free(path);
+
+	g_array_set_size(store->lines, 0);
+	store->dead = 0;
+	store->first_serial = 0;
+	free_blocks(store);
+	/* invalidate existing iters */
+	store->stamp++;
+}
+
+
+/* Sets the maximum number of rows, the oldest rows are removed when a row is
+ * appended to a full store. 0 means no limit. */
+void geany_msg_store_set_max_lines(GeanyMsgStore *store, guint max_lines)
+{
+	g_return_if_fail(IS_GEANY_MSG_STORE(store));
+
+	store->max_lines = max_lines;
+}
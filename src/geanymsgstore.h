@@ -0,0 +1,65 @@
+/*
+ *      geanymsgstore.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef GEANY_MSG_STORE_H
+#define GEANY_MSG_STORE_H
+
+G_BEGIN_DECLS
+
+
+#define GEANY_MSG_STORE_TYPE				(geany_msg_store_get_type())
+#define GEANY_MSG_STORE(obj)				(G_TYPE_CHECK_INSTANCE_CAST((obj), \
+	GEANY_MSG_STORE_TYPE, GeanyMsgStore))
+#define GEANY_MSG_STORE_CLASS(klass)		(G_TYPE_CHECK_CLASS_CAST((klass), \
+	GEANY_MSG_STORE_TYPE, GeanyMsgStoreClass))
+#define IS_GEANY_MSG_STORE(obj)				(G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+	GEANY_MSG_STORE_TYPE))
+#define IS_GEANY_MSG_STORE_CLASS(klass)		(G_TYPE_CHECK_CLASS_TYPE((klass), \
+	GEANY_MSG_STORE_TYPE))
+
+
+/* Columns of the store */
+enum
+{
+	MSG_STORE_COL_LINE,			/* G_TYPE_INT, the line the message is about or -1 */
+	MSG_STORE_COL_DOC,			/* G_TYPE_POINTER, the document the message is about or NULL */
+	MSG_STORE_COL_COLOR,		/* GDK_TYPE_COLOR, NULL for the default color */
+	MSG_STORE_COL_STRING,		/* G_TYPE_STRING */
+	MSG_STORE_COL_MSG_COLOR,	/* G_TYPE_INT, one of MsgColors */
+	MSG_STORE_N_COLUMNS
+};
+
+typedef struct _GeanyMsgStore       GeanyMsgStore;
+typedef struct _GeanyMsgStoreClass  GeanyMsgStoreClass;
+
+typedef const GdkColor *(*GeanyMsgStoreColorFunc)(gint msg_color);
+
+GType			geany_msg_store_get_type			(void);
+GeanyMsgStore*	geany_msg_store_new					(GeanyMsgStoreColorFunc get_color);
+void			geany_msg_store_append				(GeanyMsgStore *store, gint msg_color,
+													 gint line, gpointer doc, const gchar *text,
+													 GtkTreeIter *iter);
+void			geany_msg_store_clear				(GeanyMsgStore *store);
+void			geany_msg_store_set_max_lines		(GeanyMsgStore *store, guint max_lines);
+
+
+G_END_DECLS
+
+#endif /* GEANY_MSG_STORE_H */
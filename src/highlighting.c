@@ -544,6 +544,34 @@ static GKeyFile *utils_key_file_new(const gchar *filename)
 }
 
 
+static void get_color_scheme_paths(const gchar *scheme, gchar **path, gchar **path_home)
+{
+	*path = g_build_path(G_DIR_SEPARATOR_S, app->datadir, GEANY_COLORSCHEMES_SUBDIR, scheme, NULL);
+	*path_home = g_build_path(G_DIR_SEPARATOR_S, app->configdir, GEANY_COLORSCHEMES_SUBDIR, scheme, NULL);
+}
+
+
+/* Appends the settings and file times the named styles depend on, so that
+ * filetypes_load_config() can tell whether they need to be read again. */
+void highlighting_append_color_scheme_stamp(GString *stamp)
+{
+	const gchar *scheme = editor_prefs.color_scheme;
+
+	g_string_append_printf(stamp, "%d:", interface_prefs.highlighting_invert_all);
+	if (!EMPTY(scheme))
+	{
+		gchar *path, *path_home;
+
+		get_color_scheme_paths(scheme, &path, &path_home);
+		g_string_append_printf(stamp, "%s:", scheme);
+		utils_append_file_stamp(stamp, path);
+		utils_append_file_stamp(stamp, path_home);
+		g_free(path);
+		g_free(path_home);
+	}
+}
+
+
 static void load_named_styles(GKeyFile *config, GKeyFile *config_home)
 {
 	const gchar *scheme = editor_prefs.color_scheme;
@@ -558,8 +586,7 @@ static void load_named_styles(GKeyFile *config, GKeyFile *config_home)
 	{
 		gchar *path, *path_home;
 
-		path = g_build_path(G_DIR_SEPARATOR_S, app->datadir, GEANY_COLORSCHEMES_SUBDIR, scheme, NULL);
-		path_home = g_build_path(G_DIR_SEPARATOR_S, app->configdir, GEANY_COLORSCHEMES_SUBDIR, scheme, NULL);
+		get_color_scheme_paths(scheme, &path, &path_home);
 
 		if (g_file_test(path, G_FILE_TEST_EXISTS) || g_file_test(path_home, G_FILE_TEST_EXISTS))
 		{
@@ -55,6 +55,8 @@ gboolean highlighting_is_code_style(gint lexer, gint style);
 
 void highlighting_show_color_scheme_dialog(void);
 
+void highlighting_append_color_scheme_stamp(GString *stamp);
+
 G_END_DECLS
 
 #endif
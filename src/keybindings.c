@@ -56,6 +56,7 @@
 #include "geanywraplabel.h"
 #include "main.h"
 #include "search.h"
+#include "finder.h"
 #include "gtkcompat.h"
 #ifdef HAVE_VTE
 # include "vte.h"
@@ -466,6 +467,9 @@ static void init_default_kb(void)
 		GDK_Right, GDK_MOD1_MASK, "nav_forward", _("Navigate forward a location"), NULL);
 	add_kb(group, GEANY_KEYS_GOTO_LINE, NULL,
 		GDK_l, GDK_CONTROL_MASK, "menu_gotoline", _("Go to Line"), "go_to_line1");
+	add_kb(group, GEANY_KEYS_GOTO_ANYTHING, NULL,
+		GDK_o, GDK_CONTROL_MASK | GDK_MOD1_MASK, "menu_gotoanything", _("Go to Anything"),
+		"go_to_anything1");
 	add_kb(group, GEANY_KEYS_GOTO_MATCHINGBRACE, NULL,
 		GDK_b, GDK_CONTROL_MASK, "edit_gotomatchingbrace",
 		_("Go to matching brace"), NULL);
@@ -1884,6 +1888,12 @@ static gboolean cb_func_goto_action(guint key_id)
 	gint cur_line;
 	GeanyDocument *doc = document_get_current();
 
+	/* also works without documents */
+	if (key_id == GEANY_KEYS_GOTO_ANYTHING)
+	{
+		finder_show();
+		return TRUE;
+	}
 	if (doc == NULL)
 		return TRUE;
 
@@ -58,7 +58,11 @@
 #include "printing.h"
 #include "templates.h"
 #include "toolbar.h"
+#include "projectindex.h"
+#include "tagcache.h"
 #include "stash.h"
+#include "sidebar.h"
+#include "callbacks.h"
 
 
 /* some default settings which are used at the very first start of Geany to fill
@@ -90,12 +94,25 @@ static gchar *scribble_text = NULL;
 static gint scribble_pos = -1;
 static GPtrArray *session_files = NULL;
 static gint session_notebook_page;
+static gboolean session_restore_in_background;
 static gint hpan_position;
 static gint vpan_position;
 static const gchar atomic_file_saving_key[] = "use_atomic_file_saving";
 
 static GPtrArray *keyfile_groups = NULL;
 
+/* Session files which are still being opened in the background */
+static struct
+{
+	GPtrArray	*files;		/* session entries in tab order, NULL once handled */
+	GtkWidget	**pages;	/* weak references to the pages opened for each entry */
+	guint		*order;		/* entry indexes, nearest to the current page first */
+	guint		 next;		/* next index into order */
+	guint		 source_id;
+	gboolean	 failure;
+}
+pending_session = {NULL, NULL, NULL, 0, 0, FALSE};
+
 GPtrArray *pref_groups = NULL;
 
 static struct
@@ -220,6 +237,8 @@ static void init_pref_groups(void)
 		"gio_unsafe_save_backup", FALSE);
 	stash_group_add_boolean(group, &file_prefs.use_gio_unsafe_file_saving,
 		"use_gio_unsafe_file_saving", TRUE);
+	stash_group_add_integer(group, &file_prefs.background_save_size,
+		"background_save_size", 4096);
 	/* for backwards-compatibility */
 	stash_group_add_integer(group, &editor_prefs.indentation->hard_tab_width,
 		"indent_hard_tab_width", 8);
@@ -227,6 +246,14 @@ static void init_pref_groups(void)
 		"find_selection_type", GEANY_FIND_SEL_CURRENT_WORD);
 	stash_group_add_string(group, &file_prefs.extract_filetype_regex,
 		"extract_filetype_regex", GEANY_DEFAULT_FILETYPE_REGEX);
+	stash_group_add_boolean(group, &session_restore_in_background,
+		"session_restore_in_background", TRUE);
+	stash_group_add_integer(group, &tagcache_prefs.max_size,
+		"tag_cache_size", 50);
+	stash_group_add_integer(group, &tagcache_prefs.max_age,
+		"tag_cache_max_age", 30);
+	stash_group_add_boolean(group, &projectindex_prefs.enabled,
+		"project_index_files", TRUE);
 
 	/* Note: Interface-related various prefs are in ui_init_prefs() */
 
@@ -255,6 +282,11 @@ static void settings_action(GKeyFile *config, SettingAction action)
 	guint i;
 	StashGroup *group;
 
+	/* reading replaces the session, but writing must keep the files still to be restored
+	 * so that configuration_save_session_files() saves them */
+	if (action == SETTING_READ)
+		configuration_cancel_pending_session_files();
+
 	foreach_ptr_array(group, i, keyfile_groups)
 	{
 		switch (action)
@@ -325,12 +357,48 @@ static gchar *get_session_file_string(GeanyDocument *doc)
 }
 
 
+/* Stores the session entries before index end which have not been opened yet, so quitting
+ * before the session has been restored completely doesn't lose them. */
+static void save_pending_session_files(GKeyFile *config, guint *pending, guint end, guint *j)
+{
+	gchar entry[16];
+
+	for (; *pending < end; (*pending)++)
+	{
+		gchar **tmp = g_ptr_array_index(pending_session.files, *pending);
+		guint len;
+
+		if (tmp != NULL && (len = g_strv_length(tmp)) >= 8)
+		{
+			g_snprintf(entry, sizeof(entry), "FILE_NAME_%d", *j);
+			g_key_file_set_string_list(config, "files", entry, (const gchar **) tmp, len);
+			(*j)++;
+		}
+	}
+}
+
+
+/* Returns the session entry index the notebook page was opened for, or -1 */
+static gint get_pending_session_index(GtkWidget *page)
+{
+	guint i;
+
+	for (i = 0; i < pending_session.files->len; i++)
+	{
+		if (pending_session.pages[i] == page)
+			return i;
+	}
+	return -1;
+}
+
+
 void configuration_save_session_files(GKeyFile *config)
 {
 	gint npage;
 	gchar *tmp;
 	gchar entry[16];
 	guint i = 0, j = 0, max;
+	guint pending = 0;
 	GeanyDocument *doc;
 
 	npage = gtk_notebook_get_current_page(GTK_NOTEBOOK(main_widgets.notebook));
@@ -345,6 +413,18 @@ void configuration_save_session_files(GKeyFile *config)
 		{
 			gchar *fname;
 
+			if (pending_session.files != NULL)
+			{
+				gint idx = get_pending_session_index(
+					gtk_notebook_get_nth_page(GTK_NOTEBOOK(main_widgets.notebook), i));
+
+				/* keep the entries not opened yet in front of their right neighbour */
+				if (idx >= (gint) pending)
+				{
+					save_pending_session_files(config, &pending, idx, &j);
+					pending = idx + 1;
+				}
+			}
 			g_snprintf(entry, sizeof(entry), "FILE_NAME_%d", j);
 			fname = get_session_file_string(doc);
 			g_key_file_set_string(config, "files", entry, fname);
@@ -352,6 +432,9 @@ void configuration_save_session_files(GKeyFile *config)
 			j++;
 		}
 	}
+	if (pending_session.files != NULL)
+		save_pending_session_files(config, &pending, pending_session.files->len, &j);
+
 	/* if open filenames less than saved session files, delete existing entries in the list */
 	i = j;
 	while (TRUE)
@@ -1081,7 +1164,7 @@ gboolean configuration_load(void)
 }
 
 
-static gboolean open_session_file(gchar **tmp, guint len)
+static GeanyDocument *open_session_file(gchar **tmp, guint len)
 {
 	guint pos;
 	const gchar *ft_name;
@@ -1092,7 +1175,7 @@ static gboolean open_session_file(gchar **tmp, guint len)
 	gboolean ro, auto_indent, line_wrapping;
 	/** TODO when we have a global pref for line breaking, use its value */
 	gboolean line_breaking = FALSE;
-	gboolean ret = FALSE;
+	GeanyDocument *ret = NULL;
 
 	pos = atoi(tmp[0]);
 	ft_name = tmp[1];
@@ -1131,7 +1214,7 @@ static gboolean open_session_file(gchar **tmp, guint len)
 			editor_set_line_wrapping(doc->editor, line_wrapping);
 			doc->editor->line_breaking = line_breaking;
 			doc->editor->auto_indent = auto_indent;
-			ret = TRUE;
+			ret = doc;
 		}
 	}
 	else
@@ -1145,6 +1228,197 @@ static gboolean open_session_file(gchar **tmp, guint len)
 }
 
 
+static void free_pending_session(void)
+{
+	guint i;
+
+	if (pending_session.source_id != 0)
+		g_source_remove(pending_session.source_id);
+
+	for (i = 0; i < pending_session.files->len; i++)
+	{
+		g_strfreev(g_ptr_array_index(pending_session.files, i));
+		if (pending_session.pages[i] != NULL)
+			g_object_remove_weak_pointer(G_OBJECT(pending_session.pages[i]),
+				(gpointer *) &pending_session.pages[i]);
+	}
+	g_ptr_array_free(pending_session.files, TRUE);
+	g_free(pending_session.pages);
+	g_free(pending_session.order);
+
+	pending_session.files = NULL;
+	pending_session.pages = NULL;
+	pending_session.order = NULL;
+	pending_session.next = 0;
+	pending_session.source_id = 0;
+	pending_session.failure = FALSE;
+}
+
+
+/* Stops opening the remaining session files, e.g. when all documents are closed
+ * or another session is loaded. */
+void configuration_cancel_pending_session_files(void)
+{
+	if (pending_session.files != NULL)
+		free_pending_session();
+}
+
+
+/* Moves a page opened in the background next to the pages of its neighbouring
+ * session entries, so the tab order is the same as when opening all files at once. */
+static void place_pending_session_page(guint idx, GtkWidget *page)
+{
+	GtkNotebook *notebook = GTK_NOTEBOOK(main_widgets.notebook);
+	gint cur = gtk_notebook_page_num(notebook, page);
+	guint i;
+
+	for (i = idx; i-- > 0;)
+	{
+		if (pending_session.pages[i] != NULL)
+		{
+			gint pos = gtk_notebook_page_num(notebook, pending_session.pages[i]);
+
+			if (pos < 0)
+				continue;
+			gtk_notebook_reorder_child(notebook, page, cur < pos ? pos : pos + 1);
+			return;
+		}
+	}
+	for (i = idx + 1; i < pending_session.files->len; i++)
+	{
+		if (pending_session.pages[i] != NULL)
+		{
+			gint pos = gtk_notebook_page_num(notebook, pending_session.pages[i]);
+
+			if (pos < 0)
+				continue;
+			gtk_notebook_reorder_child(notebook, page, cur < pos ? pos - 1 : pos);
+			return;
+		}
+	}
+}
+
+
+static GeanyDocument *open_pending_session_file(guint idx)
+{
+	gchar **tmp = g_ptr_array_index(pending_session.files, idx);
+	GeanyDocument *doc = NULL;
+	guint len;
+
+	if (tmp != NULL && (len = g_strv_length(tmp)) >= 8)
+	{
+		gboolean opening = main_status.opening_session_files;
+
+		main_status.opening_session_files = TRUE;
+		doc = open_session_file(tmp, len);
+		main_status.opening_session_files = opening;
+
+		if (doc == NULL)
+			pending_session.failure = TRUE;
+		else
+		{
+			GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(main_widgets.notebook),
+				document_get_notebook_page(doc));
+
+			place_pending_session_page(idx, page);
+			pending_session.pages[idx] = page;
+			g_object_add_weak_pointer(G_OBJECT(page), (gpointer *) &pending_session.pages[idx]);
+		}
+	}
+	g_strfreev(tmp);
+	g_ptr_array_index(pending_session.files, idx) = NULL;
+	return doc;
+}
+
+
+static gboolean on_pending_session_idle(gpointer data)
+{
+	GeanyDocument *cur_doc = document_get_current();
+	guint idx;
+
+	if (main_status.quitting)
+	{
+		pending_session.source_id = 0;
+		free_pending_session();
+		return FALSE;
+	}
+
+	idx = pending_session.order[pending_session.next++];
+	if (open_pending_session_file(idx) != NULL)
+	{
+		GeanyDocument *doc = document_get_current();
+
+		/* opening a file replaces an unchanged untitled document, which might have been
+		 * the current one; otherwise the current document just stays in front */
+		if (doc != cur_doc)
+			on_notebook1_switch_page_after(GTK_NOTEBOOK(main_widgets.notebook), NULL,
+				gtk_notebook_get_current_page(GTK_NOTEBOOK(main_widgets.notebook)), NULL);
+		else
+			sidebar_select_openfiles_item(doc);
+	}
+
+	if (pending_session.next < pending_session.files->len)
+		return TRUE;
+
+	if (pending_session.failure)
+		ui_set_statusbar(TRUE, _("Failed to load one or more session files."));
+	pending_session.source_id = 0;
+	free_pending_session();
+	return FALSE;
+}
+
+
+/* Opens the session file shown at startup and queues the others to be opened from idle
+ * callbacks, nearest to the current tab first, so the main window appears sooner. */
+static void open_files_in_background(void)
+{
+	guint n;
+	guint cur, i, k;
+	GeanyDocument *doc = NULL;
+
+	/* drop the NULL terminator */
+	g_ptr_array_set_size(session_files, session_files->len - 1);
+	n = session_files->len;
+
+	pending_session.files = session_files;
+	pending_session.pages = g_new0(GtkWidget *, n);
+	pending_session.order = g_new(guint, n);
+	session_files = NULL;
+
+	cur = session_notebook_page >= 0 ? MIN((guint) session_notebook_page, n - 1) : 0;
+	k = 0;
+	pending_session.order[k++] = cur;
+	for (i = 1; k < n; i++)
+	{
+		if (cur + i < n)
+			pending_session.order[k++] = cur + i;
+		if (i <= cur)
+			pending_session.order[k++] = cur - i;
+	}
+
+	/* open the first file which can be found in the foreground */
+	while (doc == NULL && pending_session.next < n)
+		doc = open_pending_session_file(pending_session.order[pending_session.next++]);
+
+	if (pending_session.next < n)
+		pending_session.source_id = g_idle_add(on_pending_session_idle, NULL);
+	else
+	{
+		gboolean failure = pending_session.failure;
+
+		free_pending_session();
+		if (failure)
+			ui_set_statusbar(TRUE, _("Failed to load one or more session files."));
+	}
+
+	if (doc != NULL)
+	{
+		main_status.opening_session_files = FALSE;
+		document_show_tab(doc);
+	}
+}
+
+
 /* Open session files
  * Note: notebook page switch handler and adding to recent files list is always disabled
  * for all files opened within this function */
@@ -1153,6 +1427,17 @@ void configuration_open_files(void)
 	gint i;
 	gboolean failure = FALSE;
 
+	configuration_cancel_pending_session_files();
+
+	/* at startup only open the visible file before showing the main window */
+	if (session_restore_in_background && ! main_status.main_window_realized &&
+		session_files->len > 2)
+	{
+		open_files_in_background();
+		main_status.opening_session_files = FALSE;
+		return;
+	}
+
 	/* necessary to set it to TRUE for project session support */
 	main_status.opening_session_files = TRUE;
 
@@ -43,6 +43,8 @@ gboolean configuration_load(void);
 
 void configuration_open_files(void);
 
+void configuration_cancel_pending_session_files(void);
+
 void configuration_reload_default_session(void);
 
 void configuration_save_default_session(void);
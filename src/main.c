@@ -71,6 +71,10 @@
 #include "printing.h"
 #include "toolbar.h"
 #include "geanyobject.h"
+#include "trace.h"
+#include "projectindex.h"
+#include "finder.h"
+#include "tagcache.h"
 
 #ifdef HAVE_SOCKET
 # include "socket.h"
@@ -110,11 +114,23 @@ static gboolean generate_tags = FALSE;
 static gboolean no_preprocessing = FALSE;
 static gboolean ft_names = FALSE;
 static gboolean print_prefix = FALSE;
+static gchar *trace_file = NULL;
+static gboolean profile_startup = FALSE;
+static gchar *profile_startup_file = NULL;
 #ifdef HAVE_PLUGINS
 static gboolean no_plugins = FALSE;
 #endif
 static gboolean dummy = FALSE;
 
+static gboolean on_profile_startup_option(const gchar *option_name, const gchar *value,
+		gpointer data, GError **error)
+{
+	profile_startup = TRUE;
+	SETPTR(profile_startup_file, g_strdup(value));
+	return TRUE;
+}
+
+
 /* in alphabetical order of short options */
 static GOptionEntry entries[] =
 {
@@ -135,8 +151,10 @@ static GOptionEntry entries[] =
 	{ "no-plugins", 'p', 0, G_OPTION_ARG_NONE, &no_plugins, N_("Don't load plugins"), NULL },
 #endif
 	{ "print-prefix", 0, 0, G_OPTION_ARG_NONE, &print_prefix, N_("Print Geany's installation prefix"), NULL },
+	{ "profile-startup", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, (gpointer) on_profile_startup_option, N_("Print the time and memory used by each startup phase, optionally also writing them to a JSON file"), N_("file") },
 	{ "read-only", 'r', 0, G_OPTION_ARG_NONE, &cl_options.readonly, N_("Open all FILES in read-only mode (see documention)"), NULL },
 	{ "no-session", 's', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &cl_options.load_session, N_("Don't load the previous session's files"), NULL },
+	{ "trace-file", 0, 0, G_OPTION_ARG_FILENAME, &trace_file, N_("Trace editing latency and write the results to this file on exit"), NULL },
 #ifdef HAVE_VTE
 	{ "no-terminal", 't', 0, G_OPTION_ARG_NONE, &no_vte, N_("Don't load terminal support"), NULL },
 	{ "vte-lib", 0, 0, G_OPTION_ARG_FILENAME, &lib_vte, N_("Filename of libvte.so"), NULL },
@@ -636,6 +654,20 @@ static void parse_command_line_options(gint *argc, gchar ***argv)
 #endif
 	cl_options.ignore_global_tags = ignore_global_tags;
 
+	if (profile_startup)
+	{
+		trace_startup_init(profile_startup_file);
+		g_free(profile_startup_file);
+		profile_startup_file = NULL;
+	}
+
+	if (trace_file)
+	{
+		trace_init(trace_file);
+		g_free(trace_file);
+		trace_file = NULL;
+	}
+
 	if (! gtk_init_check(NULL, NULL))
 	{	/* check whether we have a valid X display and exit if not */
 		g_printerr("Geany: cannot open display\n");
@@ -795,8 +827,9 @@ static void signal_cb(gint sig)
  */
 
 /* Used for command-line arguments at startup or from socket.
- * this will strip any :line:col filename suffix from locale_filename */
-gboolean main_handle_filename(const gchar *locale_filename)
+ * this will strip any :line:col filename suffix from locale_filename.
+ * doc is set to the opened or created document, if not NULL. */
+gboolean main_handle_filename(const gchar *locale_filename, GeanyDocument **doc_out)
 {
 	GeanyDocument *doc;
 	gint line = -1, column = -1;
@@ -804,6 +837,9 @@ gboolean main_handle_filename(const gchar *locale_filename)
 
 	g_return_val_if_fail(locale_filename, FALSE);
 
+	if (doc_out != NULL)
+		*doc_out = NULL;
+
 	/* check whether the passed filename is an URI */
 	filename = utils_get_path_from_uri(locale_filename);
 	if (filename == NULL)
@@ -821,6 +857,8 @@ gboolean main_handle_filename(const gchar *locale_filename)
 		/* add recent file manually if opening_session_files is set */
 		if (doc != NULL && main_status.opening_session_files)
 			ui_add_recent_document(doc);
+		if (doc_out != NULL)
+			*doc_out = doc;
 		g_free(filename);
 		return TRUE;
 	}
@@ -831,6 +869,8 @@ gboolean main_handle_filename(const gchar *locale_filename)
 		doc = document_new_file(utf8_filename, NULL, NULL);
 		if (doc != NULL)
 			ui_add_recent_document(doc);
+		if (doc_out != NULL)
+			*doc_out = doc;
 		g_free(utf8_filename);
 		g_free(filename);
 		return TRUE;
@@ -859,7 +899,7 @@ static void open_cl_files(gint argc, gchar **argv)
 		/* It seems argv elements are encoded in CP1252 on a German Windows */
 		SETPTR(filename, g_locale_to_utf8(filename, -1, NULL, NULL, NULL));
 #endif
-		if (filename && ! main_handle_filename(filename))
+		if (filename && ! main_handle_filename(filename, NULL))
 		{
 			const gchar *msg = _("Could not find file '%s'.");
 
@@ -964,6 +1004,7 @@ static void load_startup_files(gint argc, gchar **argv)
 static gboolean send_startup_complete(gpointer data)
 {
 	g_signal_emit_by_name(geany_object, "geany-startup-complete");
+	trace_startup_finish();
 	return FALSE;
 }
 
@@ -1111,8 +1152,11 @@ gint main(gint argc, gchar **argv)
 	geany_object = geany_object_new();
 
 	/* inits */
+	trace_startup_begin("main_init (UI from geany.glade)");
 	main_init();
+	trace_startup_end();
 
+	trace_startup_begin("core init");
 	encodings_init();
 	editor_init();
 
@@ -1125,20 +1169,34 @@ gint main(gint argc, gchar **argv)
 	plugins_init();
 #endif
 	sidebar_init();
+	trace_startup_end();
+
+	trace_startup_begin("configuration_load");
 	load_settings();	/* load keyfile */
+	trace_startup_end();
 
+	trace_startup_begin("UI init");
 	msgwin_init();
 	build_init();
 	ui_create_insert_menu_items();
 	ui_create_insert_date_menu_items();
 	keybindings_init();
 	notebook_init();
+	trace_startup_end();
+
+	trace_startup_begin("filetypes_init");
 	filetypes_init();
+	trace_startup_end();
+
+	trace_startup_begin("templates, symbols and snippets init");
 	templates_init();
 	navqueue_init();
 	document_init_doclist();
 	symbols_init();
+	projectindex_init();
+	finder_init();
 	editor_snippets_init();
+	trace_startup_end();
 
 	/* registering some basic events */
 	g_signal_connect(main_widgets.window, "delete-event", G_CALLBACK(on_exit_clicked), NULL);
@@ -1157,12 +1215,18 @@ gint main(gint argc, gchar **argv)
 			g_strerror(config_dir_result));
 
 	/* apply all configuration options */
+	trace_startup_begin("apply_settings");
 	apply_settings();
+	trace_startup_end();
 
 #ifdef HAVE_PLUGINS
 	/* load any enabled plugins before we open any documents */
 	if (want_plugins)
+	{
+		trace_startup_begin("plugins_load_active");
 		plugins_load_active();
+		trace_startup_end();
+	}
 #endif
 
 	ui_sidebar_show_hide();
@@ -1171,16 +1235,20 @@ gint main(gint argc, gchar **argv)
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(main_widgets.sidebar_notebook), ui_prefs.sidebar_page);
 
 	/* load keybinding settings after plugins have added their groups */
+	trace_startup_begin("keybindings_load_keyfile");
 	keybindings_load_keyfile();
+	trace_startup_end();
 
 	/* create the custom command menu after the keybindings have been loaded to have the proper
 	 * accelerator shown for the menu items */
 	tools_create_insert_custom_command_menu_items();
 
 	/* load any command line files or session files */
+	trace_startup_begin("session and command line files");
 	main_status.opening_session_files = TRUE;
 	load_startup_files(argc, argv);
 	main_status.opening_session_files = FALSE;
+	trace_startup_end();
 
 	/* open a new file if no other file was opened */
 	document_new_file_if_non_open();
@@ -1201,9 +1269,11 @@ gint main(gint argc, gchar **argv)
 	setup_window_position();
 
 	/* finally show the window */
+	trace_startup_begin("show main window");
 	document_grab_focus(doc);
 	gtk_widget_show(main_widgets.window);
 	main_status.main_window_realized = TRUE;
+	trace_startup_end();
 
 	configuration_apply_settings();
 
@@ -1256,8 +1326,11 @@ void main_quit()
 	msgwin_finalize();
 	search_finalize();
 	build_finalize();
+	finder_finalize();
 	document_finalize();
+	projectindex_finalize();
 	symbols_finalize();
+	tagcache_finalize();
 	project_finalize();
 	editor_finalize();
 	editor_snippets_free();
@@ -1266,6 +1339,7 @@ void main_quit()
 	sidebar_finalize();
 	configuration_finalize();
 	filetypes_free_types();
+	trace_finalize();
 	log_finalize();
 
 	tm_workspace_free(TM_WORK_OBJECT(app->tm_workspace));
@@ -42,6 +42,7 @@
 #include "navqueue.h"
 #include "editor.h"
 #include "msgwindow.h"
+#include "geanymsgstore.h"
 #include "keybindings.h"
 
 #include <string.h>
@@ -72,6 +73,7 @@ static GtkWidget *create_message_popup_menu(gint type);
 static gboolean on_msgwin_button_press_event(GtkWidget *widget, GdkEventButton *event,
 																			gpointer user_data);
 static void on_scribble_populate(GtkTextView *textview, GtkMenu *arg1, gpointer user_data);
+static const GdkColor *get_color(gint msg_color);
 
 
 void msgwin_show_hide_tabs(void)
@@ -175,15 +177,13 @@ static void prepare_msg_tree_view(void)
 	GtkTreeViewColumn *column;
 	GtkTreeSelection *selection;
 
-	/* line, doc, fg, str */
-	msgwindow.store_msg = gtk_list_store_new(4, G_TYPE_INT, G_TYPE_POINTER,
-		GDK_TYPE_COLOR, G_TYPE_STRING);
+	msgwindow.store_msg = geany_msg_store_new(get_color);
 	gtk_tree_view_set_model(GTK_TREE_VIEW(msgwindow.tree_msg), GTK_TREE_MODEL(msgwindow.store_msg));
 	g_object_unref(msgwindow.store_msg);
 
 	renderer = gtk_cell_renderer_text_new();
 	column = gtk_tree_view_column_new_with_attributes(NULL, renderer,
-		"foreground-gdk", 2, "text", 3, NULL);
+		"foreground-gdk", MSG_STORE_COL_COLOR, "text", MSG_STORE_COL_STRING, NULL);
 	gtk_tree_view_append_column(GTK_TREE_VIEW(msgwindow.tree_msg), column);
 
 	gtk_tree_view_set_enable_search(GTK_TREE_VIEW(msgwindow.tree_msg), FALSE);
@@ -214,12 +214,13 @@ static void prepare_compiler_tree_view(void)
 	GtkTreeViewColumn *column;
 	GtkTreeSelection *selection;
 
-	msgwindow.store_compiler = gtk_list_store_new(2, GDK_TYPE_COLOR, G_TYPE_STRING);
+	msgwindow.store_compiler = geany_msg_store_new(get_color);
 	gtk_tree_view_set_model(GTK_TREE_VIEW(msgwindow.tree_compiler), GTK_TREE_MODEL(msgwindow.store_compiler));
 	g_object_unref(msgwindow.store_compiler);
 
 	renderer = gtk_cell_renderer_text_new();
-	column = gtk_tree_view_column_new_with_attributes(NULL, renderer, "foreground-gdk", 0, "text", 1, NULL);
+	column = gtk_tree_view_column_new_with_attributes(NULL, renderer,
+		"foreground-gdk", MSG_STORE_COL_COLOR, "text", MSG_STORE_COL_STRING, NULL);
 	gtk_tree_view_append_column(GTK_TREE_VIEW(msgwindow.tree_compiler), column);
 
 	gtk_tree_view_set_enable_search(GTK_TREE_VIEW(msgwindow.tree_compiler), FALSE);
@@ -243,10 +244,9 @@ static void prepare_compiler_tree_view(void)
 }
 
 
-static const GdkColor color_error = {0, 65535, 0, 0};
-
 static const GdkColor *get_color(gint msg_color)
 {
+	static const GdkColor color_error = {0, 65535, 0, 0};
 	static const GdkColor dark_red = {0, 65535 / 2, 0, 0};
 	static const GdkColor blue = {0, 0, 0, 0xD000};	/* not too bright ;-) */
 
@@ -284,7 +284,6 @@ void msgwin_compiler_add_string(gint msg_color, const gchar *msg)
 {
 	GtkTreeIter iter;
 	GtkTreePath *path;
-	const GdkColor *color = get_color(msg_color);
 	gchar *utf8_msg;
 
 	if (! g_utf8_validate(msg, -1, NULL))
@@ -292,8 +291,8 @@ void msgwin_compiler_add_string(gint msg_color, const gchar *msg)
 	else
 		utf8_msg = (gchar *) msg;
 
-	gtk_list_store_append(msgwindow.store_compiler, &iter);
-	gtk_list_store_set(msgwindow.store_compiler, &iter, 0, color, 1, utf8_msg, -1);
+	geany_msg_store_set_max_lines(msgwindow.store_compiler, ui_prefs.msgwin_max_lines);
+	geany_msg_store_append(msgwindow.store_compiler, msg_color, -1, NULL, utf8_msg, &iter);
 
 	if (ui_prefs.msgwindow_visible && interface_prefs.compiler_tab_autoscroll)
 	{
@@ -356,8 +355,6 @@ void msgwin_msg_add(gint msg_color, gint line, GeanyDocument *doc, const gchar *
 /* adds string to the msg treeview */
 void msgwin_msg_add_string(gint msg_color, gint line, GeanyDocument *doc, const gchar *string)
 {
-	GtkTreeIter iter;
-	const GdkColor *color = get_color(msg_color);
 	gchar *tmp;
 	gsize len;
 	gchar *utf8_msg;
@@ -379,8 +376,8 @@ void msgwin_msg_add_string(gint msg_color, gint line, GeanyDocument *doc, const
 	else
 		utf8_msg = tmp;
 
-	gtk_list_store_append(msgwindow.store_msg, &iter);
-	gtk_list_store_set(msgwindow.store_msg, &iter, 0, line, 1, doc, 2, color, 3, utf8_msg, -1);
+	geany_msg_store_set_max_lines(msgwindow.store_msg, ui_prefs.msgwin_max_lines);
+	geany_msg_store_append(msgwindow.store_msg, msg_color, line, doc, utf8_msg, NULL);
 
 	g_free(tmp);
 	if (utf8_msg != tmp)
@@ -445,7 +442,7 @@ on_compiler_treeview_copy_activate(GtkMenuItem *menuitem, gpointer user_data)
 	GtkTreeSelection *selection;
 	GtkTreeModel *model;
 	GtkTreeIter iter;
-	gint str_idx = 1;
+	gint str_idx = MSG_STORE_COL_STRING;
 
 	switch (GPOINTER_TO_INT(user_data))
 	{
@@ -460,7 +457,6 @@ on_compiler_treeview_copy_activate(GtkMenuItem *menuitem, gpointer user_data)
 
 		case MSG_MESSAGE:
 		tv = msgwindow.tree_msg;
-		str_idx = 3;
 		break;
 	}
 	selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(tv));
@@ -482,16 +478,16 @@ on_compiler_treeview_copy_activate(GtkMenuItem *menuitem, gpointer user_data)
 
 static void on_compiler_treeview_copy_all_activate(GtkMenuItem *menuitem, gpointer user_data)
 {
-	GtkListStore *store = msgwindow.store_compiler;
+	GtkTreeModel *model = GTK_TREE_MODEL(msgwindow.store_compiler);
 	GtkTreeIter iter;
 	GString *str = g_string_new("");
-	gint str_idx = 1;
+	gint str_idx = MSG_STORE_COL_STRING;
 	gboolean valid;
 
 	switch (GPOINTER_TO_INT(user_data))
 	{
 		case MSG_STATUS:
-		store = msgwindow.store_status;
+		model = GTK_TREE_MODEL(msgwindow.store_status);
 		str_idx = 0;
 		break;
 
@@ -500,18 +496,17 @@ static void on_compiler_treeview_copy_all_activate(GtkMenuItem *menuitem, gpoint
 		break;
 
 		case MSG_MESSAGE:
-		store = msgwindow.store_msg;
-		str_idx = 3;
+		model = GTK_TREE_MODEL(msgwindow.store_msg);
 		break;
 	}
 
 	/* walk through the list and copy every line into a string */
-	valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(store), &iter);
+	valid = gtk_tree_model_get_iter_first(model, &iter);
 	while (valid)
 	{
 		gchar *line;
 
-		gtk_tree_model_get(GTK_TREE_MODEL(store), &iter, str_idx, &line, -1);
+		gtk_tree_model_get(model, &iter, str_idx, &line, -1);
 		if (!EMPTY(line))
 		{
 			g_string_append(str, line);
@@ -519,7 +514,7 @@ static void on_compiler_treeview_copy_all_activate(GtkMenuItem *menuitem, gpoint
 		}
 		g_free(line);
 
-		valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(store), &iter);
+		valid = gtk_tree_model_iter_next(model, &iter);
 	}
 
 	/* copy the string into the clipboard */
@@ -611,7 +606,7 @@ find_prev_build_dir(GtkTreePath *cur, GtkTreeModel *model, gchar **prefix)
 		if (gtk_tree_model_get_iter(model, &iter, cur))
 		{
 			gchar *string;
-			gtk_tree_model_get(model, &iter, 1, &string, -1);
+			gtk_tree_model_get(model, &iter, MSG_STORE_COL_STRING, &string, -1);
 			if (string != NULL && build_parse_make_dir(string, prefix))
 			{
 				g_free(string);
@@ -691,22 +686,17 @@ gboolean msgwin_goto_compiler_file_line(gboolean focus_editor)
 	GtkTreeModel *model;
 	GtkTreeSelection *selection;
 	gchar *string;
-	GdkColor *color;
+	gint msg_color;
 
 	selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(msgwindow.tree_compiler));
 	if (gtk_tree_selection_get_selected(selection, &model, &iter))
 	{
 		/* if the item is not coloured red, it's not an error line */
-		gtk_tree_model_get(model, &iter, 0, &color, -1);
-		if (color == NULL || ! gdk_color_equal(color, &color_error))
-		{
-			if (color != NULL)
-				gdk_color_free(color);
+		gtk_tree_model_get(model, &iter, MSG_STORE_COL_MSG_COLOR, &msg_color, -1);
+		if (msg_color != COLOR_RED)
 			return FALSE;
-		}
-		gdk_color_free(color);
 
-		gtk_tree_model_get(model, &iter, 1, &string, -1);
+		gtk_tree_model_get(model, &iter, MSG_STORE_COL_STRING, &string, -1);
 		if (string != NULL)
 		{
 			gint line;
@@ -983,7 +973,7 @@ void msgwin_parse_compiler_error_line(const gchar *string, const gchar *dir,
 		gchar **filename, gint *line)
 {
 	GeanyFiletype *ft;
-	gchar *trimmed_string;
+	const gchar *trimmed_string;
 
 	*filename = NULL;
 	*line = -1;
@@ -991,12 +981,19 @@ void msgwin_parse_compiler_error_line(const gchar *string, const gchar *dir,
 	if (G_UNLIKELY(string == NULL))
 		return;
 
+	/* Every error message has a line number, so skip the (much more common) other lines of
+	 * build output without trying the regex and the compiler specific parsers. */
+	if (strpbrk(string, "0123456789") == NULL)
+		return;
+
 	if (dir == NULL)
 		dir = build_info.dir;
 	g_return_if_fail(dir != NULL);
 
-	trimmed_string = g_strdup(string);
-	g_strchug(trimmed_string); /* remove possible leading whitespace */
+	/* remove possible leading whitespace */
+	trimmed_string = string;
+	while (g_ascii_isspace(*trimmed_string))
+		trimmed_string++;
 
 	ft = filetypes[build_info.file_type_id];
 
@@ -1007,7 +1004,6 @@ void msgwin_parse_compiler_error_line(const gchar *string, const gchar *dir,
 		parse_compiler_error_line(trimmed_string, filename, line);
 	}
 	make_absolute(filename, dir);
-	g_free(trimmed_string);
 }
 
 
@@ -1071,7 +1067,8 @@ gboolean msgwin_goto_messages_file_line(gboolean focus_editor)
 		GeanyDocument *doc;
 		GeanyDocument *old_doc = document_get_current();
 
-		gtk_tree_model_get(model, &iter, 0, &line, 1, &doc, 3, &string, -1);
+		gtk_tree_model_get(model, &iter, MSG_STORE_COL_LINE, &line, MSG_STORE_COL_DOC, &doc,
+			MSG_STORE_COL_STRING, &string, -1);
 		/* doc may have been closed, so check doc->index: */
 		if (line >= 0 && DOC_VALID(doc))
 		{
@@ -1202,23 +1199,19 @@ void msgwin_switch_tab(gint tabnum, gboolean show)
  **/
 void msgwin_clear_tab(gint tabnum)
 {
-	GtkListStore *store = NULL;
-
 	switch (tabnum)
 	{
 		case MSG_MESSAGE:
-			store = msgwindow.store_msg;
+			geany_msg_store_clear(msgwindow.store_msg);
 			break;
 
 		case MSG_COMPILER:
-			gtk_list_store_clear(msgwindow.store_compiler);
+			geany_msg_store_clear(msgwindow.store_compiler);
 			build_menu_update(NULL);	/* update next error items */
-			return;
+			break;
 
-		case MSG_STATUS: store = msgwindow.store_status; break;
-		default: return;
+		case MSG_STATUS:
+			gtk_list_store_clear(msgwindow.store_status);
+			break;
 	}
-	if (store == NULL)
-		return;
-	gtk_list_store_clear(store);
 }
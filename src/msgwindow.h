@@ -51,8 +51,8 @@ typedef enum
 typedef struct
 {
 	GtkListStore	*store_status;
-	GtkListStore	*store_msg;
-	GtkListStore	*store_compiler;
+	struct _GeanyMsgStore	*store_msg;
+	struct _GeanyMsgStore	*store_compiler;
 	GtkWidget		*tree_compiler;
 	GtkWidget		*tree_status;
 	GtkWidget		*tree_msg;
@@ -59,6 +59,7 @@
 #include "win32.h"
 #include "pluginutils.h"
 #include "pluginprivate.h"
+#include "trace.h"
 
 
 GList *active_plugin_list = NULL; /* list of only actually loaded plugins, always valid */
@@ -920,8 +921,10 @@ load_active_plugins(void)
 
 		if (!EMPTY(fname) && g_file_test(fname, G_FILE_TEST_EXISTS))
 		{
+			trace_startup_begin("plugin %s", fname);
 			if (!check_plugin_path(fname) || plugin_new(fname, TRUE, FALSE) == NULL)
 				failed_plugins_list = g_list_prepend(failed_plugins_list, g_strdup(fname));
+			trace_startup_end();
 		}
 	}
 }
@@ -0,0 +1,1054 @@
+/*
+ *      projectindex.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Background indexing of the source files under the base path of the open project, so
+ * that autocompletion, calltips and Go to Tag Definition also know the symbols of files
+ * which aren't open.
+ *
+ * A worker thread walks the base path and reads the files which changed since the index
+ * was saved, the parsing itself is done in short slices in the main thread at low priority
+ * because the parsers aren't reentrant. The files belong to a TMProject which is searched
+ * file by file (see tm_project_new_empty()), so changing one file doesn't sort the tags of
+ * the whole project again. Directories are watched to keep the index up to date, changed
+ * files and new directories are read by the worker too. When the project is closed, the
+ * worker is stopped and the index is saved in the background.
+ */
+
+#include <string.h>
+
+#include "geany.h"
+
+/* gstdio.h also includes sys/stat.h */
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "projectindex.h"
+#include "document.h"
+#include "filetypes.h"
+#include "finder.h"
+#include "geanyobject.h"
+#include "project.h"
+#include "ui_utils.h"
+#include "utils.h"
+
+
+/* time in seconds the main thread may spend parsing before handling other events */
+#define INDEX_TIME_SLICE 0.01
+/* interval in milliseconds to look for files while the scan is running */
+#define INDEX_POLL_INTERVAL 100
+/* number of files the scan reads ahead of the parsing */
+#define INDEX_MAX_QUEUED 64
+/* limits the resources used for directory monitors in huge trees, the directories above
+ * the limit are scanned again when the project is saved or the window is focused */
+#define INDEX_MAX_MONITORS 1024
+
+
+typedef struct PatternLang
+{
+	GPatternSpec	*spec;
+	gint			 lang;
+}
+PatternLang;
+
+/* A file or directory found by the scan, also used for the tasks of the worker */
+typedef struct IndexItem
+{
+	gchar		*path;		/* locale encoded */
+	gboolean	 is_dir;
+	gboolean	 unread;	/* the file or directory still has to be read */
+	gint		 lang;
+	time_t		 mtime;
+	GPtrArray	*tags;		/* tags from the saved index, if the file didn't change */
+	gchar		*contents;	/* contents to parse otherwise */
+	gsize		 length;
+}
+IndexItem;
+
+/* The tags of a file in the saved index */
+typedef struct IndexRecord
+{
+	gint		 lang;
+	time_t		 mtime;
+	GPtrArray	*tags;
+}
+IndexRecord;
+
+typedef struct ProjectIndex
+{
+	TMWorkObject	*project;
+	gchar			*base_path;		/* locale encoded real path */
+	GSList			*patterns;		/* PatternLang for the filetypes with tags */
+	GSList			*file_patterns;	/* GPatternSpec for the project's file patterns */
+	GHashTable		*files;			/* path -> TMWorkObject of project */
+	GHashTable		*monitors;		/* directory path -> GFileMonitor */
+	GHashTable		*unmonitored;	/* directory paths above INDEX_MAX_MONITORS */
+	GHashTable		*pending;		/* paths which changed */
+	guint			 refresh_id;
+	GTimer			*timer;
+	gboolean		 complete;		/* whether the scan of the base path finished */
+
+	/* the worker */
+	GThreadPool		*pool;			/* IndexItem tasks, run one at a time */
+	GAsyncQueue		*queue;			/* IndexItem */
+	gchar			*index_file;
+	volatile gint	 cancelled;
+	volatile gint	 tasks;			/* number of tasks which aren't finished */
+	gboolean		 scanned;		/* whether the worker scanned the base path */
+	guint			 queue_id;
+
+	/* closing */
+	GThread			*close_thread;
+	guint			 close_idle_id;
+}
+ProjectIndex;
+
+
+ProjectIndexPrefs projectindex_prefs;
+
+static ProjectIndex *current_index = NULL;
+/* incremented when files are added to or removed from the index */
+static guint files_generation = 0;
+
+/* the closed indexes which are still saved */
+static GSList *closing_indexes = NULL;
+
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer data);
+
+
+static void free_item(IndexItem *item)
+{
+	g_free(item->path);
+	g_free(item->contents);
+	tm_tags_array_free(item->tags, TRUE);
+	g_slice_free(IndexItem, item);
+}
+
+
+static void free_record(gpointer data)
+{
+	IndexRecord *record = data;
+
+	tm_tags_array_free(record->tags, TRUE);
+	g_slice_free(IndexRecord, record);
+}
+
+
+static void free_monitor(gpointer data)
+{
+	GFileMonitor *monitor = data;
+
+	g_signal_handlers_disconnect_matched(monitor, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+		on_monitor_changed, NULL);
+	g_file_monitor_cancel(monitor);
+	g_object_unref(monitor);
+}
+
+
+/* The index of a project is stored in the projectindex directory of the configuration
+ * directory, named after a checksum of the base path. */
+static gchar *get_index_file(const gchar *base_path)
+{
+	gchar *dir = g_build_filename(app->configdir, "projectindex", NULL);
+	gchar *checksum, *path = NULL;
+
+	if (g_file_test(dir, G_FILE_TEST_IS_DIR) || utils_mkdir(dir, TRUE) == 0)
+	{
+		checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, base_path, -1);
+		path = g_build_filename(dir, checksum, NULL);
+		g_free(checksum);
+	}
+	g_free(dir);
+	return path;
+}
+
+
+static void build_patterns(ProjectIndex *index)
+{
+	guint i;
+	gchar **pattern;
+
+	for (i = 0; i < filetypes_array->len; i++)
+	{
+		GeanyFiletype *ft = filetypes[i];
+
+		if (ft->lang < 0 || ! filetype_has_tags(ft) || ft->pattern == NULL)
+			continue;
+		foreach_strv(pattern, ft->pattern)
+		{
+			PatternLang *pl = g_new(PatternLang, 1);
+
+			pl->spec = g_pattern_spec_new(*pattern);
+			pl->lang = ft->lang;
+			index->patterns = g_slist_prepend(index->patterns, pl);
+		}
+	}
+	index->patterns = g_slist_reverse(index->patterns);
+
+	if (app->project->file_patterns != NULL)
+	{
+		foreach_strv(pattern, app->project->file_patterns)
+			index->file_patterns = g_slist_prepend(index->file_patterns,
+				g_pattern_spec_new(*pattern));
+	}
+}
+
+
+static void free_patterns(ProjectIndex *index)
+{
+	GSList *node;
+
+	foreach_slist(node, index->patterns)
+	{
+		PatternLang *pl = node->data;
+
+		g_pattern_spec_free(pl->spec);
+		g_free(pl);
+	}
+	g_slist_free(index->patterns);
+	g_slist_foreach(index->file_patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(index->file_patterns);
+}
+
+
+/* Returns the tag manager language of path, or -1 if it shouldn't be indexed.
+ * The patterns are only read after they are built, so this is also used by the scan. */
+static gint match_lang(ProjectIndex *index, const gchar *path)
+{
+	const gchar *name = strrchr(path, G_DIR_SEPARATOR);
+	GSList *node;
+
+	name = (name != NULL) ? name + 1 : path;
+	if (index->file_patterns != NULL)
+	{
+		foreach_slist(node, index->file_patterns)
+		{
+			if (g_pattern_match_string(node->data, name))
+				break;
+		}
+		if (node == NULL)
+			return -1;
+	}
+	foreach_slist(node, index->patterns)
+	{
+		PatternLang *pl = node->data;
+
+		if (g_pattern_match_string(pl->spec, name))
+			return pl->lang;
+	}
+	return -1;
+}
+
+
+/* Reads the index written by tm_project_save(): each file pseudo tag is followed by the
+ * tags of the file. */
+static GHashTable *read_index(ProjectIndex *index)
+{
+	GHashTable *records = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_record);
+	IndexRecord *record = NULL;
+	TMTag *tag;
+	FILE *fp;
+
+	fp = g_fopen(index->index_file, "r");
+	if (fp == NULL)
+		return records;
+
+	while (! g_atomic_int_get(&index->cancelled) && (tag = tm_tag_read(NULL, fp)) != NULL)
+	{
+		if (tag->type == tm_tag_file_t)
+		{
+			record = g_slice_new(IndexRecord);
+			record->lang = tag->atts.file.lang;
+			record->mtime = tag->atts.file.timestamp;
+			record->tags = g_ptr_array_new();
+			g_hash_table_insert(records, g_strdup(tag->name), record);
+			tm_tag_unref(tag);
+		}
+		else if (record != NULL)
+			g_ptr_array_add(record->tags, tag);
+		else
+			tm_tag_unref(tag);
+	}
+	/* a line which can't be read means the index is damaged, so don't trust any of it */
+	if (! feof(fp) && ! g_atomic_int_get(&index->cancelled))
+	{
+		geany_debug("Ignoring damaged project index %s", index->index_file);
+		g_hash_table_remove_all(records);
+	}
+	fclose(fp);
+	return records;
+}
+
+
+static void push_item(ProjectIndex *index, IndexItem *item)
+{
+	/* don't read too many files ahead of the parsing */
+	while (g_async_queue_length(index->queue) >= INDEX_MAX_QUEUED &&
+		! g_atomic_int_get(&index->cancelled))
+		g_usleep(10000);
+
+	g_async_queue_push(index->queue, item);
+}
+
+
+static IndexItem *new_item(const gchar *path, gboolean is_dir, gint lang, time_t mtime)
+{
+	IndexItem *item = g_slice_new0(IndexItem);
+
+	item->path = g_strdup(path);
+	item->is_dir = is_dir;
+	item->unread = TRUE;
+	item->lang = lang;
+	item->mtime = mtime;
+	return item;
+}
+
+
+/* Returns FALSE if the file can't be read */
+static gboolean read_item(IndexItem *item)
+{
+	if (! g_file_get_contents(item->path, &item->contents, &item->length, NULL))
+		return FALSE;
+	item->unread = FALSE;
+	return TRUE;
+}
+
+
+/* Without records, the main thread decides whether the file has to be read, because
+ * only it knows the files in the index. */
+static void scan_file(ProjectIndex *index, GHashTable *records, const gchar *path,
+		struct stat *st)
+{
+	gint lang = match_lang(index, path);
+	IndexRecord *record;
+	IndexItem *item;
+
+	if (lang < 0)
+		return;
+
+	item = new_item(path, FALSE, lang, st->st_mtime);
+	if (records != NULL)
+	{
+		record = g_hash_table_lookup(records, path);
+		if (record != NULL && record->mtime == st->st_mtime && record->lang == lang)
+		{
+			item->tags = record->tags;
+			record->tags = NULL;
+			item->unread = FALSE;
+		}
+		else if (! read_item(item))
+		{
+			free_item(item);
+			return;
+		}
+	}
+	push_item(index, item);
+}
+
+
+/* With records, the whole tree is scanned, otherwise only dir_path and the
+ * subdirectories are left to the main thread. */
+static void scan_dir(ProjectIndex *index, GHashTable *records, const gchar *dir_path)
+{
+	GDir *dir = g_dir_open(dir_path, 0, NULL);
+	const gchar *name;
+	IndexItem *item;
+
+	if (dir == NULL)
+		return;
+
+	if (records != NULL)
+	{
+		item = new_item(dir_path, TRUE, -1, 0);
+		item->unread = FALSE;
+		push_item(index, item);
+	}
+
+	while ((name = g_dir_read_name(dir)) != NULL && ! g_atomic_int_get(&index->cancelled))
+	{
+		gchar *path;
+		struct stat st;
+
+		/* skip hidden files and directories, e.g. those of version control systems */
+		if (name[0] == '.')
+			continue;
+
+		path = g_build_filename(dir_path, name, NULL);
+		/* symbolic links aren't followed, they could loop or index files twice */
+		if (g_lstat(path, &st) == 0)
+		{
+			if (S_ISDIR(st.st_mode) && records != NULL)
+				scan_dir(index, records, path);
+			else if (S_ISDIR(st.st_mode))
+				push_item(index, new_item(path, TRUE, -1, 0));
+			else if (S_ISREG(st.st_mode))
+				scan_file(index, records, path, &st);
+		}
+		g_free(path);
+	}
+	g_dir_close(dir);
+}
+
+
+static void scan_base_path(ProjectIndex *index)
+{
+	GHashTable *records = read_index(index);
+
+	scan_dir(index, records, index->base_path);
+	/* the remaining records are of files which have been removed or changed */
+	g_hash_table_destroy(records);
+}
+
+
+/* Runs a task in the worker: scans a directory or reads a file */
+static void run_task(gpointer data, gpointer user_data)
+{
+	ProjectIndex *index = user_data;
+	IndexItem *task = data;
+
+	if (g_atomic_int_get(&index->cancelled))
+		free_item(task);
+	else if (! task->is_dir)
+	{
+		if (read_item(task))
+			push_item(index, task);
+		else
+			free_item(task);
+	}
+	else
+	{
+		/* the first task is the base path, which also reads the saved index */
+		if (! index->scanned)
+		{
+			scan_base_path(index);
+			index->scanned = TRUE;
+		}
+		else
+			scan_dir(index, NULL, task->path);
+		free_item(task);
+	}
+	/* after the items are pushed, see on_queue_poll() */
+	g_atomic_int_add(&index->tasks, -1);
+}
+
+
+static gboolean is_known_dir(ProjectIndex *index, const gchar *path)
+{
+	return g_hash_table_lookup(index->monitors, path) != NULL ||
+		g_hash_table_lookup_extended(index->unmonitored, path, NULL, NULL);
+}
+
+
+static void add_monitor(ProjectIndex *index, const gchar *path)
+{
+	GFileMonitor *monitor = NULL;
+	GFile *file;
+
+	if (is_known_dir(index, path))
+		return;
+
+	if (g_hash_table_size(index->monitors) < INDEX_MAX_MONITORS)
+	{
+		file = g_file_new_for_path(path);
+		monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+		g_object_unref(file);
+	}
+	else if (g_hash_table_size(index->unmonitored) == 0)
+		geany_debug("Project index of %s: more than %d directories, the others are only "
+			"scanned when the project is saved or Geany is focused", index->base_path,
+			INDEX_MAX_MONITORS);
+
+	/* the directory is scanned again later instead, see rescan_unmonitored() */
+	if (monitor == NULL)
+	{
+		g_hash_table_insert(index->unmonitored, g_strdup(path), NULL);
+		return;
+	}
+	g_signal_connect(monitor, "changed", G_CALLBACK(on_monitor_changed), index);
+	g_hash_table_insert(index->monitors, g_strdup(path), monitor);
+}
+
+
+static void remove_dir(ProjectIndex *index, const gchar *path)
+{
+	gchar *prefix = g_strconcat(path, G_DIR_SEPARATOR_S, NULL);
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, index->files);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		if (g_str_has_prefix(key, prefix))
+		{
+			/* the key is part of the source file */
+			g_hash_table_iter_remove(&iter);
+			tm_project_remove_source_file(TM_PROJECT(index->project), value);
+			files_generation++;
+		}
+	}
+	g_hash_table_iter_init(&iter, index->monitors);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		if (g_str_has_prefix(key, prefix))
+			g_hash_table_iter_remove(&iter);
+	}
+	g_hash_table_iter_init(&iter, index->unmonitored);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		if (g_str_has_prefix(key, prefix))
+			g_hash_table_iter_remove(&iter);
+	}
+	g_hash_table_remove(index->monitors, path);
+	g_hash_table_remove(index->unmonitored, path);
+	g_free(prefix);
+}
+
+
+static gboolean on_queue_poll(gpointer data);
+
+static void schedule_queue_poll(ProjectIndex *index, gboolean busy)
+{
+	if (busy)
+		index->queue_id = g_idle_add_full(G_PRIORITY_LOW, on_queue_poll, index, NULL);
+	else
+		index->queue_id = g_timeout_add_full(G_PRIORITY_LOW, INDEX_POLL_INTERVAL,
+			on_queue_poll, index, NULL);
+}
+
+
+/* Lets the worker scan a directory or read a file. Takes ownership of task. */
+static void queue_task(ProjectIndex *index, IndexItem *task)
+{
+	g_atomic_int_inc(&index->tasks);
+	g_thread_pool_push(index->pool, task, NULL);
+	if (index->queue_id == 0)
+		schedule_queue_poll(index, FALSE);
+}
+
+
+/* Lets the worker scan a directory which isn't in the index yet */
+static void queue_dir(ProjectIndex *index, IndexItem *task)
+{
+	if (is_known_dir(index, task->path))
+	{
+		free_item(task);
+		return;
+	}
+	/* watch it first, so that no change is missed during the scan */
+	add_monitor(index, task->path);
+	queue_task(index, task);
+}
+
+
+/* Lets the worker read a file which isn't in the index or changed since it was parsed */
+static void queue_file(ProjectIndex *index, IndexItem *task)
+{
+	TMWorkObject *source_file = g_hash_table_lookup(index->files, task->path);
+
+	/* open documents are updated when they are closed */
+	if (source_file != NULL &&
+		(TM_SOURCE_FILE(source_file)->inactive || source_file->analyze_time == task->mtime))
+		free_item(task);
+	else
+		queue_task(index, task);
+}
+
+
+/* Adds or updates a file, either with the tags from the saved index or by parsing
+ * contents. Takes ownership of tags. */
+static void add_file(ProjectIndex *index, const gchar *path, gint lang, time_t mtime,
+		GPtrArray *tags, const gchar *contents, gsize length)
+{
+	TMWorkObject *source_file = g_hash_table_lookup(index->files, path);
+	guint i;
+
+	if (source_file == NULL)
+	{
+		source_file = tm_source_file_new(path, FALSE, tm_source_file_get_lang_name(lang));
+		if (source_file == NULL)
+		{
+			tm_tags_array_free(tags, TRUE);
+			return;
+		}
+		tm_project_add_source_file(TM_PROJECT(index->project), source_file);
+		g_hash_table_insert(index->files, source_file->file_name, source_file);
+		files_generation++;
+	}
+
+	if (tags != NULL)
+	{
+		for (i = 0; i < tags->len; i++)
+			TM_TAG(tags->pdata[i])->atts.entry.file = TM_SOURCE_FILE(source_file);
+		tm_tags_array_free(source_file->tags_array, TRUE);
+		source_file->tags_array = tags;
+	}
+	else if (length > 0)
+		tm_source_file_buffer_update(source_file, (guchar *) contents, length, FALSE);
+	else if (source_file->tags_array != NULL)
+		g_ptr_array_set_size(source_file->tags_array, 0);
+	finder_invalidate_tags(source_file);
+
+	source_file->analyze_time = mtime;
+	/* open documents have their own tags */
+	TM_SOURCE_FILE(source_file)->inactive =
+		(document_find_by_real_path(source_file->file_name) != NULL);
+}
+
+
+static void remove_file(ProjectIndex *index, TMWorkObject *source_file)
+{
+	g_hash_table_remove(index->files, source_file->file_name);
+	tm_project_remove_source_file(TM_PROJECT(index->project), source_file);
+	files_generation++;
+}
+
+
+static void add_item(ProjectIndex *index, IndexItem *item)
+{
+	if (item->is_dir && item->unread)
+		queue_dir(index, item);
+	else if (item->unread)
+		queue_file(index, item);
+	else
+	{
+		if (item->is_dir)
+			add_monitor(index, item->path);
+		else
+		{
+			add_file(index, item->path, item->lang, item->mtime, item->tags,
+				item->contents, item->length);
+			item->tags = NULL;
+		}
+		free_item(item);
+	}
+}
+
+
+static gboolean on_queue_poll(gpointer data)
+{
+	ProjectIndex *index = data;
+	/* checked first, then all items of the finished tasks are in the queue */
+	gboolean done = g_atomic_int_get(&index->tasks) == 0;
+	IndexItem *item;
+
+	g_timer_start(index->timer);
+	while ((item = g_async_queue_try_pop(index->queue)) != NULL)
+	{
+		add_item(index, item);
+		if (g_timer_elapsed(index->timer, NULL) > INDEX_TIME_SLICE)
+		{
+			schedule_queue_poll(index, TRUE);
+			return FALSE;
+		}
+	}
+	/* the items might have queued new tasks */
+	if (done && g_atomic_int_get(&index->tasks) == 0)
+	{
+		index->queue_id = 0;
+		if (! index->complete)
+			geany_debug("Project index of %s: %u files", index->base_path,
+				g_hash_table_size(index->files));
+		index->complete = TRUE;
+	}
+	else
+		schedule_queue_poll(index, FALSE);
+	return FALSE;
+}
+
+
+/* Updates the index after a file or directory below the base path changed */
+static void refresh_path(ProjectIndex *index, const gchar *path)
+{
+	TMWorkObject *source_file = g_hash_table_lookup(index->files, path);
+	struct stat st;
+	gint lang;
+
+	if (g_lstat(path, &st) != 0)
+	{
+		if (source_file != NULL)
+			remove_file(index, source_file);
+		else if (is_known_dir(index, path))
+			remove_dir(index, path);
+		return;
+	}
+	if (S_ISDIR(st.st_mode))
+		queue_dir(index, new_item(path, TRUE, -1, 0));
+	else if (S_ISREG(st.st_mode))
+	{
+		lang = match_lang(index, path);
+		if (lang >= 0)
+			queue_file(index, new_item(path, FALSE, lang, st.st_mtime));
+	}
+}
+
+
+static gboolean on_refresh_idle(gpointer data)
+{
+	ProjectIndex *index = data;
+	GHashTableIter iter;
+	gpointer key;
+
+	g_timer_start(index->timer);
+	g_hash_table_iter_init(&iter, index->pending);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		gchar *path = g_strdup(key);
+
+		g_hash_table_iter_remove(&iter);
+		refresh_path(index, path);
+		g_free(path);
+		if (g_timer_elapsed(index->timer, NULL) > INDEX_TIME_SLICE)
+			return TRUE;
+	}
+	index->refresh_id = 0;
+	return FALSE;
+}
+
+
+/* Takes ownership of path */
+static void queue_refresh(ProjectIndex *index, gchar *path)
+{
+	g_hash_table_replace(index->pending, path, NULL);
+	if (index->refresh_id == 0)
+		index->refresh_id = g_idle_add_full(G_PRIORITY_LOW, on_refresh_idle, index, NULL);
+}
+
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer data)
+{
+	ProjectIndex *index = data;
+	gchar *path, *name;
+
+	if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+		event_type != G_FILE_MONITOR_EVENT_CREATED &&
+		event_type != G_FILE_MONITOR_EVENT_DELETED)
+		return;
+
+	path = g_file_get_path(file);
+	if (path == NULL)
+		return;
+	name = strrchr(path, G_DIR_SEPARATOR);
+	if (name != NULL && name[1] == '.')
+		g_free(path);
+	else
+		queue_refresh(index, path);
+}
+
+
+static void on_document_open(GObject *obj, GeanyDocument *doc, gpointer data)
+{
+	TMWorkObject *source_file;
+
+	if (current_index == NULL || doc->real_path == NULL)
+		return;
+
+	source_file = g_hash_table_lookup(current_index->files, doc->real_path);
+	if (source_file != NULL)
+		TM_SOURCE_FILE(source_file)->inactive = TRUE;
+}
+
+
+static void on_document_close(GObject *obj, GeanyDocument *doc, gpointer data)
+{
+	TMWorkObject *source_file;
+
+	if (current_index == NULL || doc->real_path == NULL)
+		return;
+
+	source_file = g_hash_table_lookup(current_index->files, doc->real_path);
+	if (source_file != NULL)
+	{
+		/* the file might have been saved while it was open */
+		TM_SOURCE_FILE(source_file)->inactive = FALSE;
+		queue_refresh(current_index, g_strdup(doc->real_path));
+	}
+}
+
+
+static gboolean start_thread(GThread **thread, const gchar *name, GThreadFunc func, gpointer data)
+{
+	GError *error = NULL;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	*thread = g_thread_try_new(name, func, data, &error);
+#else
+	*thread = g_thread_create(func, data, TRUE, &error);
+#endif
+	if (*thread == NULL)
+	{
+		geany_debug("Could not create %s thread: %s", name, error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+/* Frees what is left of an index after it was released */
+static void free_index(ProjectIndex *index)
+{
+	tm_work_object_free(index->project);
+	g_free(index->base_path);
+	g_free(index->index_file);
+	g_free(index);
+}
+
+
+/* Stops the worker, saves the index if it's complete and frees the files */
+static void release_index(ProjectIndex *index)
+{
+	TMProject *project = TM_PROJECT(index->project);
+	IndexItem *item;
+	guint i;
+
+	/* the tasks return early once cancelled */
+	g_thread_pool_free(index->pool, FALSE, TRUE);
+	while ((item = g_async_queue_try_pop(index->queue)) != NULL)
+		free_item(item);
+	g_async_queue_unref(index->queue);
+	free_patterns(index);
+
+	/* an incomplete index would make the next scan parse the missing files again,
+	 * while the old index is still good for the files which didn't change */
+	if (index->complete)
+		tm_project_save(project);
+	/* the tags can be freed here, only the project itself is part of the workspace */
+	if (project->file_list != NULL)
+	{
+		for (i = 0; i < project->file_list->len; i++)
+			tm_work_object_free(project->file_list->pdata[i]);
+		g_ptr_array_set_size(project->file_list, 0);
+	}
+}
+
+
+/* Waits until a closed index is saved and frees it */
+static void wait_for_close(ProjectIndex *index)
+{
+	g_thread_join(index->close_thread);
+	/* the thread added the source before exiting */
+	if (index->close_idle_id != 0)
+		g_source_remove(index->close_idle_id);
+
+	closing_indexes = g_slist_remove(closing_indexes, index);
+	free_index(index);
+}
+
+
+static gboolean on_close_done(gpointer data)
+{
+	ProjectIndex *index = data;
+
+	index->close_idle_id = 0;
+	wait_for_close(index);
+	return FALSE;
+}
+
+
+static gpointer close_thread_func(gpointer data)
+{
+	ProjectIndex *index = data;
+
+	release_index(index);
+	index->close_idle_id = g_idle_add(on_close_done, index);
+	return NULL;
+}
+
+
+static void close_index(ProjectIndex *index)
+{
+	g_atomic_int_set(&index->cancelled, TRUE);
+	if (index->queue_id != 0)
+		g_source_remove(index->queue_id);
+	if (index->refresh_id != 0)
+		g_source_remove(index->refresh_id);
+
+	g_hash_table_destroy(index->monitors);
+	g_hash_table_destroy(index->unmonitored);
+	g_hash_table_destroy(index->pending);
+	g_hash_table_destroy(index->files);
+	g_timer_destroy(index->timer);
+
+	tm_workspace_remove_object(index->project, FALSE, TRUE);
+	files_generation++;
+
+	/* waiting for the worker and saving can take a while */
+	if (start_thread(&index->close_thread, "projectindex-close", close_thread_func, index))
+		closing_indexes = g_slist_prepend(closing_indexes, index);
+	else
+	{
+		release_index(index);
+		free_index(index);
+	}
+}
+
+
+static void open_index(const gchar *locale_base_path)
+{
+	ProjectIndex *index;
+	GSList *node, *next;
+	GError *error = NULL;
+
+	index = g_new0(ProjectIndex, 1);
+	index->base_path = tm_get_real_path(locale_base_path);
+	index->index_file = get_index_file(index->base_path);
+	if (index->index_file != NULL)
+	{
+		/* the same project might still be saved to the index file */
+		for (node = closing_indexes; node != NULL; node = next)
+		{
+			ProjectIndex *closing = node->data;
+
+			next = node->next;
+			if (strcmp(closing->index_file, index->index_file) == 0)
+				wait_for_close(closing);
+		}
+		index->project = tm_project_new_empty(index->base_path, index->index_file);
+	}
+	if (index->project != NULL)
+		index->pool = g_thread_pool_new(run_task, index, 1, FALSE, &error);
+	if (index->pool == NULL)
+	{
+		if (error != NULL)
+		{
+			geany_debug("Could not create projectindex thread: %s", error->message);
+			g_error_free(error);
+		}
+		free_index(index);
+		return;
+	}
+	build_patterns(index);
+	index->files = g_hash_table_new(g_str_hash, g_str_equal);
+	index->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_monitor);
+	index->unmonitored = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	index->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	index->queue = g_async_queue_new();
+	index->timer = g_timer_new();
+
+	queue_task(index, new_item(index->base_path, TRUE, -1, 0));
+	current_index = index;
+}
+
+
+static void on_project_open(GObject *obj, GKeyFile *config, gpointer data)
+{
+	gchar *utf8_base_path, *locale_base_path;
+
+	if (! projectindex_prefs.enabled)
+		return;
+
+	utf8_base_path = project_get_base_path();
+	if (utf8_base_path == NULL)
+		return;
+	locale_base_path = utils_get_locale_from_utf8(utf8_base_path);
+	if (g_file_test(locale_base_path, G_FILE_TEST_IS_DIR))
+		open_index(locale_base_path);
+	g_free(locale_base_path);
+	g_free(utf8_base_path);
+}
+
+
+/* Lets the worker look for new and changed files in the directories above
+ * INDEX_MAX_MONITORS, which aren't watched */
+static void rescan_unmonitored(ProjectIndex *index)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	/* the last scan isn't done yet */
+	if (g_atomic_int_get(&index->tasks) > 0)
+		return;
+
+	g_hash_table_iter_init(&iter, index->unmonitored);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		queue_task(index, new_item(key, TRUE, -1, 0));
+}
+
+
+static void on_project_save(GObject *obj, GKeyFile *config, gpointer data)
+{
+	if (current_index != NULL)
+		rescan_unmonitored(current_index);
+}
+
+
+/* the files might have been changed in another program */
+static gboolean on_window_focus_in(GtkWidget *widget, GdkEventFocus *event, gpointer data)
+{
+	if (current_index != NULL)
+		rescan_unmonitored(current_index);
+	return FALSE;
+}
+
+
+static void on_project_close(GObject *obj, gpointer data)
+{
+	if (current_index != NULL)
+	{
+		close_index(current_index);
+		current_index = NULL;
+	}
+}
+
+
+/* Returns a number which changes whenever files are added to or removed from the index,
+ * to find out whether a copy of the file list is outdated. */
+guint projectindex_get_generation(void)
+{
+	return files_generation;
+}
+
+
+/* Calls func with the locale encoded path of each indexed file */
+void projectindex_foreach_file(GFunc func, gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	if (current_index == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, current_index->files);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		func(key, user_data);
+}
+
+
+void projectindex_init(void)
+{
+	g_signal_connect(geany_object, "project-open", G_CALLBACK(on_project_open), NULL);
+	g_signal_connect(geany_object, "project-close", G_CALLBACK(on_project_close), NULL);
+	g_signal_connect(geany_object, "project-save", G_CALLBACK(on_project_save), NULL);
+	g_signal_connect(geany_object, "document-open", G_CALLBACK(on_document_open), NULL);
+	g_signal_connect(geany_object, "document-reload", G_CALLBACK(on_document_open), NULL);
+	g_signal_connect(geany_object, "document-close", G_CALLBACK(on_document_close), NULL);
+	g_signal_connect(main_widgets.window, "focus-in-event", G_CALLBACK(on_window_focus_in), NULL);
+}
+
+
+void projectindex_finalize(void)
+{
+	on_project_close(NULL, NULL);
+	while (closing_indexes != NULL)
+		wait_for_close(closing_indexes->data);
+}
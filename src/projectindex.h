@@ -0,0 +1,44 @@
+/*
+ *      projectindex.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef GEANY_PROJECTINDEX_H
+#define GEANY_PROJECTINDEX_H 1
+
+
+typedef struct ProjectIndexPrefs
+{
+	gboolean	enabled;	/* index the files under the project base path */
+}
+ProjectIndexPrefs;
+
+extern ProjectIndexPrefs projectindex_prefs;
+
+
+void projectindex_init(void);
+
+guint projectindex_get_generation(void);
+
+void projectindex_foreach_file(GFunc func, gpointer user_data);
+
+void projectindex_finalize(void);
+
+
+#endif
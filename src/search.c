@@ -33,6 +33,7 @@
 #include "utils.h"
 #include "document.h"
 #include "msgwindow.h"
+#include "geanymsgstore.h"
 #include "sciwrappers.h"
 #include "ui_utils.h"
 #include "editor.h"
@@ -153,6 +154,9 @@ static gchar **search_get_argv(const gchar **argv_prefix, const gchar *dir);
 
 static GRegex *compile_regex(const gchar *str, gint sflags);
 
+static GSList *find_regex_range(const gchar *text, gint len, GRegex *regex, gint flags,
+		gint start, gint end);
+
 
 static void
 on_find_replace_checkbutton_toggled(GtkToggleButton *togglebutton, gpointer user_data);
@@ -1190,6 +1194,22 @@ static GSList *find_range(ScintillaObject *sci, gint flags, struct Sci_TextToFin
 	if (! *ttf->lpstrText)
 		return NULL;
 
+	if (flags & SCFIND_REGEXP)
+	{
+		/* compile the regex once rather than for each match */
+		GRegex *regex = compile_regex(ttf->lpstrText, flags);
+		const gchar *text;
+
+		if (!regex)
+			return NULL;
+
+		text = (const gchar *) scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0);
+		matches = find_regex_range(text, sci_get_length(sci), regex, flags,
+			ttf->chrg.cpMin, ttf->chrg.cpMax);
+		g_regex_unref(regex);
+		return matches;
+	}
+
 	while (search_find_text(sci, flags, ttf, &info) != -1)
 	{
 		if (ttf->chrgText.cpMax > ttf->chrg.cpMax)
@@ -1376,25 +1396,126 @@ on_replace_entry_activate(GtkEntry *entry, gpointer user_data)
 }
 
 
+typedef struct FindJob
+{
+	GeanyDocument *doc;
+	gint flags;
+	const gchar *text;	/* the buffer of doc, for regex searches */
+	gint len;
+	GSList *matches;
+}
+FindJob;
+
+
+static void find_job_run(gpointer data, gpointer user_data)
+{
+	FindJob *job = data;
+
+	job->matches = find_regex_range(job->text, job->len, user_data, job->flags, 0, job->len);
+}
+
+
+/* Finds the matches in the documents of jobs. Regex searches run in parallel, directly on
+ * the buffers, which cannot change until all have finished as this doesn't return to
+ * the main loop meanwhile. */
+static void find_in_documents(FindJob *jobs, guint n_jobs, const gchar *find, gint flags)
+{
+	GThreadPool *pool = NULL;
+	GRegex *regex = NULL;
+	guint i;
+
+	if (flags & SCFIND_REGEXP)
+	{
+		gint n_threads;
+
+		regex = compile_regex(find, flags);
+		if (!regex)
+			return;
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		n_threads = g_get_num_processors();
+#else
+		n_threads = 4;
+#endif
+		if (n_jobs > 1 && n_threads > 1)
+			pool = g_thread_pool_new(find_job_run, regex, n_threads, FALSE, NULL);
+	}
+
+	for (i = 0; i < n_jobs; i++)
+	{
+		FindJob *job = &jobs[i];
+		ScintillaObject *sci = job->doc->editor->sci;
+
+		/* a save would still read the text while the gap is moved below */
+		document_wait_for_save(job->doc);
+		/* e.g. a custom command or word count still uses the text, it can't be replaced */
+		if (job->doc->readonly || document_buffer_is_held(job->doc))
+			continue;
+
+		job->flags = flags;
+		job->len = sci_get_length(sci);
+		if (regex != NULL)
+		{
+			/* this moves the gap out of the text */
+			job->text = (const gchar *) scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0);
+			if (pool != NULL)
+				g_thread_pool_push(pool, job, NULL);
+			else
+				find_job_run(job, regex);
+		}
+		else
+		{
+			struct Sci_TextToFind ttf;
+
+			ttf.chrg.cpMin = 0;
+			ttf.chrg.cpMax = job->len;
+			ttf.lpstrText = (gchar *) find;
+			job->matches = find_range(sci, flags, &ttf);
+		}
+	}
+
+	if (pool != NULL)
+		g_thread_pool_free(pool, FALSE, TRUE);
+	if (regex != NULL)
+		g_regex_unref(regex);
+}
+
+
 static void replace_in_session(GeanyDocument *doc,
 		gint search_flags_re, gboolean search_replace_escape_re,
 		const gchar *find, const gchar *replace,
 		const gchar *original_find, const gchar *original_replace)
 {
 	guint n, page_count, rep_count = 0, file_count = 0;
+	FindJob *jobs;
+
+	/* an empty regex would match between all characters */
+	if (EMPTY(find))
+		return;
 
 	/* replace in all documents following notebook tab order */
 	page_count = gtk_notebook_get_n_pages(GTK_NOTEBOOK(main_widgets.notebook));
+	jobs = g_new0(FindJob, page_count);
+	for (n = 0; n < page_count; n++)
+		jobs[n].doc = document_get_from_page(n);
+
+	/* find all matches before changing any document */
+	find_in_documents(jobs, page_count, find, search_flags_re);
+
+	/* parse the tags of the changed documents only once, after all replacements */
+	document_defer_tag_updates(TRUE);
 	for (n = 0; n < page_count; n++)
 	{
-		GeanyDocument *tmp_doc = document_get_from_page(n);
 		gint reps = 0;
 
-		reps = document_replace_all(tmp_doc, find, replace, original_find, original_replace, search_flags_re);
+		reps = document_replace_matches(jobs[n].doc, jobs[n].matches, replace,
+			original_find, original_replace);
 		rep_count += reps;
 		if (reps)
 			file_count++;
 	}
+	document_defer_tag_updates(FALSE);
+	g_free(jobs);
 	if (file_count == 0)
 	{
 		utils_beep();
@@ -1700,7 +1821,7 @@ search_find_in_files(const gchar *utf8_search_text, const gchar *dir, const gcha
 		return FALSE;
 	}
 
-	gtk_list_store_clear(msgwindow.store_msg);
+	geany_msg_store_clear(msgwindow.store_msg);
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_MESSAGE);
 
 	if (! g_spawn_async_with_pipes(dir, (gchar**)argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
@@ -1944,17 +2065,14 @@ static gchar *get_regex_match_string(const gchar *text, const GeanyMatchInfo *ma
 }
 
 
-static gint find_regex(ScintillaObject *sci, guint pos, GRegex *regex, GeanyMatchInfo *match)
+/* Finds the first match of regex in text from pos on. text must stay unchanged meanwhile,
+ * this doesn't use Scintilla so it can be called from other threads. */
+static gint find_regex_in_text(const gchar *text, guint pos, GRegex *regex,
+		GeanyMatchInfo *match)
 {
-	const gchar *text;
 	GMatchInfo *minfo;
 	gint ret = -1;
 
-	g_return_val_if_fail(pos <= (guint)sci_get_length(sci), -1);
-
-	/* Warning: any SCI calls will invalidate 'text' after calling SCI_GETCHARACTERPOINTER */
-	text = (void*)scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0);
-
 	/* Warning: minfo will become invalid when 'text' does! */
 	if (g_regex_match_full(regex, text, -1, pos, 0, &minfo, NULL))
 	{
@@ -1980,6 +2098,49 @@ static gint find_regex(ScintillaObject *sci, guint pos, GRegex *regex, GeanyMatc
 }
 
 
+static gint find_regex(ScintillaObject *sci, guint pos, GRegex *regex, GeanyMatchInfo *match)
+{
+	const gchar *text;
+
+	g_return_val_if_fail(pos <= (guint)sci_get_length(sci), -1);
+
+	/* Warning: any SCI calls will invalidate 'text' after calling SCI_GETCHARACTERPOINTER */
+	text = (void*)scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0);
+
+	return find_regex_in_text(text, pos, regex, match);
+}
+
+
+/* Finds all matches of regex between start and end in text of length len, like
+ * find_range(). This can be called from other threads, like find_regex_in_text(). */
+static GSList *find_regex_range(const gchar *text, gint len, GRegex *regex, gint flags,
+		gint start, gint end)
+{
+	GSList *matches = NULL;
+	gint pos = start;
+
+	while (pos <= len)
+	{
+		GeanyMatchInfo *info = match_info_new(flags, 0, 0);
+		gint ret = find_regex_in_text(text, pos, regex, info);
+
+		/* stop at matches which are not or only partially in range */
+		if (ret == -1 || ret >= end || info->end > end)
+		{
+			geany_match_info_free(info);
+			break;
+		}
+		matches = g_slist_prepend(matches, info);
+		pos = info->end;
+
+		/* avoid rematching with empty matches, see find_range() */
+		if (info->end == info->start)
+			pos++;
+	}
+	return g_slist_reverse(matches);
+}
+
+
 gint search_find_prev(ScintillaObject *sci, const gchar *str, gint flags, GeanyMatchInfo **match_)
 {
 	gint ret;
@@ -2173,7 +2334,7 @@ void search_find_usage(const gchar *search_text, const gchar *original_search_te
 	}
 
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_MESSAGE);
-	gtk_list_store_clear(msgwindow.store_msg);
+	geany_msg_store_clear(msgwindow.store_msg);
 
 	if (! in_session)
 	{	/* use current document */
@@ -2211,41 +2372,73 @@ void search_find_usage(const gchar *search_text, const gchar *original_search_te
 /* ttf is updated to include the last match position (ttf->chrg.cpMin) and
  * the new search range end (ttf->chrg.cpMax).
  * Note: Normally you would call sci_start/end_undo_action() around this call. */
-guint search_replace_range(ScintillaObject *sci, struct Sci_TextToFind *ttf,
-		gint flags, const gchar *replace_text)
+/* Replaces the matches, which must be in order and found in the current text of sci,
+ * and frees them.
+ * If not NULL, *last_start is set to the start of the last replacement and *offset to
+ * the difference of the text length.
+ * Returns: the number of replacements made, 0 if sci is read-only. */
+guint search_replace_matches(ScintillaObject *sci, GSList *matches, const gchar *replace_text,
+		gint *last_start, gint *offset)
 {
 	gint count = 0;
-	gint offset = 0; /* difference between search pos and replace pos */
-	GSList *match, *matches;
+	gint diff = 0; /* difference between search pos and replace pos */
+	GSList *match;
 
-	g_return_val_if_fail(sci != NULL && ttf->lpstrText != NULL && replace_text != NULL, 0);
-	if (! *ttf->lpstrText)
+	/* replacing would silently do nothing */
+	if (scintilla_send_message(sci, SCI_GETREADONLY, 0, 0))
+	{
+		g_slist_foreach(matches, (GFunc) geany_match_info_free, NULL);
+		g_slist_free(matches);
+		if (offset != NULL)
+			*offset = 0;
 		return 0;
+	}
 
-	matches = find_range(sci, flags, ttf);
 	foreach_slist (match, matches)
 	{
 		GeanyMatchInfo *info = match->data;
 		gint replace_len;
 
-		info->start += offset;
-		info->end += offset;
+		info->start += diff;
+		info->end += diff;
 
 		replace_len = search_replace_match(sci, info, replace_text);
-		offset += replace_len - (info->end - info->start);
+		diff += replace_len - (info->end - info->start);
 		count ++;
 
-		/* on last match, update the last match/new range end */
-		if (! match->next)
-		{
-			ttf->chrg.cpMin = info->start;
-			ttf->chrg.cpMax += offset;
-		}
+		if (! match->next && last_start != NULL)
+			*last_start = info->start;
 
 		geany_match_info_free(info);
 	}
 	g_slist_free(matches);
 
+	if (offset != NULL)
+		*offset = diff;
+	return count;
+}
+
+
+guint search_replace_range(ScintillaObject *sci, struct Sci_TextToFind *ttf,
+		gint flags, const gchar *replace_text)
+{
+	gint count;
+	gint last_start, offset;
+	GSList *matches;
+
+	g_return_val_if_fail(sci != NULL && ttf->lpstrText != NULL && replace_text != NULL, 0);
+	if (! *ttf->lpstrText)
+		return 0;
+
+	matches = find_range(sci, flags, ttf);
+	count = search_replace_matches(sci, matches, replace_text, &last_start, &offset);
+
+	/* update the last match/new range end */
+	if (count > 0)
+	{
+		ttf->chrg.cpMin = last_start;
+		ttf->chrg.cpMax += offset;
+	}
 	return count;
 }
 
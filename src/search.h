@@ -121,6 +121,9 @@ gint search_replace_match(struct _ScintillaObject *sci, const GeanyMatchInfo *ma
 guint search_replace_range(struct _ScintillaObject *sci, struct Sci_TextToFind *ttf,
 		gint flags, const gchar *replace_text);
 
+guint search_replace_matches(struct _ScintillaObject *sci, GSList *matches,
+		const gchar *replace_text, gint *last_start, gint *offset);
+
 G_END_DECLS
 
 #endif
@@ -40,7 +40,15 @@
  * The command window is only available on Windows and takes no additional data, instead it
  * writes back a Windows handle (HWND) for the main window to set it to the foreground (focus).
  *
- * At the moment the commands window, doclist, open, openro, line and column are available.
+ * The command opened also takes no additional data and writes back a line for each file of the
+ * previous open or openro command of the connection, with the index of its document (or -1 if it
+ * couldn't be opened) and the filename, followed by a '.' line.
+ *
+ * At the moment the commands window, doclist, open, openro, opened, line and column are available.
+ *
+ * The running instance reads and answers the commands without blocking, and opens the files of
+ * each open command a few at a time in an idle callback, parsing their tags afterwards. The
+ * commands of a connection are handled in order, so a command after open sees its files.
  *
  * About the socket files on Unix-like systems:
  * Geany creates a socket in /tmp (or any other directory returned by g_get_tmp_dir()) and
@@ -57,6 +65,7 @@
 #ifdef HAVE_SOCKET
 
 #ifndef G_OS_WIN32
+# include <errno.h>
 # include <sys/time.h>
 # include <sys/types.h>
 # include <sys/socket.h>
@@ -97,9 +106,40 @@
 #define INVALID_SOCKET		(-1)
 #endif
 #define BUFFER_LENGTH 4096
+/* time in seconds spent opening files sent by other instances before handling other events */
+#define OPEN_TIME_SLICE 0.02
+
+
+/* A connection from another instance, see socket_lock_input_cb() */
+typedef struct SocketClient
+{
+	gint		 fd;
+	GIOChannel	*ioc;
+	guint		 in_watch_id;	/* 0 once the client has closed its end */
+	guint		 out_watch_id;	/* only while there is output to send */
+	GString		*input;			/* data received but not handled yet */
+	GString		*output;		/* replies not sent yet */
+	gchar		*command;		/* command whose data is being received, or NULL */
+	GPtrArray	*files;			/* files of the open command */
+	guint		 next_file;		/* index of the next file to open */
+	gboolean	 opening;		/* whether the files are being opened */
+	gboolean	 dead;			/* sending failed, the client is freed once opening is done */
+	gboolean	 readonly;
+	gint		 line;
+	gint		 column;
+	GString		*report;		/* results of the last open command, see "opened" */
+}
+SocketClient;
+
 
 struct socket_info_struct socket_info;
 
+static GList *clients = NULL;
+/* clients whose files are being opened, in order */
+static GQueue open_queue = G_QUEUE_INIT;
+static guint open_idle_id = 0;
+static GtkWidget *main_window = NULL;
+
 
 #ifdef G_OS_WIN32
 static gint socket_fd_connect_inet	(gushort port);
@@ -112,11 +152,10 @@ static gint socket_fd_open_unix		(const gchar *path);
 
 static gint socket_fd_write			(gint sock, const gchar *buf, gint len);
 static gint socket_fd_write_all		(gint sock, const gchar *buf, gint len);
-static gint socket_fd_gets			(gint sock, gchar *buf, gint len);
 static gint socket_fd_check_io		(gint fd, GIOCondition cond);
 static gint socket_fd_read			(gint sock, gchar *buf, gint len);
-static gint socket_fd_recv			(gint fd, gchar *buf, gint len, gint flags);
 static gint socket_fd_close			(gint sock);
+static void client_free				(SocketClient *client);
 
 
 
@@ -334,6 +373,14 @@ gint socket_finalize(void)
 	if (socket_info.lock_socket < 0)
 		return -1;
 
+	while (clients != NULL)
+		client_free(clients->data);
+	if (open_idle_id != 0)
+	{
+		g_source_remove(open_idle_id);
+		open_idle_id = 0;
+	}
+
 	if (socket_info.lock_socket_tag > 0)
 		g_source_remove(socket_info.lock_socket_tag);
 	if (socket_info.read_ioc)
@@ -439,7 +486,7 @@ static gint socket_fd_open_unix(const gchar *path)
 		return -1;
 	}
 
-	if (listen(sock, 1) < 0)
+	if (listen(sock, SOMAXCONN) < 0)
 	{
 		perror("listen");
 		socket_fd_close(sock);
@@ -498,7 +545,7 @@ static gint socket_fd_open_inet(gushort port)
 		return -1;
 	}
 
-	if (listen(sock, 1) < 0)
+	if (listen(sock, SOMAXCONN) < 0)
 	{
 		perror("listen");
 		socket_fd_close(sock);
@@ -548,10 +595,37 @@ static void socket_init_win32(void)
 #endif
 
 
-static void handle_input_filename(const gchar *buf)
+static gboolean socket_fd_set_nonblocking(gint fd)
+{
+#ifdef G_OS_WIN32
+	u_long mode = 1;
+
+	return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+	gint flags = fcntl(fd, F_GETFL, 0);
+
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+
+/* whether the last recv() or send() failed only because it would have blocked */
+static gboolean socket_would_block(void)
+{
+#ifdef G_OS_WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+
+static void handle_input_filename(const gchar *buf, GeanyDocument **doc)
 {
 	gchar *utf8_filename, *locale_filename;
 
+	*doc = NULL;
+
 	/* we never know how the input is encoded, so do the best auto detection we can */
 	if (! g_utf8_validate(buf, -1, NULL))
 		utf8_filename = encodings_convert_to_utf8(buf, -1, NULL);
@@ -567,7 +641,7 @@ static void handle_input_filename(const gchar *buf)
 				main_load_project_from_command_line(locale_filename, TRUE);
 		}
 		else
-			main_handle_filename(locale_filename);
+			main_handle_filename(locale_filename, doc);
 	}
 	g_free(utf8_filename);
 	g_free(locale_filename);
@@ -590,137 +664,329 @@ static gchar *build_document_list(void)
 }
 
 
-gboolean socket_lock_input_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+static void present_main_window(void)
 {
-	gint fd, sock;
-	gchar buf[BUFFER_LENGTH];
-	struct sockaddr_in caddr;
-	socklen_t caddr_len = sizeof(caddr);
-	GtkWidget *window = data;
-	gboolean popup = FALSE;
+#ifdef GDK_WINDOWING_X11
+	GdkWindow *x11_window = gtk_widget_get_window(main_window);
 
-	fd = g_io_channel_unix_get_fd(source);
-	sock = accept(fd, (struct sockaddr *)&caddr, &caddr_len);
+	/* Set the proper interaction time on the window. This seems necessary to make
+	 * gtk_window_present() really bring the main window into the foreground on some
+	 * window managers like Gnome's metacity.
+	 * Code taken from Gedit. */
+#	if GTK_CHECK_VERSION(3, 0, 0)
+	if (GDK_IS_X11_WINDOW(x11_window))
+#	endif
+	{
+		gdk_x11_window_set_user_time(x11_window, gdk_x11_get_server_time(x11_window));
+	}
+#endif
+	gtk_window_present(GTK_WINDOW(main_window));
+#ifdef G_OS_WIN32
+	gdk_window_show(gtk_widget_get_window(main_window));
+#endif
+}
+
+
+static void client_clear_files(SocketClient *client)
+{
+	guint i;
+
+	for (i = 0; i < client->files->len; i++)
+		g_free(g_ptr_array_index(client->files, i));
+	g_ptr_array_set_size(client->files, 0);
+}
+
+
+static void client_free(SocketClient *client)
+{
+	if (client->in_watch_id != 0)
+		g_source_remove(client->in_watch_id);
+	if (client->out_watch_id != 0)
+		g_source_remove(client->out_watch_id);
+	g_queue_remove(&open_queue, client);
+	clients = g_list_remove(clients, client);
+
+	g_io_channel_unref(client->ioc);
+	socket_fd_close(client->fd);
+	g_string_free(client->input, TRUE);
+	g_string_free(client->output, TRUE);
+	g_string_free(client->report, TRUE);
+	client_clear_files(client);
+	g_ptr_array_free(client->files, TRUE);
+	g_free(client->command);
+	g_free(client);
+}
+
+
+/* Closes the connection once the client has closed its end and everything is done, or it
+ * has gone away. A client whose files are being opened is still used by open_files_idle(). */
+static void client_check_done(SocketClient *client)
+{
+	if (! client->opening &&
+		(client->dead || (client->in_watch_id == 0 && client->output->len == 0)))
+		client_free(client);
+}
+
+
+static gboolean on_client_output(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	SocketClient *client = data;
+	gint n = send(client->fd, client->output->str, client->output->len, 0);
+
+	if (n < 0 && socket_would_block())
+		return TRUE;
+
+	if (n <= 0)
+	{	/* the client has gone away, stop reading from it */
+		client->out_watch_id = 0;
+		client->dead = TRUE;
+		if (client->in_watch_id != 0)
+		{
+			g_source_remove(client->in_watch_id);
+			client->in_watch_id = 0;
+		}
+		g_string_truncate(client->output, 0);
+		client_check_done(client);
+		return FALSE;
+	}
+	g_string_erase(client->output, 0, n);
+	if (client->output->len > 0)
+		return TRUE;
+
+	client->out_watch_id = 0;
+	client_check_done(client);
+	return FALSE;
+}
+
+
+/* Queues data to be sent as the client reads it, so a slow client doesn't block */
+static void client_send(SocketClient *client, const gchar *buf, gsize len)
+{
+	if (client->dead)
+		return;
+	g_string_append_len(client->output, buf, len);
+	if (client->out_watch_id == 0)
+		client->out_watch_id = g_io_add_watch(client->ioc, G_IO_OUT | G_IO_ERR | G_IO_HUP,
+			on_client_output, client);
+}
+
+
+static void client_open_file(SocketClient *client, const gchar *filename)
+{
+	gboolean readonly = cl_options.readonly;
+	GeanyDocument *doc;
+
+	cl_options.readonly = client->readonly;
+	/* like on the command line, the line and column apply to the first file */
+	if (client->line >= 0)
+	{
+		cl_options.goto_line = client->line;
+		client->line = -1;
+	}
+	if (client->column >= 0)
+	{
+		cl_options.goto_column = client->column;
+		client->column = -1;
+	}
+	handle_input_filename(filename, &doc);
+	cl_options.readonly = readonly;
+
+	g_string_append_printf(client->report, "%d %s\n", (doc != NULL) ? (gint) doc->index : -1,
+		filename);
+}
+
+
+static void client_handle_input(SocketClient *client);
+
+static void client_files_opened(SocketClient *client)
+{
+	client->opening = FALSE;
+	client_clear_files(client);
+	present_main_window();
 
-	/* first get the command */
-	while (socket_fd_gets(sock, buf, sizeof(buf)) != -1)
+	/* handle the commands which were received meanwhile */
+	client_handle_input(client);
+	client_check_done(client);
+}
+
+
+/* Opens the files sent by the clients in order, a few at a time so that the user interface
+ * keeps responding. The tags of the opened files are parsed afterwards. */
+static gboolean open_files_idle(gpointer data)
+{
+	GTimer *timer = g_timer_new();
+	SocketClient *client;
+
+	document_defer_tag_updates(TRUE);
+	while ((client = g_queue_peek_head(&open_queue)) != NULL &&
+		g_timer_elapsed(timer, NULL) < OPEN_TIME_SLICE)
 	{
-		if (strncmp(buf, "open", 4) == 0)
+		/* the remaining files of a client which has gone away are skipped */
+		if (client->next_file < client->files->len && ! client->dead)
+			client_open_file(client, g_ptr_array_index(client->files, client->next_file++));
+		else
 		{
-			cl_options.readonly = strncmp(buf+4, "ro", 2) == 0; /* open in readonly? */
-			while (socket_fd_gets(sock, buf, sizeof(buf)) != -1 && *buf != '.')
-			{
-				gsize buf_len = strlen(buf);
-
-				/* remove trailing newline */
-				if (buf_len > 0 && buf[buf_len - 1] == '\n')
-					buf[buf_len - 1] = '\0';
-
-				handle_input_filename(buf);
-			}
-			popup = TRUE;
+			g_queue_pop_head(&open_queue);
+			client_files_opened(client);
 		}
-		else if (strncmp(buf, "doclist", 7) == 0)
+	}
+	document_defer_tag_updates(FALSE);
+	g_timer_destroy(timer);
+
+	if (client != NULL)
+		return TRUE;
+	open_idle_id = 0;
+	return FALSE;
+}
+
+
+static void client_open_files(SocketClient *client)
+{
+	client->opening = TRUE;
+	client->next_file = 0;
+	g_string_truncate(client->report, 0);
+
+	g_queue_push_tail(&open_queue, client);
+	if (open_idle_id == 0)
+		open_idle_id = g_idle_add(open_files_idle, NULL);
+}
+
+
+static void client_handle_line(SocketClient *client, const gchar *line)
+{
+	if (client->command == NULL)
+	{
+		/* check "opened" first, the open command also allows a suffix */
+		if (utils_str_equal(line, "opened"))
+		{
+			client_send(client, client->report->str, client->report->len);
+			client_send(client, ".\n", 2);
+		}
+		else if (strncmp(line, "open", 4) == 0)
+		{
+			client->readonly = strncmp(line + 4, "ro", 2) == 0; /* open in readonly? */
+			client->command = g_strdup("open");
+		}
+		else if (strncmp(line, "line", 4) == 0)
+			client->command = g_strdup("line");
+		else if (strncmp(line, "column", 6) == 0)
+			client->command = g_strdup("column");
+		else if (strncmp(line, "doclist", 7) == 0)
 		{
 			gchar *doc_list = build_document_list();
+
 			if (!EMPTY(doc_list))
-				socket_fd_write_all(sock, doc_list, strlen(doc_list));
+				client_send(client, doc_list, strlen(doc_list));
 			else
 				/* send ETX (end-of-text) in case we have no open files, we must send anything
 				 * otherwise the client would hang on reading */
-				socket_fd_write_all(sock, "\3", 1);
+				client_send(client, "\3", 1);
 			g_free(doc_list);
 		}
-		else if (strncmp(buf, "line", 4) == 0)
-		{
-			while (socket_fd_gets(sock, buf, sizeof(buf)) != -1 && *buf != '.')
-			{
-				g_strstrip(buf); /* remove \n char */
-				/* on any error we get 0 which should be safe enough as fallback */
-				cl_options.goto_line = atoi(buf);
-			}
-		}
-		else if (strncmp(buf, "column", 6) == 0)
-		{
-			while (socket_fd_gets(sock, buf, sizeof(buf)) != -1 && *buf != '.')
-			{
-				g_strstrip(buf); /* remove \n char */
-				/* on any error we get 0 which should be safe enough as fallback */
-				cl_options.goto_column = atoi(buf);
-			}
-		}
 #ifdef G_OS_WIN32
-		else if (strncmp(buf, "window", 6) == 0)
+		else if (strncmp(line, "window", 6) == 0)
 		{
 #	if GTK_CHECK_VERSION(3, 0, 0)
-			HWND hwnd = (HWND) gdk_win32_window_get_handle(gtk_widget_get_window(window));
+			HWND hwnd = (HWND) gdk_win32_window_get_handle(gtk_widget_get_window(main_window));
 #	else
 			HWND hwnd = (HWND) gdk_win32_drawable_get_handle(
-				GDK_DRAWABLE(gtk_widget_get_window(window)));
+				GDK_DRAWABLE(gtk_widget_get_window(main_window)));
 #	endif
-			socket_fd_write(sock, (gchar *)&hwnd, sizeof(hwnd));
+			client_send(client, (gchar *)&hwnd, sizeof(hwnd));
 		}
 #endif
 	}
-
-	if (popup)
+	else if (utils_str_equal(line, "."))
 	{
-#ifdef GDK_WINDOWING_X11
-		GdkWindow *x11_window = gtk_widget_get_window(window);
-
-		/* Set the proper interaction time on the window. This seems necessary to make
-		 * gtk_window_present() really bring the main window into the foreground on some
-		 * window managers like Gnome's metacity.
-		 * Code taken from Gedit. */
-#	if GTK_CHECK_VERSION(3, 0, 0)
-		if (GDK_IS_X11_WINDOW(x11_window))
-#	endif
-		{
-			gdk_x11_window_set_user_time(x11_window, gdk_x11_get_server_time(x11_window));
-		}
-#endif
-		gtk_window_present(GTK_WINDOW(window));
-#ifdef G_OS_WIN32
-		gdk_window_show(gtk_widget_get_window(window));
-#endif
+		if (utils_str_equal(client->command, "open"))
+			client_open_files(client);
+		SETPTR(client->command, NULL);
 	}
+	else if (utils_str_equal(client->command, "open"))
+		g_ptr_array_add(client->files, g_strdup(line));
+	/* on any error we get 0 which should be safe enough as fallback */
+	else if (utils_str_equal(client->command, "line"))
+		client->line = atoi(line);
+	else if (utils_str_equal(client->command, "column"))
+		client->column = atoi(line);
+}
 
-	socket_fd_close(sock);
 
-	return TRUE;
+/* Handles the complete lines received, until an open command has to wait for its files */
+static void client_handle_input(SocketClient *client)
+{
+	gchar *newline;
+	gsize pos = 0;
+
+	while (! client->opening &&
+		(newline = memchr(client->input->str + pos, '\n', client->input->len - pos)) != NULL)
+	{
+		gchar *line = client->input->str + pos;
+
+		*newline = '\0';
+		pos = newline - client->input->str + 1;
+		client_handle_line(client, line);
+	}
+	g_string_erase(client->input, 0, pos);
 }
 
 
-static gint socket_fd_gets(gint fd, gchar *buf, gint len)
+static gboolean on_client_input(GIOChannel *source, GIOCondition condition, gpointer data)
 {
-	gchar *newline, *bp = buf;
+	SocketClient *client = data;
+	gchar buf[BUFFER_LENGTH];
 	gint n;
 
-	if (--len < 1)
-		return -1;
-	do
-	{
-		if ((n = socket_fd_recv(fd, bp, len, MSG_PEEK)) <= 0)
-			return -1;
-		if ((newline = memchr(bp, '\n', n)) != NULL)
-			n = newline - bp + 1;
-		if ((n = socket_fd_read(fd, bp, n)) < 0)
-			return -1;
-		bp += n;
-		len -= n;
-	} while (! newline && len);
+	while ((n = recv(client->fd, buf, sizeof(buf), 0)) > 0)
+		g_string_append_len(client->input, buf, n);
 
-	*bp = '\0';
-	return bp - buf;
+	if (n < 0 && socket_would_block())
+	{
+		client_handle_input(client);
+		return TRUE;
+	}
+	/* the client has closed its end */
+	client->in_watch_id = 0;
+	client_handle_input(client);
+	client_check_done(client);
+	return FALSE;
 }
 
 
-static gint socket_fd_recv(gint fd, gchar *buf, gint len, gint flags)
+/* Accepts a connection from another instance. The commands are read and answered as the
+ * client sends and reads them, so that a slow client doesn't block the main loop. */
+gboolean socket_lock_input_cb(GIOChannel *source, GIOCondition condition, gpointer data)
 {
-	if (socket_fd_check_io(fd, G_IO_IN) < 0)
-		return -1;
+	gint fd, sock;
+	struct sockaddr_in caddr;
+	socklen_t caddr_len = sizeof(caddr);
+	SocketClient *client;
 
-	return recv(fd, buf, len, flags);
+	main_window = data;
+	fd = g_io_channel_unix_get_fd(source);
+	sock = accept(fd, (struct sockaddr *)&caddr, &caddr_len);
+	if (! SOCKET_IS_VALID(sock))
+		return TRUE;
+	if (! socket_fd_set_nonblocking(sock))
+	{
+		socket_fd_close(sock);
+		return TRUE;
+	}
+
+	client = g_new0(SocketClient, 1);
+	client->fd = sock;
+	client->ioc = g_io_channel_unix_new(sock);
+	client->input = g_string_new(NULL);
+	client->output = g_string_new(NULL);
+	client->report = g_string_new(NULL);
+	client->files = g_ptr_array_new();
+	client->line = -1;
+	client->column = -1;
+	client->in_watch_id = g_io_add_watch(client->ioc, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP,
+		on_client_input, client);
+	clients = g_list_prepend(clients, client);
+
+	return TRUE;
 }
 
 
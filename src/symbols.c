@@ -56,6 +56,7 @@
 #include "sciwrappers.h"
 #include "filetypesprivate.h"
 #include "search.h"
+#include "trace.h"
 
 
 const guint TM_GLOBAL_TYPE_MASK =
@@ -215,7 +216,9 @@ void symbols_global_tags_loaded(guint file_type_idx)
 	{
 		gchar *fname = g_build_filename(app->datadir, tfi->tag_file, NULL);
 
+		trace_startup_begin("global tags %s", tfi->tag_file);
 		symbols_load_global_tags(fname, filetypes[file_type_idx]);
+		trace_startup_end();
 		tfi->tags_loaded = TRUE;
 		g_free(fname);
 	}
@@ -414,6 +417,7 @@ static TMTag *find_workspace_tag(const gchar *tag_name, guint type)
 {
 	guint j;
 	const GPtrArray *work_objects = NULL;
+	const GPtrArray *tags;
 
 	if (app->tm_workspace != NULL)
 		work_objects = app->tm_workspace->work_objects;
@@ -430,6 +434,11 @@ static TMTag *find_workspace_tag(const gchar *tag_name, guint type)
 				return tmtag;
 		}
 	}
+
+	/* project files which aren't open, see projectindex.c */
+	tags = tm_workspace_find_scoped(tag_name, NULL, type, NULL, FALSE, -1, FALSE);
+	if (tags != NULL && tags->len > 0)
+		return TM_TAG(tags->pdata[0]);
 	return NULL;	/* not found */
 }
 
@@ -0,0 +1,229 @@
+/*
+ *      tagcache.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * On-disk cache of the tags of saved documents, so that reopening a file whose
+ * contents haven't changed (e.g. when restoring the session) doesn't parse it again.
+ * Each entry is a file in the tagcache directory of the configuration directory,
+ * named after a checksum of the file name, language and contents; entries are
+ * evicted by age and total size on exit.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "geany.h"
+
+/* gstdio.h also includes sys/stat.h */
+#include <glib/gstdio.h>
+
+#include "tagcache.h"
+#include "utils.h"
+
+
+/* change this when the format of the entries or the key changes */
+#define TAGCACHE_VERSION "2"
+
+
+typedef struct CacheEntry
+{
+	gchar	*path;
+	time_t	 mtime;
+	gint64	 size;
+}
+CacheEntry;
+
+
+TagCachePrefs tagcache_prefs;
+
+static gchar *cache_dir = NULL;
+
+extern gchar **c_tags_ignore;
+
+
+static const gchar *get_cache_dir(void)
+{
+	if (cache_dir == NULL)
+		cache_dir = g_build_filename(app->configdir, "tagcache", NULL);
+	return cache_dir;
+}
+
+
+/* Returns a key for the tags of buf, which is newly allocated and can also be used
+ * to check whether the buffer changed since the last call. The Geany version is part
+ * of the key so that parser changes don't leave outdated entries in use, and so is the
+ * ignore.tags list because it changes the tags of C-like files. */
+gchar *tagcache_get_key(const gchar *locale_filename, gint lang, const guchar *buf, gsize len)
+{
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+	const gchar *lang_name = tm_source_file_get_lang_name(lang);
+	gchar *key;
+	gchar **token;
+
+	g_checksum_update(checksum, (const guchar *) TAGCACHE_VERSION VERSION, -1);
+	foreach_strv(token, c_tags_ignore)
+		g_checksum_update(checksum, (const guchar *) *token, strlen(*token) + 1);
+	g_checksum_update(checksum, (const guchar *) locale_filename, strlen(locale_filename) + 1);
+	if (lang_name != NULL)
+		g_checksum_update(checksum, (const guchar *) lang_name, strlen(lang_name) + 1);
+	g_checksum_update(checksum, buf, len);
+	key = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	return key;
+}
+
+
+/* Replaces the tags of source_file with the cached ones for key.
+ * Returns FALSE if there are none, source_file should be parsed then. */
+gboolean tagcache_load(TMWorkObject *source_file, const gchar *key)
+{
+	gchar *path;
+	FILE *fp;
+	gboolean ret = FALSE;
+
+	if (tagcache_prefs.max_size <= 0)
+		return FALSE;
+
+	path = g_build_filename(get_cache_dir(), key, NULL);
+	fp = g_fopen(path, "r");
+	if (fp != NULL)
+	{
+		ret = tm_source_file_read_tags(source_file, fp, TRUE);
+		fclose(fp);
+		if (ret)
+			/* mark the entry as recently used so it is evicted last */
+			g_utime(path, NULL);
+		else
+		{
+			geany_debug("Removing invalid tag cache entry %s", path);
+			g_unlink(path);
+		}
+	}
+	g_free(path);
+	return ret;
+}
+
+
+/* Stores the tags of source_file, which must have been parsed from the buffer key
+ * was computed for, unless they are already cached. */
+void tagcache_save(TMWorkObject *source_file, const gchar *key)
+{
+	const gchar *dir = get_cache_dir();
+	gchar *path, *tmp_path;
+	FILE *fp;
+
+	if (tagcache_prefs.max_size <= 0 || source_file->tags_array == NULL)
+		return;
+	if (! g_file_test(dir, G_FILE_TEST_IS_DIR) && utils_mkdir(dir, TRUE) != 0)
+		return;
+
+	path = g_build_filename(dir, key, NULL);
+	if (g_file_test(path, G_FILE_TEST_EXISTS))
+	{
+		g_free(path);
+		return;
+	}
+	/* write to a temporary file first so that an entry is always complete */
+	tmp_path = g_strconcat(path, ".tmp", NULL);
+	fp = g_fopen(tmp_path, "w");
+	if (fp != NULL)
+	{
+		gboolean ok = tm_tags_write_full(source_file->tags_array, fp);
+
+		if (fclose(fp) != 0)
+			ok = FALSE;
+		if (! ok || g_rename(tmp_path, path) != 0)
+			g_unlink(tmp_path);
+	}
+	g_free(tmp_path);
+	g_free(path);
+}
+
+
+static gint compare_entries_newest_first(gconstpointer a, gconstpointer b)
+{
+	const CacheEntry *entry_a = a;
+	const CacheEntry *entry_b = b;
+
+	if (entry_a->mtime == entry_b->mtime)
+		return 0;
+	return (entry_a->mtime > entry_b->mtime) ? -1 : 1;
+}
+
+
+/* Removes the entries older than tagcache_prefs.max_age and then the least recently used
+ * ones until the cache fits into tagcache_prefs.max_size. */
+static void evict_entries(void)
+{
+	GDir *dir = g_dir_open(get_cache_dir(), 0, NULL);
+	GArray *entries;
+	const gchar *name;
+	time_t now = time(NULL);
+	gint64 max_size = (gint64) tagcache_prefs.max_size * 1024 * 1024;
+	gint64 total_size = 0;
+	guint i;
+
+	if (dir == NULL)
+		return;
+
+	entries = g_array_new(FALSE, FALSE, sizeof(CacheEntry));
+	while ((name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *path = g_build_filename(get_cache_dir(), name, NULL);
+		struct stat st;
+
+		if (g_stat(path, &st) != 0 || ! S_ISREG(st.st_mode))
+			g_free(path);
+		else if (max_size <= 0 || g_str_has_suffix(name, ".tmp") ||
+			now - st.st_mtime > (time_t) tagcache_prefs.max_age * 24 * 60 * 60)
+		{
+			g_unlink(path);
+			g_free(path);
+		}
+		else
+		{
+			CacheEntry entry = { path, st.st_mtime, st.st_size };
+
+			g_array_append_val(entries, entry);
+		}
+	}
+	g_dir_close(dir);
+
+	g_array_sort(entries, compare_entries_newest_first);
+	for (i = 0; i < entries->len; i++)
+	{
+		CacheEntry *entry = &g_array_index(entries, CacheEntry, i);
+
+		total_size += entry->size;
+		if (total_size > max_size)
+			g_unlink(entry->path);
+		g_free(entry->path);
+	}
+	g_array_free(entries, TRUE);
+}
+
+
+void tagcache_finalize(void)
+{
+	evict_entries();
+
+	g_free(cache_dir);
+	cache_dir = NULL;
+}
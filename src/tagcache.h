@@ -0,0 +1,45 @@
+/*
+ *      tagcache.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef GEANY_TAGCACHE_H
+#define GEANY_TAGCACHE_H 1
+
+
+typedef struct TagCachePrefs
+{
+	gint	max_size;	/* in MiB, 0 disables the cache */
+	gint	max_age;	/* in days */
+}
+TagCachePrefs;
+
+extern TagCachePrefs tagcache_prefs;
+
+
+gchar *tagcache_get_key(const gchar *locale_filename, gint lang, const guchar *buf, gsize len);
+
+gboolean tagcache_load(TMWorkObject *source_file, const gchar *key);
+
+void tagcache_save(TMWorkObject *source_file, const gchar *key);
+
+void tagcache_finalize(void);
+
+
+#endif
@@ -35,11 +35,14 @@
 # include <sys/types.h>
 # include <sys/wait.h>
 # include <signal.h>
+#else
+# include <windows.h>
 #endif
 
 #include "tools.h"
 #include "support.h"
 #include "document.h"
+#include "documentprivate.h"
 #include "editor.h"
 #include "sciwrappers.h"
 #include "utils.h"
@@ -61,6 +64,11 @@ enum
 	CC_COLUMN_COUNT
 };
 
+/* size of the parts of the selection written to a custom command, and of the output read */
+#define CC_CHUNK_SIZE 16384
+/* delay in milliseconds before a dialog to cancel a running custom command is shown */
+#define CC_PROGRESS_DELAY 1000
+
 /* custom commands code*/
 struct cc_dialog
 {
@@ -78,11 +86,24 @@ struct cc_dialog
 /* data required by the custom command callbacks */
 struct cc_data
 {
-	const gchar *command;	/* command launched */
-	GeanyDocument *doc;		/* document in which replace the selection */
-	GString *buffer;		/* buffer holding stdout content, or NULL */
+	gchar *command;			/* command launched */
+	GeanyDocument *doc;		/* document in which replace the selection, NULL once it is closed */
+	ScintillaObject *sci;	/* editor widget of doc */
+	gint sel_start;			/* the selection to replace */
+	gint sel_end;
+	gchar *input;			/* selection written to stdin */
+	gsize input_len;
+	gsize input_pos;
+	GString *buffer;		/* buffer holding stdout content */
+	GString *errors;		/* buffer holding stderr content */
+	GPid pid;
+	gint open_channels;		/* number of the stdin, stdout and stderr pipes still open */
+	gboolean exited;		/* whether the command has exited */
 	gboolean error;			/* whether and error occurred */
-	gboolean finished;		/* whether the command has finished */
+	gboolean cancelled;		/* whether the command was cancelled */
+	guint dialog_id;		/* timeout to show the progress dialog */
+	GtkWidget *dialog;		/* progress dialog, or NULL */
+	GtkWidget *progress;
 };
 
 
@@ -206,147 +227,267 @@ static void cc_on_dialog_move_down_clicked(GtkButton *button, struct cc_dialog *
 }
 
 
-static gboolean cc_iofunc(GIOChannel *ioc, GIOCondition cond, gpointer user_data)
+static void word_count_wait(ScintillaObject *sci);
+
+static void cc_finish(struct cc_data *data)
 {
-	struct cc_data *data = user_data;
+	if (data->dialog_id != 0)
+		g_source_remove(data->dialog_id);
+	if (data->dialog != NULL)
+		gtk_widget_destroy(data->dialog);
 
-	if (cond & (G_IO_IN | G_IO_PRI))
+	if (data->doc != NULL)
 	{
-		gchar *msg = NULL;
-		GIOStatus rv;
-		GError *err = NULL;
+		ScintillaObject *sci = data->sci;
+
+		g_signal_handlers_disconnect_matched(sci, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
+		g_object_set_data(G_OBJECT(sci), "custom-command", NULL);
+		/* a save or word count started before the command may still read the text */
+		document_wait_for_save(data->doc);
+		word_count_wait(sci);
+		document_release_buffer(data->doc);
+
+		if (data->cancelled)
+			ui_set_statusbar(FALSE, _("The custom command was cancelled."));
+		else if (data->errors->len > 0)
+		{
+			g_warning("%s: %s\n", data->command, data->errors->str);
+			ui_set_statusbar(TRUE,
+				_("The executed custom command returned an error. "
+				"Your selection was not changed. Error message: %s"),
+				data->errors->str);
+		}
+		else if (data->error)
+		{	/* TODO maybe include the exit code in the error message */
+			ui_set_statusbar(TRUE,
+				_("The executed custom command exited with an unsuccessful exit code."));
+		}
+		else
+		{	/* Command completed successfully, replace the selection it was started with */
+			sci_start_undo_action(sci);
+			sci_set_selection(sci, data->sel_start, data->sel_end);
+			sci_replace_sel(sci, data->buffer->str);
+			sci_end_undo_action(sci);
+		}
+	}
 
-		if (! data->buffer)
-			data->buffer = g_string_sized_new(256);
+	g_string_free(data->buffer, TRUE);
+	g_string_free(data->errors, TRUE);
+	g_free(data->input);
+	g_free(data->command);
+	g_slice_free1(sizeof *data, data);
+}
 
-		do
-		{
-			rv = g_io_channel_read_line(ioc, &msg, NULL, NULL, &err);
-			if (msg != NULL)
-			{
-				g_string_append(data->buffer, msg);
-				g_free(msg);
-			}
-			if (G_UNLIKELY(err != NULL))
-			{
-				geany_debug("%s: %s", G_STRFUNC, err->message);
-				g_error_free(err);
-				err = NULL;
-			}
-		} while (rv == G_IO_STATUS_NORMAL || rv == G_IO_STATUS_AGAIN);
 
-		if (G_UNLIKELY(rv != G_IO_STATUS_EOF))
-		{	/* Something went wrong? */
-			g_warning("%s: %s\n", G_STRFUNC, "Incomplete command output");
-		}
+/* The selection is only replaced once the command has exited and all its output is read */
+static void cc_check_finished(struct cc_data *data)
+{
+	if (data->exited && data->open_channels == 0)
+		cc_finish(data);
+}
+
+
+static void cc_channel_closed(struct cc_data *data)
+{
+	data->open_channels--;
+	cc_check_finished(data);
+}
+
+
+static void cc_cancel(struct cc_data *data)
+{
+	if (data->cancelled || data->exited)
+		return;
+
+	data->cancelled = TRUE;
+#ifdef G_OS_WIN32
+	TerminateProcess(data->pid, 0);
+#else
+	kill(data->pid, SIGTERM);
+#endif
+}
+
+
+static void cc_update_progress(struct cc_data *data)
+{
+	if (data->progress == NULL)
+		return;
+
+	if (data->input_pos < data->input_len)
+	{
+		gdouble fraction = (gdouble) data->input_pos / data->input_len;
+		gchar *text = g_strdup_printf(_("Sent %d%% of the selection"), (gint) (fraction * 100));
+
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(data->progress), fraction);
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(data->progress), text);
+		g_free(text);
 	}
+	else
+	{
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(data->progress), _("Waiting for the output"));
+		gtk_progress_bar_pulse(GTK_PROGRESS_BAR(data->progress));
+	}
+}
+
+
+static void cc_on_progress_response(GtkDialog *dialog, gint response, gpointer user_data)
+{
+	cc_cancel(user_data);
+}
+
+
+static gboolean cc_show_progress_dialog(gpointer user_data)
+{
+	struct cc_data *data = user_data;
+	GtkWidget *vbox, *label;
+	gchar *text;
+
+	data->dialog_id = 0;
+	data->dialog = gtk_dialog_new_with_buttons(_("Custom Commands"),
+		GTK_WINDOW(main_widgets.window), GTK_DIALOG_DESTROY_WITH_PARENT,
+		GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL, NULL);
+	vbox = ui_dialog_vbox_new(GTK_DIALOG(data->dialog));
+
+	text = g_strdup_printf(_("Executing custom command: %s"), data->command);
+	label = gtk_label_new(text);
+	g_free(text);
+	gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
+	gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 0);
+
+	data->progress = gtk_progress_bar_new();
+	gtk_box_pack_start(GTK_BOX(vbox), data->progress, FALSE, FALSE, 0);
+	cc_update_progress(data);
+
+	g_signal_connect(data->dialog, "response", G_CALLBACK(cc_on_progress_response), data);
+	/* the dialog is destroyed when the command has finished */
+	g_signal_connect(data->dialog, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+	gtk_widget_show_all(data->dialog);
 	return FALSE;
 }
 
 
-static gboolean cc_iofunc_err(GIOChannel *ioc, GIOCondition cond, gpointer user_data)
+/* the document was closed, its selection can't be replaced anymore */
+static void cc_on_editor_destroy(GtkWidget *widget, gpointer user_data)
+{
+	struct cc_data *data = user_data;
+
+	data->doc = NULL;
+	cc_cancel(data);
+}
+
+
+/* Writes the next part of the selection to the command, without blocking so that the
+ * output can be read meanwhile: a command can't take more input while its output isn't read. */
+static gboolean cc_write_func(GIOChannel *ioc, GIOCondition cond, gpointer user_data)
 {
 	struct cc_data *data = user_data;
 
-	if (cond & (G_IO_IN | G_IO_PRI))
+	if (! data->cancelled && (cond & G_IO_OUT))
 	{
-		gchar *msg = NULL;
-		GString *str = g_string_sized_new(256);
+		gsize wrote = 0;
 		GIOStatus rv;
+		GError *err = NULL;
 
-		do
+		rv = g_io_channel_write_chars(ioc, data->input + data->input_pos,
+			MIN(data->input_len - data->input_pos, CC_CHUNK_SIZE), &wrote, &err);
+		data->input_pos += wrote;
+		if (G_UNLIKELY(rv == G_IO_STATUS_ERROR))
 		{
-			rv = g_io_channel_read_line(ioc, &msg, NULL, NULL, NULL);
-			if (msg != NULL)
-			{
-				g_string_append(str, msg);
-				g_free(msg);
-			}
-		} while (rv == G_IO_STATUS_NORMAL || rv == G_IO_STATUS_AGAIN);
-
-		if (!EMPTY(str->str))
+			g_warning("%s: %s: %s\n", G_STRFUNC, "Failed sending data to command", err->message);
+			g_error_free(err);
+		}
+		else if (data->input_pos < data->input_len)
 		{
-			g_warning("%s: %s\n", data->command, str->str);
-			ui_set_statusbar(TRUE,
-				_("The executed custom command returned an error. "
-				"Your selection was not changed. Error message: %s"),
-				str->str);
-			data->error = TRUE;
-
+			cc_update_progress(data);
+			return TRUE;
 		}
-		g_string_free(str, TRUE);
 	}
-	data->finished = TRUE;
+	/* closing stdin tells the command that the input is complete */
+	cc_channel_closed(data);
 	return FALSE;
 }
 
 
-static gboolean cc_replace_sel_cb(gpointer user_data)
+/* Appends what can be read from ioc without blocking to buffer.
+ * Returns FALSE at the end of the output. */
+static gboolean cc_read_channel(GIOChannel *ioc, GString *buffer)
+{
+	gchar chunk[CC_CHUNK_SIZE];
+	gsize len;
+	GIOStatus rv;
+
+	do
+	{
+		len = 0;
+		rv = g_io_channel_read_chars(ioc, chunk, sizeof chunk, &len, NULL);
+		g_string_append_len(buffer, chunk, len);
+	}
+	while (rv == G_IO_STATUS_NORMAL);
+
+	return rv == G_IO_STATUS_AGAIN;
+}
+
+
+static gboolean cc_iofunc(GIOChannel *ioc, GIOCondition cond, gpointer user_data)
 {
 	struct cc_data *data = user_data;
 
-	if (! data->finished)
-	{	/* keep this function in the main loop until cc_iofunc_err() has finished */
+	if (cc_read_channel(ioc, data->buffer))
+	{
+		if (data->input_pos == data->input_len)
+			cc_update_progress(data);
 		return TRUE;
 	}
+	cc_channel_closed(data);
+	return FALSE;
+}
 
-	if (! data->error && data->buffer != NULL)
-	{	/* Command completed successfully */
-		sci_replace_sel(data->doc->editor->sci, data->buffer->str);
-	}
 
-	if (data->buffer)
-		g_string_free(data->buffer, TRUE);
-	g_slice_free1(sizeof *data, data);
+static gboolean cc_iofunc_err(GIOChannel *ioc, GIOCondition cond, gpointer user_data)
+{
+	struct cc_data *data = user_data;
 
+	if (cc_read_channel(ioc, data->errors))
+		return TRUE;
+	cc_channel_closed(data);
 	return FALSE;
 }
 
 
-/* check whether the executed command failed and if so do nothing.
- * If it returned with a sucessful exit code, replace the selection. */
+/* check whether the executed command failed, the selection is replaced by cc_finish() */
 static void cc_exit_cb(GPid child_pid, gint status, gpointer user_data)
 {
 	struct cc_data *data = user_data;
 
-	/* if there was already an error, skip further checks */
-	if (! data->error)
-	{
 #ifdef G_OS_UNIX
-		if (WIFEXITED(status))
-		{
-			if (WEXITSTATUS(status) != EXIT_SUCCESS)
-				data->error = TRUE;
-		}
-		else if (WIFSIGNALED(status))
-		{	/* the terminating signal: WTERMSIG (status)); */
-			data->error = TRUE;
-		}
-		else
-		{	/* any other failure occured */
+	if (WIFEXITED(status))
+	{
+		if (WEXITSTATUS(status) != EXIT_SUCCESS)
 			data->error = TRUE;
-		}
+	}
+	else if (WIFSIGNALED(status))
+	{	/* the terminating signal: WTERMSIG (status)); */
+		data->error = TRUE;
+	}
+	else
+	{	/* any other failure occured */
+		data->error = TRUE;
+	}
 #else
-		data->error = ! win32_get_exit_status(child_pid);
+	data->error = ! win32_get_exit_status(child_pid);
 #endif
 
-		if (data->error)
-		{	/* here we are sure data->error was set due to an unsuccessful exit code
-			 * and so we add an error message */
-			/* TODO maybe include the exit code in the error message */
-			ui_set_statusbar(TRUE,
-				_("The executed custom command exited with an unsuccessful exit code."));
-		}
-	}
-
-	g_idle_add(cc_replace_sel_cb, data);
 	g_spawn_close_pid(child_pid);
+	data->exited = TRUE;
+	cc_check_finished(data);
 }
 
 
 /* Executes command (which should include all necessary command line args) and passes the current
  * selection through the standard input of command. The whole output of command replaces the
- * current selection. */
+ * selection in a single undo action when command has finished.
+ * The input is written and the output read as the pipes allow it, and the document is
+ * read-only meanwhile. A dialog to cancel the command is shown if it takes a while. */
 void tools_execute_custom_command(GeanyDocument *doc, const gchar *command)
 {
 	GError *error = NULL;
@@ -355,10 +496,18 @@ void tools_execute_custom_command(GeanyDocument *doc, const gchar *command)
 	gint stdin_fd;
 	gint stdout_fd;
 	gint stderr_fd;
+	ScintillaObject *sci;
 
 	g_return_if_fail(doc != NULL && command != NULL);
 
-	if (! sci_has_selection(doc->editor->sci))
+	sci = doc->editor->sci;
+	if (g_object_get_data(G_OBJECT(sci), "custom-command") != NULL)
+	{
+		ui_set_statusbar(TRUE, _("A custom command is already running on this document."));
+		return;
+	}
+
+	if (! sci_has_selection(sci))
 		editor_select_lines(doc->editor, FALSE);
 
 	if (!g_shell_parse_argv(command, NULL, &argv, &error))
@@ -372,43 +521,40 @@ void tools_execute_custom_command(GeanyDocument *doc, const gchar *command)
 	if (g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
 						NULL, NULL, &pid, &stdin_fd, &stdout_fd, &stderr_fd, &error))
 	{
-		gchar *sel;
-		gint remaining, wrote;
-		struct cc_data *data = g_slice_alloc(sizeof *data);
+		GIOChannel *ioc;
+		struct cc_data *data = g_slice_alloc0(sizeof *data);
 
-		data->error = FALSE;
-		data->finished = FALSE;
-		data->buffer = NULL;
+		data->command = g_strdup(command);
 		data->doc = doc;
-		data->command = command;
+		data->sci = sci;
+		data->sel_start = sci_get_selection_start(sci);
+		data->sel_end = sci_get_selection_end(sci);
+		data->input = sci_get_selection_contents(sci);
+		data->input_len = strlen(data->input);
+		data->buffer = g_string_sized_new(MAX(data->input_len, 256));
+		data->errors = g_string_new(NULL);
+		data->pid = pid;
+		data->open_channels = 3;
+
+		/* the selection must not change until it is replaced */
+		document_hold_buffer(doc);
+		g_object_set_data(G_OBJECT(sci), "custom-command", data);
+		g_signal_connect(sci, "destroy", G_CALLBACK(cc_on_editor_destroy), data);
 
 		g_child_watch_add(pid, cc_exit_cb, data);
 
 		/* use GIOChannel to monitor stdout */
 		utils_set_up_io_channel(stdout_fd, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
-				FALSE, cc_iofunc, data);
+				TRUE, cc_iofunc, data);
 		/* copy program's stderr to Geany's stdout to help error tracking */
 		utils_set_up_io_channel(stderr_fd, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
-				FALSE, cc_iofunc_err, data);
-
-		/* get selection */
-		sel = sci_get_selection_contents(doc->editor->sci);
+				TRUE, cc_iofunc_err, data);
+		/* write data to the command when it can take it */
+		ioc = utils_set_up_io_channel(stdin_fd, G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				TRUE, cc_write_func, data);
+		g_io_channel_set_buffered(ioc, FALSE);
 
-		/* write data to the command */
-		remaining = strlen(sel);
-		do
-		{
-			wrote = write(stdin_fd, sel, remaining);
-			if (G_UNLIKELY(wrote < 0))
-			{
-				g_warning("%s: %s: %s\n", G_STRFUNC, "Failed sending data to command",
-										g_strerror(errno));
-				break;
-			}
-			remaining -= wrote;
-		} while (remaining > 0);
-		close(stdin_fd);
-		g_free(sel);
+		data->dialog_id = g_timeout_add(CC_PROGRESS_DELAY, cc_show_progress_dialog, data);
 	}
 	else
 	{
@@ -789,153 +935,419 @@ void tools_create_insert_custom_command_menu_items(void)
 }
 
 
-/* (stolen from bluefish, thanks)
- * Returns number of characters, lines and words in the supplied gchar*.
- * Handles UTF-8 correctly. Input must be properly encoded UTF-8.
- * Words are defined as any characters grouped, separated with spaces. */
-static void word_count(gchar *text, guint *chars, guint *lines, guint *words)
+/* Byte classes for the word count */
+enum
+{
+	WC_WORD,			/* printable ASCII character */
+	WC_SPACE,			/* ASCII white space except line endings */
+	WC_NEWLINE,
+	WC_RETURN,
+	WC_CONTROL,			/* other ASCII control characters, they don't separate words */
+	WC_LEAD,			/* first byte of a multi-byte character */
+	WC_CONTINUATION
+};
+
+/* minimum size of the text which is counted in a worker thread */
+#define WORD_COUNT_THREAD_SIZE (4 * 1024 * 1024)
+
+typedef struct TextStats
+{
+	guint64 bytes;
+	guint64 chars;			/* UTF-8 characters */
+	guint64 lines;
+	guint64 words;
+	guint64 longest_line;	/* in characters, without the line ending */
+	guint64 line_chars;		/* characters of the current line */
+	gboolean in_word;
+}
+TextStats;
+
+typedef struct WordCountJob
+{
+	GeanyDocument *doc;
+	ScintillaObject *sci;
+	gint start;
+	/* the text before and after the gap, which are read in place */
+	const gchar *segments[2];
+	gsize segment_lens[2];
+	gchar *copy;			/* a rectangular or multiple selection, which must be copied */
+	TextStats stats;
+	GThread *thread;
+	guint idle_id;
+	GtkWidget *dialog;		/* NULL once it was closed */
+	GtkWidget *values[5];	/* labels for lines, words, characters, bytes and longest line */
+}
+WordCountJob;
+
+
+static guchar word_count_classes[256];
+
+
+static void init_word_count_classes(void)
 {
-	guint in_word = 0;
-	gunichar utext;
+	static gboolean initialized = FALSE;
+	guint c;
 
-	if (! text)
-		return; /* politely refuse to operate on NULL */
+	if (initialized)
+		return;
 
-	*chars = *words = *lines = 0;
-	while (*text != '\0')
+	for (c = 0; c < G_N_ELEMENTS(word_count_classes); c++)
 	{
-		(*chars)++;
+		if (c == '\n')
+			word_count_classes[c] = WC_NEWLINE;
+		else if (c == '\r')
+			word_count_classes[c] = WC_RETURN;
+		else if (c == ' ' || c == '\t' || c == '\f' || c == '\v')
+			word_count_classes[c] = WC_SPACE;
+		else if (c < 0x80)
+			word_count_classes[c] = g_ascii_isgraph(c) ? WC_WORD : WC_CONTROL;
+		else if (c < 0xC0)
+			word_count_classes[c] = WC_CONTINUATION;
+		else
+			word_count_classes[c] = WC_LEAD;
+	}
+	initialized = TRUE;
+}
+
 
-		switch (*text)
+/* Adds the statistics of len bytes of UTF-8 text, which can be a part of the text.
+ * ASCII is classified with a table and runs of word characters are skipped in a tight loop,
+ * only multi-byte characters need decoding. Words are defined as any characters grouped,
+ * separated with spaces. */
+static void text_stats_add(TextStats *stats, const gchar *text, gsize len)
+{
+	const guchar *p = (const guchar *) text;
+	const guchar *end = p + len;
+	const guchar *start;
+	guint64 chars = 0, words = 0, lines = 0;
+	guint64 line_chars = stats->line_chars;
+	guint64 longest_line = stats->longest_line;
+	gboolean in_word = stats->in_word;
+	gunichar uc;
+
+	for (; p < end; p++)
+	{
+		switch (word_count_classes[*p])
 		{
-			case '\n':
-				(*lines)++;
-			case '\r':
-			case '\f':
-			case '\t':
-			case ' ':
-			case '\v':
-				mb_word_separator:
-				if (in_word)
+			case WC_WORD:
+				start = p;
+				while (p + 1 < end && word_count_classes[p[1]] == WC_WORD)
+					p++;
+				chars += p - start + 1;
+				line_chars += p - start + 1;
+				in_word = TRUE;
+				break;
+			case WC_NEWLINE:
+				lines++;
+				if (line_chars > longest_line)
+					longest_line = line_chars;
+				line_chars = 0;
+				/* fall through */
+			case WC_RETURN:
+				chars++;
+				words += in_word;
+				in_word = FALSE;
+				break;
+			case WC_SPACE:
+				chars++;
+				line_chars++;
+				words += in_word;
+				in_word = FALSE;
+				break;
+			case WC_CONTROL:
+				chars++;
+				line_chars++;
+				break;
+			case WC_LEAD:
+				chars++;
+				line_chars++;
+				/* a character split by the end of text is neither space nor printable */
+				uc = g_utf8_get_char_validated((const gchar *) p, end - p);
+				if (g_unichar_isspace(uc)) /* Unicode encoded space? */
 				{
-					in_word = 0;
-					(*words)++;
+					words += in_word;
+					in_word = FALSE;
 				}
+				else if (g_unichar_isgraph(uc)) /* Is this something printable? */
+					in_word = TRUE;
 				break;
-			default:
-				utext = g_utf8_get_char_validated(text, 2); /* This might be an utf-8 char */
-				if (g_unichar_isspace(utext)) /* Unicode encoded space? */
-					goto mb_word_separator;
-				if (g_unichar_isgraph(utext)) /* Is this something printable? */
-					in_word = 1;
+			case WC_CONTINUATION:
 				break;
 		}
-		/* Even if the current char is 2 bytes, this will iterate correctly. */
-		text = g_utf8_next_char(text);
 	}
 
+	stats->bytes += len;
+	stats->chars += chars;
+	stats->words += words;
+	stats->lines += lines;
+	stats->line_chars = line_chars;
+	stats->longest_line = longest_line;
+	stats->in_word = in_word;
+}
+
+
+static void text_stats_finish(TextStats *stats)
+{
 	/* Capture last word, if there's no whitespace at the end of the file. */
-	if (in_word)
-		(*words)++;
+	if (stats->in_word)
+		stats->words++;
+	stats->in_word = FALSE;
+	if (stats->line_chars > stats->longest_line)
+		stats->longest_line = stats->line_chars;
 	/* We start counting line numbers from 1 */
-	if (*chars > 0)
-		(*lines)++;
+	if (stats->chars > 0)
+		stats->lines++;
+}
+
+
+static void word_count_run(WordCountJob *job)
+{
+	if (job->copy != NULL)
+		text_stats_add(&job->stats, job->copy, strlen(job->copy));
+	else
+	{
+		text_stats_add(&job->stats, job->segments[0], job->segment_lens[0]);
+		text_stats_add(&job->stats, job->segments[1], job->segment_lens[1]);
+	}
+	text_stats_finish(&job->stats);
+}
+
+
+/* Gets the text between start and end without moving the gap of the buffer, so that
+ * nothing is copied. The gap is always at a character boundary. */
+static void word_count_get_segments(WordCountJob *job, gint start, gint end)
+{
+	ScintillaObject *sci = job->sci;
+	gint gap = scintilla_send_message(sci, SCI_GETGAPPOSITION, 0, 0);
+	gint split = CLAMP(gap, start, end);
+
+	job->start = start;
+	job->segments[0] = (const gchar *) scintilla_send_message(sci, SCI_GETRANGEPOINTER,
+		start, split - start);
+	job->segment_lens[0] = split - start;
+	job->segments[1] = (const gchar *) scintilla_send_message(sci, SCI_GETRANGEPOINTER,
+		split, end - split);
+	job->segment_lens[1] = end - split;
+}
+
+
+static GtkWidget *word_count_add_row(GtkWidget *table, guint row, const gchar *name,
+		const gchar *value)
+{
+	GtkWidget *label;
+
+	label = gtk_label_new(name);
+	gtk_table_attach(GTK_TABLE(table), label, 0, 1, row, row + 1,
+					(GtkAttachOptions) (GTK_FILL),
+					(GtkAttachOptions) (0), 0, 0);
+	gtk_misc_set_alignment(GTK_MISC(label), 1, 0);
+
+	label = gtk_label_new(value);
+	gtk_table_attach(GTK_TABLE(table), label, 1, 2, row, row + 1,
+					(GtkAttachOptions) (GTK_FILL),
+					(GtkAttachOptions) (0), 20, 0);
+	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
+	return label;
+}
+
+
+static void word_count_show_stats(WordCountJob *job)
+{
+	const guint64 values[G_N_ELEMENTS(job->values)] = {
+		job->stats.lines, job->stats.words, job->stats.chars, job->stats.bytes,
+		job->stats.longest_line };
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(job->values); i++)
+	{
+		gchar *text = g_strdup_printf("%" G_GUINT64_FORMAT, values[i]);
+
+		gtk_label_set_text(GTK_LABEL(job->values[i]), text);
+		g_free(text);
+	}
+}
+
+
+static void on_word_count_dialog_destroy(GtkWidget *widget, gpointer user_data)
+{
+	WordCountJob *job = user_data;
+
+	job->dialog = NULL;
+}
+
+
+static void word_count_job_free(WordCountJob *job)
+{
+	if (job->dialog != NULL)
+		g_signal_handlers_disconnect_by_func(job->dialog, on_word_count_dialog_destroy, job);
+	g_free(job->copy);
+	g_free(job);
+}
+
+
+static void on_word_count_editor_destroy(GtkWidget *widget, gpointer user_data);
+
+/* Waits for the count running in a thread and shows its result. This must be called
+ * before the buffer can change or is destroyed. */
+static void word_count_finish(WordCountJob *job)
+{
+	g_thread_join(job->thread);
+	/* the thread added the source before exiting */
+	if (job->idle_id != 0)
+		g_source_remove(job->idle_id);
+
+	g_signal_handlers_disconnect_by_func(job->sci, on_word_count_editor_destroy, job);
+	g_object_set_data(G_OBJECT(job->sci), "word-count-job", NULL);
+	if (DOC_VALID(job->doc))
+		document_release_buffer(job->doc);
+	if (job->dialog != NULL)
+		word_count_show_stats(job);
+	word_count_job_free(job);
+}
+
+
+/* Finishes the count running on sci, if any */
+static void word_count_wait(ScintillaObject *sci)
+{
+	WordCountJob *job = g_object_get_data(G_OBJECT(sci), "word-count-job");
+
+	if (job != NULL)
+		word_count_finish(job);
+}
+
+
+static void on_word_count_editor_destroy(GtkWidget *widget, gpointer user_data)
+{
+	word_count_finish(user_data);
+}
+
+
+static gboolean on_word_count_done(gpointer user_data)
+{
+	word_count_finish(user_data);
+	return FALSE;
+}
+
+
+static gpointer word_count_thread(gpointer user_data)
+{
+	WordCountJob *job = user_data;
+
+	word_count_run(job);
+	job->idle_id = g_idle_add(on_word_count_done, job);
+	return NULL;
+}
+
+
+/* Counts in a worker thread, the document is read-only meanwhile so that the buffer
+ * doesn't change. Returns FALSE if the count should run in the main thread. */
+static gboolean word_count_start_thread(WordCountJob *job)
+{
+	GError *error = NULL;
+
+	/* another holder of the buffer, e.g. a save, may read it in a thread, the gap must not
+	 * move then */
+	if (job->segment_lens[0] + job->segment_lens[1] < WORD_COUNT_THREAD_SIZE ||
+		document_buffer_is_held(job->doc))
+		return FALSE;
+
+	/* As for background saving, move the gap out of the text, so that other users of
+	 * SCI_GETCHARACTERPOINTER like the tag parser don't move the text while it is read. */
+	if (job->segment_lens[1] > 0)
+	{
+		const gchar *text = (const gchar *) scintilla_send_message(job->sci,
+			SCI_GETCHARACTERPOINTER, 0, 0);
+
+		job->segments[0] = text + job->start;
+		job->segment_lens[0] += job->segment_lens[1];
+		job->segment_lens[1] = 0;
+	}
+	document_hold_buffer(job->doc);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	job->thread = g_thread_try_new("word count", word_count_thread, job, &error);
+#else
+	job->thread = g_thread_create(word_count_thread, job, TRUE, &error);
+#endif
+	if (job->thread == NULL)
+	{
+		geany_debug("Could not create word count thread: %s", error->message);
+		g_error_free(error);
+		document_release_buffer(job->doc);
+		return FALSE;
+	}
+	g_object_set_data(G_OBJECT(job->sci), "word-count-job", job);
+	g_signal_connect(job->sci, "destroy", G_CALLBACK(on_word_count_editor_destroy), job);
+	return TRUE;
 }
 
 
 void tools_word_count(void)
 {
-	GtkWidget *dialog, *label, *vbox, *table;
+	GtkWidget *dialog, *vbox, *table;
 	GeanyDocument *doc;
-	guint chars = 0, lines = 0, words = 0;
-	gchar *text;
+	WordCountJob *job;
+	ScintillaObject *sci;
 	const gchar *range;
 
 	doc = document_get_current();
 	g_return_if_fail(doc != NULL);
 
-	dialog = gtk_dialog_new_with_buttons(_("Word Count"), GTK_WINDOW(main_widgets.window),
-										 GTK_DIALOG_DESTROY_WITH_PARENT,
-										 GTK_STOCK_CLOSE, GTK_RESPONSE_CANCEL, NULL);
-	vbox = ui_dialog_vbox_new(GTK_DIALOG(dialog));
-	gtk_widget_set_name(dialog, "GeanyDialog");
+	init_word_count_classes();
+	sci = doc->editor->sci;
+	job = g_new0(WordCountJob, 1);
+	job->doc = doc;
+	job->sci = sci;
 
-	if (sci_has_selection(doc->editor->sci))
+	if (sci_has_selection(sci))
 	{
-		text = sci_get_selection_contents(doc->editor->sci);
+		if (sci_get_selection_mode(sci) != SC_SEL_STREAM ||
+			scintilla_send_message(sci, SCI_GETSELECTIONS, 0, 0) > 1)
+			job->copy = sci_get_selection_contents(sci);
+		else
+			word_count_get_segments(job, sci_get_selection_start(sci), sci_get_selection_end(sci));
 		range = _("selection");
 	}
 	else
 	{
-		text = sci_get_contents(doc->editor->sci, -1);
+		word_count_get_segments(job, 0, sci_get_length(sci));
 		range = _("whole document");
 	}
-	word_count(text, &chars, &lines, &words);
-	g_free(text);
 
-	table = gtk_table_new(4, 2, FALSE);
+	dialog = gtk_dialog_new_with_buttons(_("Word Count"), GTK_WINDOW(main_widgets.window),
+										 GTK_DIALOG_DESTROY_WITH_PARENT,
+										 GTK_STOCK_CLOSE, GTK_RESPONSE_CANCEL, NULL);
+	vbox = ui_dialog_vbox_new(GTK_DIALOG(dialog));
+	gtk_widget_set_name(dialog, "GeanyDialog");
+
+	table = gtk_table_new(6, 2, FALSE);
 	gtk_table_set_row_spacings(GTK_TABLE(table), 5);
 	gtk_table_set_col_spacings(GTK_TABLE(table), 10);
 
-	label = gtk_label_new(_("Range:"));
-	gtk_table_attach(GTK_TABLE(table), label, 0, 1, 0, 1,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 0, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 1, 0);
-
-	label = gtk_label_new(range);
-	gtk_table_attach(GTK_TABLE(table), label, 1, 2, 0, 1,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 20, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
-
-	label = gtk_label_new(_("Lines:"));
-	gtk_table_attach(GTK_TABLE(table), label, 0, 1, 1, 2,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 0, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 1, 0);
-
-	text = g_strdup_printf("%d", lines);
-	label = gtk_label_new(text);
-	gtk_table_attach(GTK_TABLE(table), label, 1, 2, 1, 2,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 20, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
-	g_free(text);
-
-	label = gtk_label_new(_("Words:"));
-	gtk_table_attach(GTK_TABLE(table), label, 0, 1, 2, 3,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 0, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 1, 0);
-
-	text = g_strdup_printf("%d", words);
-	label = gtk_label_new(text);
-	gtk_table_attach(GTK_TABLE(table), label, 1, 2, 2, 3,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 20, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
-	g_free(text);
-
-	label = gtk_label_new(_("Characters:"));
-	gtk_table_attach(GTK_TABLE(table), label, 0, 1, 3, 4,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 0, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 1, 0);
-
-	text = g_strdup_printf("%d", chars);
-	label = gtk_label_new(text);
-	gtk_table_attach(GTK_TABLE(table), label, 1, 2, 3, 4,
-					(GtkAttachOptions) (GTK_FILL),
-					(GtkAttachOptions) (0), 20, 0);
-	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
-	g_free(text);
+	word_count_add_row(table, 0, _("Range:"), range);
+	job->values[0] = word_count_add_row(table, 1, _("Lines:"), "");
+	job->values[1] = word_count_add_row(table, 2, _("Words:"), "");
+	job->values[2] = word_count_add_row(table, 3, _("Characters:"), "");
+	job->values[3] = word_count_add_row(table, 4, _("Bytes:"), "");
+	job->values[4] = word_count_add_row(table, 5, _("Longest line:"), "");
 
 	gtk_container_add(GTK_CONTAINER(vbox), table);
 
 	g_signal_connect(dialog, "response", G_CALLBACK(gtk_widget_destroy), dialog);
 	g_signal_connect(dialog, "delete-event", G_CALLBACK(gtk_widget_destroy), dialog);
 
+	if (job->copy == NULL && word_count_start_thread(job))
+	{
+		/* the results are shown when the thread has finished */
+		job->dialog = dialog;
+		g_signal_connect(dialog, "destroy", G_CALLBACK(on_word_count_dialog_destroy), job);
+	}
+	else
+	{
+		word_count_run(job);
+		word_count_show_stats(job);
+		word_count_job_free(job);
+	}
+
 	gtk_widget_show_all(dialog);
 }
 
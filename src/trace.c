@@ -0,0 +1,572 @@
+/*
+ *      trace.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Lightweight latency tracing of the editing pipeline, enabled with --trace-file.
+ * Events are kept in a ring buffer and summarised in per-phase histograms; on exit
+ * they are written in Chrome's trace event format (load it in chrome://tracing).
+ *
+ * Startup profiling (--profile-startup) records wall and CPU time plus heap and
+ * resident memory growth for each (possibly nested) startup phase.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "geany.h"
+
+#if defined(HAVE_MALLINFO2) || defined(__GLIBC__)
+# include <malloc.h>
+#endif
+#ifdef __linux__
+# include <unistd.h>
+#endif
+
+#include "trace.h"
+#include "utils.h"
+
+
+/* number of recent events to keep */
+#define TRACE_RING_SIZE 8192
+/* number of slow events to keep, so they are not lost among the fast ones */
+#define TRACE_SLOW_RING_SIZE 256
+/* events longer than one frame at 60 Hz are considered slow */
+#define TRACE_SLOW_USEC 16000
+/* histogram buckets: 4 sub-buckets per power of two, up to about an hour */
+#define TRACE_HISTOGRAM_SIZE (4 * 32)
+
+
+typedef struct TraceEvent
+{
+	TracePhase	phase;
+	gint64		start;	/* microseconds since trace_init() */
+	gint64		duration;
+}
+TraceEvent;
+
+typedef struct TraceRing
+{
+	TraceEvent	*events;
+	guint		size;
+	guint		next;
+	gboolean	wrapped;
+}
+TraceRing;
+
+typedef struct TraceHistogram
+{
+	guint64		buckets[TRACE_HISTOGRAM_SIZE];
+	guint64		count;
+	gint64		max;
+}
+TraceHistogram;
+
+
+gboolean trace_enabled = FALSE;
+
+static gchar *trace_filename = NULL;
+#if GLIB_CHECK_VERSION(2, 28, 0)
+static gint64 trace_start_time = 0;
+#else
+static GTimer *trace_timer = NULL;
+#endif
+static TraceRing recent_events;
+static TraceRing slow_events;
+static TraceHistogram histograms[TRACE_PHASE_COUNT];
+
+static const gchar *phase_names[TRACE_PHASE_COUNT] =
+{
+	"editor_notify",
+	"brace_match",
+	"statusbar",
+	"autocomplete",
+	"tag_update",
+	"sidebar",
+	"paint"
+};
+
+
+gint64 trace_get_time(void)
+{
+#if GLIB_CHECK_VERSION(2, 28, 0)
+	return g_get_monotonic_time() - trace_start_time;
+#else
+	return (gint64) (g_timer_elapsed(trace_timer, NULL) * G_USEC_PER_SEC);
+#endif
+}
+
+
+static void ring_init(TraceRing *ring, guint size)
+{
+	ring->events = g_new(TraceEvent, size);
+	ring->size = size;
+	ring->next = 0;
+	ring->wrapped = FALSE;
+}
+
+
+static void ring_add(TraceRing *ring, const TraceEvent *event)
+{
+	ring->events[ring->next] = *event;
+	if (++ring->next == ring->size)
+	{
+		ring->next = 0;
+		ring->wrapped = TRUE;
+	}
+}
+
+
+/* Returns the @a i-th oldest event */
+static const TraceEvent *ring_get(const TraceRing *ring, guint i)
+{
+	if (ring->wrapped)
+		i = (ring->next + i) % ring->size;
+	return &ring->events[i];
+}
+
+
+static guint ring_length(const TraceRing *ring)
+{
+	return ring->wrapped ? ring->size : ring->next;
+}
+
+
+static guint histogram_bucket(gint64 usec)
+{
+	guint bits, bucket;
+
+	if (usec < 4)
+		return (guint) MAX(usec, 0);
+
+	bits = g_bit_storage((gulong) usec);
+	/* the leading bit selects the power of two, the next two bits the sub-bucket */
+	bucket = (bits - 2) * 4 + ((usec >> (bits - 3)) & 3);
+	return MIN(bucket, TRACE_HISTOGRAM_SIZE - 1);
+}
+
+
+/* Returns the largest value which falls into @a bucket */
+static gint64 histogram_bucket_limit(guint bucket)
+{
+	guint bits;
+
+	if (bucket < 4)
+		return bucket;
+
+	bits = bucket / 4 + 2;
+	return ((gint64) (4 + bucket % 4 + 1) << (bits - 3)) - 1;
+}
+
+
+static gint64 histogram_percentile(const TraceHistogram *histogram, gdouble percentile)
+{
+	guint64 wanted, seen = 0;
+	guint i;
+
+	if (histogram->count == 0)
+		return 0;
+
+	wanted = (guint64) (histogram->count * percentile / 100.0);
+	if (wanted == 0)
+		wanted = 1;
+	for (i = 0; i < TRACE_HISTOGRAM_SIZE; i++)
+	{
+		seen += histogram->buckets[i];
+		if (seen >= wanted)
+			return MIN(histogram_bucket_limit(i), histogram->max);
+	}
+	return histogram->max;
+}
+
+
+void trace_end(TracePhase phase, gint64 start)
+{
+	TraceEvent event;
+	TraceHistogram *histogram;
+
+	if (! trace_enabled)
+		return;
+
+	g_return_if_fail(phase < TRACE_PHASE_COUNT);
+
+	event.phase = phase;
+	event.start = start;
+	event.duration = trace_get_time() - start;
+
+	histogram = &histograms[phase];
+	histogram->buckets[histogram_bucket(event.duration)]++;
+	histogram->count++;
+	if (event.duration > histogram->max)
+		histogram->max = event.duration;
+
+	ring_add(&recent_events, &event);
+	if (event.duration >= TRACE_SLOW_USEC)
+		ring_add(&slow_events, &event);
+}
+
+
+void trace_init(const gchar *filename)
+{
+	g_return_if_fail(filename != NULL);
+
+	trace_filename = g_strdup(filename);
+#if GLIB_CHECK_VERSION(2, 28, 0)
+	trace_start_time = g_get_monotonic_time();
+#else
+	trace_timer = g_timer_new();
+#endif
+	ring_init(&recent_events, TRACE_RING_SIZE);
+	ring_init(&slow_events, TRACE_SLOW_RING_SIZE);
+	memset(histograms, 0, sizeof(histograms));
+	trace_enabled = TRUE;
+}
+
+
+static void write_event(GString *str, const TraceEvent *event, gboolean *first)
+{
+	g_string_append_printf(str,
+		"%s\n{\"name\": \"%s\", \"cat\": \"geany\", \"ph\": \"X\", "
+		"\"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT ", \"pid\": 1, \"tid\": 1}",
+		*first ? "" : ",", phase_names[event->phase], event->start, event->duration);
+	*first = FALSE;
+}
+
+
+static GString *get_trace_json(void)
+{
+	GString *str = g_string_new("{\"traceEvents\": [");
+	gboolean first = TRUE;
+	gint64 oldest_recent = G_MAXINT64;
+	guint i;
+
+	if (ring_length(&recent_events) > 0)
+		oldest_recent = ring_get(&recent_events, 0)->start;
+
+	/* slow events which dropped out of the recent events ring */
+	for (i = 0; i < ring_length(&slow_events); i++)
+	{
+		const TraceEvent *event = ring_get(&slow_events, i);
+
+		if (event->start < oldest_recent)
+			write_event(str, event, &first);
+	}
+	for (i = 0; i < ring_length(&recent_events); i++)
+		write_event(str, ring_get(&recent_events, i), &first);
+
+	g_string_append(str, "\n],\n\"otherData\": {");
+	for (i = 0; i < TRACE_PHASE_COUNT; i++)
+	{
+		const TraceHistogram *histogram = &histograms[i];
+
+		g_string_append_printf(str,
+			"%s\n\"%s\": {\"count\": %" G_GUINT64_FORMAT ", \"p50_us\": %" G_GINT64_FORMAT
+			", \"p99_us\": %" G_GINT64_FORMAT ", \"max_us\": %" G_GINT64_FORMAT "}",
+			i == 0 ? "" : ",", phase_names[i], histogram->count,
+			histogram_percentile(histogram, 50), histogram_percentile(histogram, 99),
+			histogram->max);
+	}
+	g_string_append(str, "\n}}\n");
+	return str;
+}
+
+
+static void log_statistics(void)
+{
+	guint i;
+
+	geany_debug("%-16s %10s %10s %10s %10s", "Phase", "Count", "p50 (us)", "p99 (us)", "Max (us)");
+	for (i = 0; i < TRACE_PHASE_COUNT; i++)
+	{
+		const TraceHistogram *histogram = &histograms[i];
+
+		geany_debug("%-16s %10" G_GUINT64_FORMAT " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT
+			" %10" G_GINT64_FORMAT, phase_names[i], histogram->count,
+			histogram_percentile(histogram, 50), histogram_percentile(histogram, 99),
+			histogram->max);
+	}
+}
+
+
+void trace_finalize(void)
+{
+	GString *json;
+	gint error;
+
+	if (! trace_enabled)
+		return;
+
+	trace_enabled = FALSE;
+	log_statistics();
+
+	json = get_trace_json();
+	error = utils_write_file(trace_filename, json->str);
+	if (error != 0)
+		g_warning("Could not write trace file %s (%s).", trace_filename, g_strerror(error));
+	g_string_free(json, TRUE);
+
+	g_free(recent_events.events);
+	g_free(slow_events.events);
+	g_free(trace_filename);
+	trace_filename = NULL;
+#if ! GLIB_CHECK_VERSION(2, 28, 0)
+	g_timer_destroy(trace_timer);
+	trace_timer = NULL;
+#endif
+}
+
+
+/* Startup profiling */
+
+typedef struct StartupPhase
+{
+	gchar	*name;
+	guint	 depth;
+	gint64	 wall;	/* microseconds */
+	gint64	 cpu;	/* microseconds */
+	gint64	 heap;	/* bytes */
+	gint64	 rss;	/* bytes */
+}
+StartupPhase;
+
+
+gboolean trace_startup_enabled = FALSE;
+
+static gchar *startup_json_filename = NULL;
+static GArray *startup_phases = NULL;
+/* indexes into startup_phases of the phases which haven't ended yet */
+static GSList *startup_stack = NULL;
+static GTimer *startup_timer = NULL;
+
+
+static gint64 get_cpu_usec(void)
+{
+	return (gint64) clock() * G_USEC_PER_SEC / CLOCKS_PER_SEC;
+}
+
+
+/* Returns the number of bytes allocated from the heap, or 0 if unknown */
+static gint64 get_heap_bytes(void)
+{
+#if defined(HAVE_MALLINFO2)
+	struct mallinfo2 info = mallinfo2();
+
+	return (gint64) info.uordblks + (gint64) info.hblkhd;
+#elif defined(__GLIBC__)
+	/* deprecated since glibc 2.33, which has mallinfo2() */
+	struct mallinfo info = mallinfo();
+
+	return (guint) info.uordblks + (guint) info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+
+/* Returns the resident set size in bytes, or 0 if unknown */
+static gint64 get_rss_bytes(void)
+{
+	gint64 rss = 0;
+#ifdef __linux__
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (fp != NULL)
+	{
+		glong size, resident;
+
+		if (fscanf(fp, "%ld %ld", &size, &resident) == 2)
+			rss = (gint64) resident * sysconf(_SC_PAGESIZE);
+		fclose(fp);
+	}
+#endif
+	return rss;
+}
+
+
+static void sample_startup_phase(StartupPhase *phase)
+{
+	phase->wall = (gint64) (g_timer_elapsed(startup_timer, NULL) * G_USEC_PER_SEC);
+	phase->cpu = get_cpu_usec();
+	phase->heap = get_heap_bytes();
+	phase->rss = get_rss_bytes();
+}
+
+
+/* @param json_filename File to write the results to as JSON, or @c NULL. */
+void trace_startup_init(const gchar *json_filename)
+{
+	startup_json_filename = g_strdup(json_filename);
+	startup_phases = g_array_new(FALSE, FALSE, sizeof(StartupPhase));
+	startup_timer = g_timer_new();
+	trace_startup_enabled = TRUE;
+
+	/* the whole startup is the outermost phase */
+	trace_startup_begin("total");
+}
+
+
+void trace_startup_begin(const gchar *format, ...)
+{
+	StartupPhase phase;
+	va_list args;
+
+	if (! trace_startup_enabled)
+		return;
+
+	va_start(args, format);
+	phase.name = g_strdup_vprintf(format, args);
+	va_end(args);
+	phase.depth = g_slist_length(startup_stack);
+	sample_startup_phase(&phase);
+
+	g_array_append_val(startup_phases, phase);
+	startup_stack = g_slist_prepend(startup_stack, GUINT_TO_POINTER(startup_phases->len - 1));
+}
+
+
+void trace_startup_end(void)
+{
+	StartupPhase *phase, now;
+
+	if (! trace_startup_enabled)
+		return;
+
+	g_return_if_fail(startup_stack != NULL);
+
+	phase = &g_array_index(startup_phases, StartupPhase, GPOINTER_TO_UINT(startup_stack->data));
+	startup_stack = g_slist_delete_link(startup_stack, startup_stack);
+
+	/* turn the start samples into deltas */
+	sample_startup_phase(&now);
+	phase->wall = now.wall - phase->wall;
+	phase->cpu = now.cpu - phase->cpu;
+	phase->heap = now.heap - phase->heap;
+	phase->rss = now.rss - phase->rss;
+}
+
+
+static void print_startup_phases(void)
+{
+	guint i;
+
+	printf("%-40s %10s %10s %12s %12s\n", "Phase", "Wall (ms)", "CPU (ms)", "Heap (KiB)", "RSS (KiB)");
+	for (i = 0; i < startup_phases->len; i++)
+	{
+		StartupPhase *phase = &g_array_index(startup_phases, StartupPhase, i);
+		gchar *name = g_strdup_printf("%*s%s", phase->depth * 2, "", phase->name);
+
+		printf("%-40s %10.1f %10.1f %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT "\n", name,
+			phase->wall / 1000.0, phase->cpu / 1000.0, phase->heap / 1024, phase->rss / 1024);
+		g_free(name);
+	}
+	fflush(stdout);
+}
+
+
+/* Appends s as a JSON string. Control characters are escaped and invalid UTF-8, e.g. from
+ * a locale encoded path, is replaced by U+FFFD so that the result stays valid JSON. */
+static void append_json_string(GString *str, const gchar *s)
+{
+	const gchar *end;
+
+	g_string_append_c(str, '"');
+	while (*s)
+	{
+		/* end is set to the first invalid byte, if any */
+		g_utf8_validate(s, -1, &end);
+		for (; s < end; s++)
+		{
+			guchar c = (guchar) *s;
+
+			if (c == '"' || c == '\\')
+			{
+				g_string_append_c(str, '\\');
+				g_string_append_c(str, c);
+			}
+			else if (c < 0x20)
+				g_string_append_printf(str, "\\u%04x", c);
+			else
+				g_string_append_c(str, c);
+		}
+		if (*s)
+		{
+			g_string_append(str, "\\ufffd");
+			s++;
+		}
+	}
+	g_string_append_c(str, '"');
+}
+
+
+static GString *get_startup_json(void)
+{
+	GString *str = g_string_new("[");
+	guint i;
+
+	for (i = 0; i < startup_phases->len; i++)
+	{
+		StartupPhase *phase = &g_array_index(startup_phases, StartupPhase, i);
+
+		g_string_append_printf(str, "%s\n{\"name\": ", i == 0 ? "" : ",");
+		append_json_string(str, phase->name);
+		g_string_append_printf(str,
+			", \"depth\": %u, \"wall_us\": %" G_GINT64_FORMAT
+			", \"cpu_us\": %" G_GINT64_FORMAT ", \"heap_bytes\": %" G_GINT64_FORMAT
+			", \"rss_bytes\": %" G_GINT64_FORMAT "}",
+			phase->depth, phase->wall, phase->cpu, phase->heap, phase->rss);
+	}
+	g_string_append(str, "\n]\n");
+	return str;
+}
+
+
+/* Ends any pending phases, reports the results and stops startup profiling. */
+void trace_startup_finish(void)
+{
+	guint i;
+
+	if (! trace_startup_enabled)
+		return;
+
+	while (startup_stack != NULL)
+		trace_startup_end();
+	trace_startup_enabled = FALSE;
+
+	print_startup_phases();
+	if (startup_json_filename != NULL)
+	{
+		GString *json = get_startup_json();
+		gint error = utils_write_file(startup_json_filename, json->str);
+
+		if (error != 0)
+			g_warning("Could not write startup profile %s (%s).", startup_json_filename,
+				g_strerror(error));
+		g_string_free(json, TRUE);
+	}
+
+	for (i = 0; i < startup_phases->len; i++)
+		g_free(g_array_index(startup_phases, StartupPhase, i).name);
+	g_array_free(startup_phases, TRUE);
+	startup_phases = NULL;
+	g_timer_destroy(startup_timer);
+	startup_timer = NULL;
+	g_free(startup_json_filename);
+	startup_json_filename = NULL;
+}
@@ -0,0 +1,68 @@
+/*
+ *      trace.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      Copyright 2012 The Geany contributors
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef GEANY_TRACE_H
+#define GEANY_TRACE_H 1
+
+
+/* Phases of the keypress to paint pipeline which can be traced */
+typedef enum
+{
+	TRACE_EDITOR_NOTIFY,
+	TRACE_BRACE_MATCH,
+	TRACE_STATUSBAR,
+	TRACE_AUTOCOMPLETE,
+	TRACE_TAG_UPDATE,
+	TRACE_SIDEBAR,
+	TRACE_PAINT,
+	TRACE_PHASE_COUNT
+}
+TracePhase;
+
+
+extern gboolean trace_enabled;
+
+/* Returns a start timestamp for trace_end(), or 0 when tracing is disabled so
+ * that untraced builds only pay for a single test. */
+#define trace_begin() (trace_enabled ? trace_get_time() : 0)
+
+
+void trace_init(const gchar *filename);
+
+void trace_finalize(void);
+
+gint64 trace_get_time(void);
+
+void trace_end(TracePhase phase, gint64 start);
+
+
+extern gboolean trace_startup_enabled;
+
+void trace_startup_init(const gchar *json_filename);
+
+void trace_startup_begin(const gchar *format, ...) G_GNUC_PRINTF(1, 2);
+
+void trace_startup_end(void);
+
+void trace_startup_finish(void);
+
+
+#endif
@@ -108,6 +108,7 @@ typedef struct UIPrefs
 	gboolean	allow_always_save; /* if set, files can always be saved, even if unchanged */
 	gchar		*statusbar_template;
 	gboolean	new_document_after_close;
+	gint		msgwin_max_lines;	/* of the Compiler and Messages tabs, 0 for no limit */
 
 	/* Menu-item related data */
 	GQueue		*recent_queue;
@@ -2096,3 +2096,16 @@ gchar *utils_parse_and_format_build_date(const gchar *input)
 
 	return g_strdup(input);
 }
+
+
+/* Appends the modification time and size of @a locale_filename to @a stamp, or
+ * zeros if it doesn't exist, so changes to the file can be detected by comparing stamps. */
+void utils_append_file_stamp(GString *stamp, const gchar *locale_filename)
+{
+	struct stat st;
+
+	if (g_stat(locale_filename, &st) == 0)
+		g_string_append_printf(stamp, "%ld/%ld:", (glong) st.st_mtime, (glong) st.st_size);
+	else
+		g_string_append(stamp, "0/0:");
+}
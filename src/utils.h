@@ -284,6 +284,8 @@ GDate *utils_parse_date(const gchar *input);
 
 gchar *utils_parse_and_format_build_date(const gchar *input);
 
+void utils_append_file_stamp(GString *stamp, const gchar *locale_filename);
+
 G_END_DECLS
 
 #endif
@@ -644,10 +644,23 @@ static void retardToken (statementInfo *const st)
 	setToken(st, TOKEN_NONE);
 }
 
+/* Deleted tokens are kept for reuse, so that the temporary tokens don't need to be
+ * allocated again (with their name strings) every time */
+enum { TokenPoolSize = 16 };
+static tokenInfo *TokenPool [(int) TokenPoolSize];
+static unsigned int TokenPoolCount = 0;
+
 static tokenInfo *newToken (void)
 {
-	tokenInfo *const token = xMalloc (1, tokenInfo);
-	token->name = vStringNew();
+	tokenInfo *token;
+
+	if (TokenPoolCount > 0)
+		token = TokenPool [--TokenPoolCount];
+	else
+	{
+		token = xMalloc (1, tokenInfo);
+		token->name = vStringNew();
+	}
 	initToken(token);
 	return token;
 }
@@ -656,8 +669,13 @@ static void deleteToken (tokenInfo *const token)
 {
 	if (token != NULL)
 	{
-		vStringDelete(token->name);
-		eFree(token);
+		if (TokenPoolCount < (unsigned int) TokenPoolSize)
+			TokenPool [TokenPoolCount++] = token;
+		else
+		{
+			vStringDelete(token->name);
+			eFree(token);
+		}
 	}
 }
 
@@ -1122,6 +1140,22 @@ static const char *tagName (const tagType type)
 	return result;
 }
 
+static int tagKindIndex (const tagType type)
+{
+	int result;
+	if (isLanguage (Lang_csharp))
+		result = csharpTagKind (type);
+	else if (isLanguage (Lang_d))
+		result = dTagKind (type);
+	else if (isLanguage (Lang_java))
+		result = javaTagKind (type);
+	else if (isLanguage (Lang_vala))
+		result = valaTagKind (type);
+	else
+		result = cTagKind (type);
+	return result;
+}
+
 static int tagLetter (const tagType type)
 {
 	int result;
@@ -1324,9 +1358,12 @@ static void findScopeHierarchy (vString *const string,
 	}
 	if (st->parent != NULL)
 	{
-		vString *temp = vStringNew ();
+		static vString *temp = NULL;
 		const statementInfo *s;
 
+		if (temp == NULL)
+			temp = vStringNew ();
+
 		for (s = st->parent  ;  s != NULL  ;  s = s->parent)
 		{
 			if (isContextualStatement (s) ||
@@ -1352,7 +1389,6 @@ static void findScopeHierarchy (vString *const string,
 				vStringCat (string, temp);
 			}
 		}
-		vStringDelete (temp);
 
 		if (! nonAnonPresent)
 			vStringClear (string);
@@ -1365,8 +1401,12 @@ static void makeExtraTagEntry (const tagType type, tagEntryInfo *const e,
 	if (Option.include.qualifiedTags  &&
 		scope != NULL  &&  vStringLength (scope) > 0)
 	{
-		vString *const scopedName = vStringNew ();
+		static vString *scopedName = NULL;
 
+		if (scopedName == NULL)
+			scopedName = vStringNew ();
+		else
+			vStringClear (scopedName);
 		if (type != TAG_ENUMERATOR)
 			vStringCopy (scopedName, scope);
 		else
@@ -1388,7 +1428,6 @@ static void makeExtraTagEntry (const tagType type, tagEntryInfo *const e,
 			e->name = vStringValue (scopedName);
 			makeTagEntry (e);
 		}
-		vStringDelete (scopedName);
 	}
 }
 
@@ -1408,7 +1447,7 @@ static void makeTag (const tokenInfo *const token,
 	if (isType (token, TOKEN_NAME)  &&  vStringLength (token->name) > 0  /* &&
 		includeTag (type, isFileScope) */)
 	{
-		vString *scope = vStringNew ();
+		static vString *scope = NULL;
 		tagEntryInfo e;
 
 		/* take only functions which are introduced by "function ..." */
@@ -1418,6 +1457,8 @@ static void makeTag (const tokenInfo *const token,
 			return;
 		}
 
+		if (scope == NULL)
+			scope = vStringNew ();
 		initTagEntry (&e, vStringValue (token->name));
 
 		e.lineNumber	= token->lineNumber;
@@ -1425,6 +1466,7 @@ static void makeTag (const tokenInfo *const token,
 		e.isFileScope = isFileScope;
 		e.kindName	= tagName (type);
 		e.kind		= tagLetter (type);
+		e.kindIndex	= tagKindIndex (type);
 		e.type = type;
 
 		findScopeHierarchy (scope, st);
@@ -1436,7 +1478,6 @@ static void makeTag (const tokenInfo *const token,
 		makeTagEntry (&e);
 		if (NULL != TagEntryFunction)
 			makeExtraTagEntry (type, &e, scope);
-		vStringDelete (scope);
 		if (NULL != e.extensionFields.arglist)
 			free((char *) e.extensionFields.arglist);
 	}
@@ -2808,19 +2849,31 @@ static void nextToken (statementInfo *const st)
 */
 static unsigned int contextual_fake_count = 0;
 static statementInfo *CurrentStatement = NULL;
+/* Deleted statements, linked by their parent field. They are reinitialized instead of
+ * being allocated again for each nesting level, including across files and passes. */
+static statementInfo *StatementPool = NULL;
 
 static statementInfo *newStatement (statementInfo *const parent)
 {
-	statementInfo *const st = xMalloc (1, statementInfo);
+	statementInfo *st;
 	unsigned int i;
 
-	for (i = 0  ;  i < (unsigned int) NumTokens  ;  ++i)
-		st->token [i] = newToken ();
+	if (StatementPool != NULL)
+	{
+		st = StatementPool;
+		StatementPool = st->parent;
+	}
+	else
+	{
+		st = xMalloc (1, statementInfo);
+		for (i = 0  ;  i < (unsigned int) NumTokens  ;  ++i)
+			st->token [i] = newToken ();
 
-	st->context			= newToken ();
-	st->blockName		= newToken ();
-	st->parentClasses	= vStringNew ();
-	st->firstToken		= newToken();
+		st->context			= newToken ();
+		st->blockName		= newToken ();
+		st->parentClasses	= vStringNew ();
+		st->firstToken		= newToken();
+	}
 
 	initStatement (st, parent);
 	CurrentStatement = st;
@@ -2832,17 +2885,9 @@ static void deleteStatement (void)
 {
 	statementInfo *const st = CurrentStatement;
 	statementInfo *const parent = st->parent;
-	unsigned int i;
 
-	for (i = 0  ;  i < (unsigned int) NumTokens  ;  ++i)
-	{
-		deleteToken(st->token[i]);			st->token[i] = NULL;
-	}
-	deleteToken(st->blockName);			st->blockName = NULL;
-	deleteToken(st->context);			st->context = NULL;
-	vStringDelete(st->parentClasses);	st->parentClasses = NULL;
-	deleteToken(st->firstToken);
-	eFree (st);
+	st->parent = StatementPool;
+	StatementPool = st;
 	CurrentStatement = parent;
 }
 
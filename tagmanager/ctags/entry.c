@@ -416,6 +416,7 @@ extern void initTagEntry (tagEntryInfo *const e, const char *const name)
     e->filePosition	= getInputFilePosition ();
     e->sourceFileName	= getSourceFileTagPath ();
     e->name		= name;
+    e->kindIndex	= -1;
 }
 
 /* vi:set tabstop=8 shiftwidth=4: */
@@ -65,6 +65,7 @@ typedef struct sTagEntryInfo {
     const char *name;		/* name of the tag */
     const char *kindName;	/* kind of tag */
     char	kind;		/* single character representation of kind */
+    int		kindIndex;	/* index of kindName in the parser's kinds, or -1 */
     struct {
 	const char* access;
 	const char* fileScope;
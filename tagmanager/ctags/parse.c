@@ -49,6 +49,7 @@ extern void makeSimpleTag (const vString* const name,
 
         e.kindName = kinds [kind].name;
         e.kind     = kinds [kind].letter;
+        e.kindIndex = kind;
 
         makeTagEntry (&e);
     }
@@ -67,6 +68,7 @@ extern void makeSimpleScopedTag (const vString* const name,
 
         e.kindName = kinds [kind].name;
         e.kind     = kinds [kind].letter;
+        e.kindIndex = kind;
 	e.extensionFields.scope[0] = scope;
 	e.extensionFields.scope[1] = scope2;
 	e.extensionFields.access = laccess;
@@ -0,0 +1,682 @@
+/*
+*
+*   Copyright (c) 2012, The Geany contributors
+*
+*   This source code is released for free distribution under the terms of the
+*   GNU General Public License.
+*
+*/
+
+/*
+ * tm-bench parses source files with the tag manager outside of Geany, without GTK.
+ * It reports the parsing throughput, optionally writes the tags in any of the
+ * TMFileFormat formats and can check the parsers' output against expected tags
+ * files, which is how the tests in tests/ctags are run.
+ */
+
+#include "general.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+# include <sys/resource.h>
+#endif
+
+#include "tm_tagmanager.h"
+
+
+typedef struct
+{
+	guint files;
+	guint64 bytes;
+	guint64 tags;
+	GTimer *timer;
+}
+BenchStats;
+
+/* Results for one language, the time being the sum of the best time of each file */
+typedef struct
+{
+	guint files;
+	guint64 bytes;
+	guint64 tags;
+	gdouble seconds;
+}
+LangStats;
+
+/* Baselines faster than this are too noisy to be compared */
+#define MIN_BASELINE_SECONDS 0.005
+
+
+static gchar *opt_lang = NULL;
+static gchar **opt_maps = NULL;
+static gchar *opt_format = NULL;
+static gchar *opt_output = NULL;
+static gint opt_repeat = 1;
+static gboolean opt_check = FALSE;
+static gboolean opt_quiet = FALSE;
+static gint opt_scale = 0;
+static gchar *opt_json = NULL;
+static gchar *opt_baseline = NULL;
+static gint opt_threshold = 20;
+
+static GOptionEntry entries[] =
+{
+	{ "lang", 'l', 0, G_OPTION_ARG_STRING, &opt_lang,
+		"Parse all files as LANG instead of detecting the language", "LANG" },
+	{ "map", 'x', 0, G_OPTION_ARG_STRING_ARRAY, &opt_maps,
+		"Parse files with extension EXT as LANG (can be repeated)", "EXT=LANG" },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &opt_format,
+		"Format of the written tags: tagmanager (default), pipe or ctags", "FORMAT" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+		"Write the tags of all files to FILE (- for standard output)", "FILE" },
+	{ "repeat", 'n', 0, G_OPTION_ARG_INT, &opt_repeat,
+		"Parse each file N times", "N" },
+	{ "check", 'c', 0, G_OPTION_ARG_NONE, &opt_check,
+		"Compare the tags of each source file with the given expected tags files", NULL },
+	{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &opt_quiet,
+		"Only report failures", NULL },
+	{ "scale", 's', 0, G_OPTION_ARG_INT, &opt_scale,
+		"Repeat the contents of each file until it is at least BYTES long", "BYTES" },
+	{ "json", 'j', 0, G_OPTION_ARG_FILENAME, &opt_json,
+		"Write the results of each language to FILE in JSON", "FILE" },
+	{ "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &opt_baseline,
+		"Fail if a language is slower than in FILE, written by --json before", "FILE" },
+	{ "threshold", 't', 0, G_OPTION_ARG_INT, &opt_threshold,
+		"Allowed slowdown compared to the baseline, in percent (default 20)", "PERCENT" },
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+static GHashTable *ext_langs = NULL;
+static GHashTable *lang_stats = NULL;
+
+
+/* Returns the language name to parse file_name with, or NULL to detect it */
+static const gchar *get_file_lang(const gchar *file_name)
+{
+	const gchar *ext;
+
+	if (opt_lang != NULL)
+		return opt_lang;
+
+	ext = strrchr(file_name, '.');
+	if (ext != NULL && strchr(ext, G_DIR_SEPARATOR) == NULL)
+		return g_hash_table_lookup(ext_langs, ext + 1);
+	return NULL;
+}
+
+
+static gboolean parse_maps(void)
+{
+	gchar **map;
+
+	ext_langs = g_hash_table_new(g_str_hash, g_str_equal);
+	for (map = opt_maps; map != NULL && *map != NULL; map++)
+	{
+		gchar *sep = strchr(*map, '=');
+
+		if (sep == NULL || sep == *map)
+		{
+			g_printerr("Invalid language mapping \"%s\", expected EXT=LANG\n", *map);
+			return FALSE;
+		}
+		*sep = '\0';
+		g_hash_table_insert(ext_langs, *map, sep + 1);
+	}
+	return TRUE;
+}
+
+
+static gboolean parse_format(TMFileFormat *format)
+{
+	if (opt_format == NULL || strcmp(opt_format, "tagmanager") == 0)
+		*format = TM_FILE_FORMAT_TAGMANAGER;
+	else if (strcmp(opt_format, "pipe") == 0)
+		*format = TM_FILE_FORMAT_PIPE;
+	else if (strcmp(opt_format, "ctags") == 0)
+		*format = TM_FILE_FORMAT_CTAGS;
+	else
+	{
+		g_printerr("Unknown tags file format \"%s\"\n", opt_format);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+/* Repeats contents until it is at least opt_scale bytes long, to test large inputs */
+static gchar *scale_contents(gchar *contents, gsize *length)
+{
+	GString *str;
+
+	if (*length == 0 || *length >= (gsize) opt_scale)
+		return contents;
+
+	str = g_string_sized_new(opt_scale + *length + 1);
+	while (str->len < (gsize) opt_scale)
+	{
+		g_string_append_len(str, contents, *length);
+		if (contents[*length - 1] != '\n')
+			g_string_append_c(str, '\n');
+	}
+	g_free(contents);
+	*length = str->len;
+	return g_string_free(str, FALSE);
+}
+
+
+static void add_lang_stats(TMWorkObject *source_file, gsize length, gdouble best)
+{
+	const gchar *name = tm_source_file_get_lang_name(TM_SOURCE_FILE(source_file)->lang);
+	LangStats *lang = g_hash_table_lookup(lang_stats, name);
+
+	if (lang == NULL)
+	{
+		lang = g_new0(LangStats, 1);
+		g_hash_table_insert(lang_stats, (gpointer) name, lang);
+	}
+	lang->files++;
+	lang->bytes += length;
+	if (source_file->tags_array != NULL)
+		lang->tags += source_file->tags_array->len;
+	lang->seconds += best;
+}
+
+
+/* Parses a file opt_repeat times and returns it, or NULL if it has no parser.
+ * explicit is whether the file was given on the command line, as opposed to having been
+ * found in a directory. The file is read before parsing so that only the parsing is timed.
+ * When checking, a newline is appended like tm_workspace_create_global_tags() does. */
+static TMWorkObject *parse_file(const gchar *file_name, gboolean explicit, BenchStats *stats)
+{
+	const gchar *lang = get_file_lang(file_name);
+	TMWorkObject *source_file;
+	GTimer *timer;
+	gchar *contents;
+	gsize length;
+	gdouble best = -1;
+	gint i;
+
+	if (! g_file_get_contents(file_name, &contents, &length, NULL))
+	{
+		g_printerr("Cannot read %s\n", file_name);
+		return NULL;
+	}
+	if (opt_check)
+	{
+		contents = g_realloc(contents, length + 2);
+		contents[length++] = '\n';
+		contents[length] = '\0';
+	}
+	else if (opt_scale > 0)
+		contents = scale_contents(contents, &length);
+	source_file = tm_source_file_new(file_name, FALSE, lang);
+	if (source_file == NULL)
+	{
+		g_printerr("Cannot read %s\n", file_name);
+		g_free(contents);
+		return NULL;
+	}
+	if (lang != NULL && TM_SOURCE_FILE(source_file)->lang < 0)
+	{
+		g_printerr("Unknown language \"%s\" for %s\n", lang, file_name);
+		tm_source_file_free(source_file);
+		g_free(contents);
+		return NULL;
+	}
+
+	timer = g_timer_new();
+	for (i = 0; i < opt_repeat && length > 0; i++)
+	{
+		g_timer_start(timer);
+		g_timer_continue(stats->timer);
+		tm_source_file_buffer_update(source_file, (guchar *) contents, length, FALSE);
+		g_timer_stop(stats->timer);
+		g_timer_stop(timer);
+
+		if (TM_SOURCE_FILE(source_file)->lang < 0)
+		{
+			if (explicit)
+				g_printerr("No parser for %s\n", file_name);
+			tm_source_file_free(source_file);
+			g_timer_destroy(timer);
+			g_free(contents);
+			return NULL;
+		}
+		stats->files++;
+		stats->bytes += length;
+		if (source_file->tags_array != NULL)
+			stats->tags += source_file->tags_array->len;
+		if (best < 0 || g_timer_elapsed(timer, NULL) < best)
+			best = g_timer_elapsed(timer, NULL);
+	}
+	if (best >= 0)
+		add_lang_stats(source_file, length, best);
+	g_timer_destroy(timer);
+	g_free(contents);
+	return source_file;
+}
+
+
+static void parse_dir(const gchar *dir_name, GPtrArray *source_files, BenchStats *stats)
+{
+	GDir *dir = g_dir_open(dir_name, 0, NULL);
+	const gchar *name;
+
+	if (dir == NULL)
+	{
+		g_printerr("Cannot open directory %s\n", dir_name);
+		return;
+	}
+	while ((name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *path;
+
+		if (name[0] == '.')
+			continue;
+		path = g_build_filename(dir_name, name, NULL);
+		if (g_file_test(path, G_FILE_TEST_IS_DIR))
+			parse_dir(path, source_files, stats);
+		else if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+		{
+			TMWorkObject *source_file = parse_file(path, FALSE, stats);
+
+			if (source_file != NULL)
+				g_ptr_array_add(source_files, source_file);
+		}
+		g_free(path);
+	}
+	g_dir_close(dir);
+}
+
+
+/* Writes the tags of a source file like Geany's -g option does and returns them,
+ * or NULL if there are none */
+static gchar *get_tags_contents(TMWorkObject *source_file, TMFileFormat format, gsize *len)
+{
+	FILE *fp = tmpfile();
+	gchar *contents = NULL;
+	long size;
+
+	if (fp == NULL)
+		return NULL;
+	if (tm_workspace_write_global_tags(source_file->tags_array, fp, format) &&
+		(size = ftell(fp)) >= 0)
+	{
+		rewind(fp);
+		contents = g_malloc(size + 1);
+		*len = fread(contents, 1, size, fp);
+		contents[*len] = '\0';
+	}
+	fclose(fp);
+	return contents;
+}
+
+
+/* Returns the number of the line containing offset len */
+static guint count_lines(const gchar *str, gsize len)
+{
+	guint lines = 1;
+	gsize i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (str[i] == '\n')
+			lines++;
+	}
+	return lines;
+}
+
+
+/* Parses the source file of each expected tags file and compares the tags.
+ * Returns the number of failures. */
+static guint check_files(gchar **result_files, gint count, TMFileFormat format,
+		BenchStats *stats)
+{
+	guint failures = 0;
+	gchar **result;
+
+	for (result = result_files; result < result_files + count; result++)
+	{
+		gchar *source = g_strdup(*result);
+		gchar *ext = g_strrstr(source, ".tags");
+		TMWorkObject *source_file;
+		gchar *expected = NULL, *actual = NULL;
+		gsize expected_len = 0, actual_len = 0;
+		const gchar *error = NULL;
+		gsize i;
+
+		if (ext == NULL || ext[5] != '\0')
+			error = "not a .tags file";
+		else
+		{
+			*ext = '\0';
+			if (! g_file_get_contents(*result, &expected, &expected_len, NULL))
+				error = "cannot read the expected tags";
+			else if ((source_file = parse_file(source, TRUE, stats)) == NULL)
+				error = "cannot parse the source file";
+			else
+			{
+				actual = get_tags_contents(source_file, format, &actual_len);
+				tm_source_file_free(source_file);
+				if (actual == NULL)
+					error = "no tags found";
+			}
+		}
+		if (error != NULL)
+		{
+			g_printerr("FAIL: %s: %s\n", *result, error);
+			failures++;
+		}
+		else if (actual_len != expected_len || memcmp(actual, expected, actual_len) != 0)
+		{
+			for (i = 0; i < actual_len && i < expected_len && actual[i] == expected[i]; i++);
+			g_printerr("FAIL: %s: tags differ from line %u\n", *result, count_lines(expected, i));
+			failures++;
+		}
+		else if (! opt_quiet)
+			printf("PASS: %s\n", *result);
+
+		g_free(expected);
+		g_free(actual);
+		g_free(source);
+	}
+	return failures;
+}
+
+
+/* Returns the peak resident memory in KiB, or 0 if it is unknown */
+static gulong get_peak_memory(void)
+{
+#ifdef G_OS_UNIX
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+# ifdef __APPLE__
+		return usage.ru_maxrss / 1024;	/* in bytes on Mac OS X */
+# else
+		return usage.ru_maxrss;
+# endif
+#endif
+	return 0;
+}
+
+
+static void print_stats(const BenchStats *stats, FILE *fp)
+{
+	gdouble seconds = g_timer_elapsed(stats->timer, NULL);
+	gulong peak = get_peak_memory();
+
+	fprintf(fp, "%u files, %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT
+		" tags in %.3f s\n", stats->files, stats->bytes, stats->tags, seconds);
+	if (seconds > 0)
+		fprintf(fp, "%.1f files/s, %.1f KiB/s, %.1f tags/s\n", stats->files / seconds,
+			stats->bytes / 1024.0 / seconds, stats->tags / seconds);
+	if (peak > 0)
+		fprintf(fp, "peak memory: %lu KiB\n", peak);
+}
+
+
+static gint compare_strings(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const gchar **) a, *(const gchar **) b);
+}
+
+
+/* Returns the names of the parsed languages, sorted */
+static GPtrArray *get_lang_names(void)
+{
+	GPtrArray *names = g_ptr_array_new();
+	GHashTableIter iter;
+	gpointer name;
+
+	g_hash_table_iter_init(&iter, lang_stats);
+	while (g_hash_table_iter_next(&iter, &name, NULL))
+		g_ptr_array_add(names, name);
+	g_ptr_array_sort(names, compare_strings);
+	return names;
+}
+
+
+/* Writes the results of each language with one language per line, which is what
+ * load_baseline() expects */
+static gboolean write_json(const gchar *file_name)
+{
+	GPtrArray *names = get_lang_names();
+	FILE *fp = g_fopen(file_name, "w");
+	guint i;
+
+	if (fp == NULL)
+	{
+		g_printerr("Cannot write %s\n", file_name);
+		g_ptr_array_free(names, TRUE);
+		return FALSE;
+	}
+	fprintf(fp, "{\n\t\"repeat\": %d,\n\t\"scale\": %d,\n\t\"languages\": {\n",
+		opt_repeat, opt_scale);
+	for (i = 0; i < names->len; i++)
+	{
+		const gchar *name = g_ptr_array_index(names, i);
+		const LangStats *lang = g_hash_table_lookup(lang_stats, name);
+
+		fprintf(fp, "\t\t\"%s\": { \"files\": %u, \"bytes\": %" G_GUINT64_FORMAT
+			", \"tags\": %" G_GUINT64_FORMAT ", \"seconds\": %.6f }%s\n", name, lang->files,
+			lang->bytes, lang->tags, lang->seconds, i + 1 < names->len ? "," : "");
+	}
+	fprintf(fp, "\t}\n}\n");
+	fclose(fp);
+	g_ptr_array_free(names, TRUE);
+	return TRUE;
+}
+
+
+static gboolean read_json_number(const gchar *line, const gchar *key, gdouble *value)
+{
+	gchar *quoted = g_strdup_printf("\"%s\":", key);
+	const gchar *p = strstr(line, quoted);
+
+	g_free(quoted);
+	if (p == NULL)
+		return FALSE;
+	*value = g_ascii_strtod(p + strlen(key) + 3, NULL);
+	return TRUE;
+}
+
+
+/* Reads a file written by write_json() and returns a table of language names and
+ * LangStats, or NULL on error */
+static GHashTable *load_baseline(const gchar *file_name)
+{
+	GHashTable *baseline;
+	gchar *contents;
+	gchar **lines, **line;
+
+	if (! g_file_get_contents(file_name, &contents, NULL, NULL))
+	{
+		g_printerr("Cannot read %s\n", file_name);
+		return NULL;
+	}
+	baseline = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	lines = g_strsplit(contents, "\n", -1);
+	for (line = lines; *line != NULL; line++)
+	{
+		gchar *start = strchr(*line, '"');
+		gchar *end = start ? strchr(start + 1, '"') : NULL;
+		gdouble bytes, seconds;
+
+		if (end != NULL && read_json_number(end, "bytes", &bytes) &&
+			read_json_number(end, "seconds", &seconds))
+		{
+			LangStats *lang = g_new0(LangStats, 1);
+
+			lang->bytes = (guint64) bytes;
+			lang->seconds = seconds;
+			g_hash_table_insert(baseline, g_strndup(start + 1, end - start - 1), lang);
+		}
+	}
+	g_strfreev(lines);
+	g_free(contents);
+	return baseline;
+}
+
+
+/* Compares the throughput of each language with the baseline and returns the
+ * number of languages which are slower by more than opt_threshold percent */
+static guint check_baseline(GHashTable *baseline)
+{
+	GPtrArray *names = get_lang_names();
+	guint i, regressions = 0;
+
+	for (i = 0; i < names->len; i++)
+	{
+		const gchar *name = g_ptr_array_index(names, i);
+		const LangStats *lang = g_hash_table_lookup(lang_stats, name);
+		const LangStats *base = g_hash_table_lookup(baseline, name);
+		gdouble speed, base_speed, change;
+
+		if (base == NULL || base->seconds < MIN_BASELINE_SECONDS || base->bytes == 0 ||
+			lang->seconds <= 0)
+			continue;
+
+		speed = lang->bytes / lang->seconds;
+		base_speed = base->bytes / base->seconds;
+		change = (base_speed / speed - 1) * 100;
+		if (change > opt_threshold)
+		{
+			g_printerr("REGRESSION: %s is %.0f%% slower than the baseline (%.1f KiB/s, was %.1f KiB/s)\n",
+				name, change, speed / 1024, base_speed / 1024);
+			regressions++;
+		}
+		else if (! opt_quiet)
+			printf("%s: %+.0f%% time per byte compared to the baseline\n", name, change);
+	}
+	g_ptr_array_free(names, TRUE);
+	return regressions;
+}
+
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	BenchStats stats = { 0, 0, 0, NULL };
+	TMFileFormat format;
+	GPtrArray *source_files;
+	gint i, ret = 0;
+
+	context = g_option_context_new("FILE|DIR...");
+	g_option_context_set_summary(context,
+		"Parses source files with the tag manager and reports the parsing speed.");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (! g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	if (argc < 2 || opt_repeat < 1 || ! parse_maps() || ! parse_format(&format))
+	{
+		if (argc < 2)
+			g_printerr("No files given, see --help\n");
+		return 2;
+	}
+
+#if ! GLIB_CHECK_VERSION(2, 36, 0)
+	g_type_init();
+#endif
+	stats.timer = g_timer_new();
+	g_timer_stop(stats.timer);
+	lang_stats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+	if (opt_check)
+	{
+		guint failures = check_files(argv + 1, argc - 1, format, &stats);
+
+		if (! opt_quiet || failures > 0)
+			printf("%u of %d tests failed\n", failures, argc - 1);
+		if (! opt_quiet)
+			print_stats(&stats, stdout);
+		ret = failures > 0 ? 1 : 0;
+	}
+	else
+	{
+		FILE *fp = NULL;
+
+		source_files = g_ptr_array_new();
+		for (i = 1; i < argc; i++)
+		{
+			if (g_file_test(argv[i], G_FILE_TEST_IS_DIR))
+				parse_dir(argv[i], source_files, &stats);
+			else
+			{
+				TMWorkObject *source_file = parse_file(argv[i], TRUE, &stats);
+
+				/* files without a parser are only reported */
+				if (source_file != NULL)
+					g_ptr_array_add(source_files, source_file);
+				else if (! g_file_test(argv[i], G_FILE_TEST_EXISTS))
+					ret = 1;
+			}
+		}
+
+		if (opt_output != NULL)
+		{
+			GPtrArray *tags = g_ptr_array_new();
+			guint j;
+
+			for (j = 0; j < source_files->len; j++)
+			{
+				TMWorkObject *source_file = g_ptr_array_index(source_files, j);
+				guint k;
+
+				for (k = 0; source_file->tags_array && k < source_file->tags_array->len; k++)
+					g_ptr_array_add(tags, g_ptr_array_index(source_file->tags_array, k));
+			}
+			if (strcmp(opt_output, "-") == 0)
+				fp = stdout;
+			else
+				fp = g_fopen(opt_output, "w");
+
+			if (fp == NULL)
+			{
+				g_printerr("Cannot write %s\n", opt_output);
+				ret = 1;
+			}
+			else if (! tm_workspace_write_global_tags(tags, fp, format))
+			{
+				g_printerr("No tags written to %s\n", opt_output);
+				ret = 1;
+			}
+			if (fp != NULL && fp != stdout)
+				fclose(fp);
+			g_ptr_array_free(tags, TRUE);
+		}
+		if (! opt_quiet)
+			print_stats(&stats, fp == stdout ? stderr : stdout);
+
+		g_ptr_array_foreach(source_files, (GFunc) tm_source_file_free, NULL);
+		g_ptr_array_free(source_files, TRUE);
+	}
+
+	if (opt_json != NULL && ! write_json(opt_json))
+		ret = 1;
+	if (opt_baseline != NULL)
+	{
+		GHashTable *baseline = load_baseline(opt_baseline);
+
+		if (baseline == NULL || check_baseline(baseline) > 0)
+			ret = 1;
+		if (baseline != NULL)
+			g_hash_table_destroy(baseline);
+	}
+
+	g_timer_destroy(stats.timer);
+	g_hash_table_destroy(lang_stats);
+	g_hash_table_destroy(ext_langs);
+	return ret;
+}
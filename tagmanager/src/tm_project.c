@@ -57,16 +57,13 @@ static GList *glist_from_array(const char **arr)
 
 guint project_class_id = 0;
 
-gboolean tm_project_init(TMProject *project, const char *dir
+/* Sets up project for dir with its database in path (created if force is set) and adds
+ * it to the workspace */
+static gboolean tm_project_init_full(TMProject *project, const char *dir, const char *path
   , const char **sources, const char **ignore, gboolean force)
 {
 	struct stat s;
-	char *path;
 
-	g_return_val_if_fail((project && dir), FALSE);
-#ifdef TM_DEBUG
-	g_message("Initializing project %s", dir);
-#endif
 	if (0 == project_class_id)
 	{
 		project_class_id = tm_work_object_register(tm_project_free, tm_project_update
@@ -88,21 +85,37 @@ gboolean tm_project_init(TMProject *project, const char *dir
 	else
 		project->ignore = s_ignore;
 	project->file_list = NULL;
-	path = g_strdup_printf("%s/%s", project->dir, TM_FILE_NAME);
-	if ((0 != g_stat(path, &s)) || (0 == s.st_size))
-		force = TRUE;
 	if (FALSE == tm_work_object_init(&(project->work_object),
 		  project_class_id, path, force))
 	{
 		g_warning("Unable to init project file %s", path);
 		g_free(project->dir);
-		g_free(path);
 		return FALSE;
 	}
 	if (! tm_workspace_add_object(TM_WORK_OBJECT(project)))
 	{
 		g_warning("Unable to init project file %s", path);
 		g_free(project->dir);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean tm_project_init(TMProject *project, const char *dir
+  , const char **sources, const char **ignore, gboolean force)
+{
+	struct stat s;
+	char *path;
+
+	g_return_val_if_fail((project && dir), FALSE);
+#ifdef TM_DEBUG
+	g_message("Initializing project %s", dir);
+#endif
+	path = g_strdup_printf("%s/%s", dir, TM_FILE_NAME);
+	if ((0 != g_stat(path, &s)) || (0 == s.st_size))
+		force = TRUE;
+	if (! tm_project_init_full(project, dir, path, sources, ignore, force))
+	{
 		g_free(path);
 		return FALSE;
 	}
@@ -128,6 +141,20 @@ TMWorkObject *tm_project_new(const char *dir, const char **sources
 	return (TMWorkObject *) project;
 }
 
+TMWorkObject *tm_project_new_empty(const char *dir, const char *file_name)
+{
+	TMProject *project;
+
+	g_return_val_if_fail((dir && file_name), NULL);
+	project = g_new(TMProject, 1);
+	if (FALSE == tm_project_init_full(project, dir, file_name, NULL, NULL, TRUE))
+	{
+		g_free(project);
+		return NULL;
+	}
+	return (TMWorkObject *) project;
+}
+
 void tm_project_destroy(TMProject *project)
 {
 	g_return_if_fail (project != NULL);
@@ -259,6 +286,25 @@ TMWorkObject *tm_project_find_file(TMWorkObject *work_object
 	return NULL;
 }
 
+void tm_project_add_source_file(TMProject *project, TMWorkObject *source_file)
+{
+	g_return_if_fail(project && source_file);
+
+	source_file->parent = TM_WORK_OBJECT(project);
+	if (NULL == project->file_list)
+		project->file_list = g_ptr_array_new();
+	g_ptr_array_add(project->file_list, source_file);
+}
+
+gboolean tm_project_remove_source_file(TMProject *project, TMWorkObject *source_file)
+{
+	g_return_val_if_fail((project && source_file), FALSE);
+	if (!project->file_list || !g_ptr_array_remove_fast(project->file_list, source_file))
+		return FALSE;
+	tm_work_object_free(source_file);
+	return TRUE;
+}
+
 gboolean tm_project_remove_object(TMProject *project, TMWorkObject *w)
 {
 	guint i;
@@ -384,7 +430,7 @@ gboolean tm_project_open(TMProject *project, gboolean force)
 	tm_project_set_ignorelist(project);
 	if (NULL == (fp = g_fopen(project->work_object.file_name, "r")))
 		return FALSE;
-	while (NULL != (tag = tm_tag_new_from_file(source_file, fp, 0, FALSE)))
+	while (NULL != (tag = tm_tag_read(source_file, fp)))
 	{
 		if (tm_tag_file_t == tag->type)
 		{
@@ -406,6 +452,7 @@ gboolean tm_project_open(TMProject *project, gboolean force)
 			else
 			{
 				source_file->work_object.parent = TM_WORK_OBJECT(project);
+				source_file->work_object.analyze_time = tag->atts.file.timestamp;
 				source_file->lang = tag->atts.file.lang;
 				source_file->inactive = tag->atts.file.inactive;
 				if (!project->file_list)
@@ -444,32 +491,67 @@ gboolean tm_project_open(TMProject *project, gboolean force)
 	return TRUE;
 }
 
+/* Writes the file pseudo tag of source_file followed by its tags */
+static gboolean tm_project_write_file(TMWorkObject *source_file, FILE *fp)
+{
+	TMTag *tag = tm_tag_new(TM_SOURCE_FILE(source_file), NULL);
+	gboolean complete = (NULL == source_file->tags_array) ||
+		tm_tags_can_write(source_file->tags_array);
+	gboolean ret;
+	guint i;
+
+	if (NULL == tag)
+		return FALSE;
+	/* a file whose tags can't be written is stored as not parsed yet, so that
+	 * tm_project_open() callers comparing the time stamp parse it again */
+	if (!complete)
+		tag->atts.file.timestamp = 0;
+	ret = tm_tag_write(tag, fp, tm_tag_attr_max_t);
+	tm_tag_unref(tag);
+	if (complete && (NULL != source_file->tags_array))
+	{
+		for (i = 0; ret && (i < source_file->tags_array->len); ++i)
+			ret = tm_tag_write(TM_TAG(source_file->tags_array->pdata[i]), fp, tm_tag_attr_max_t);
+	}
+	return ret;
+}
+
 gboolean tm_project_save(TMProject *project)
 {
 	guint i;
 	FILE *fp;
+	char *tmp_name;
+	gboolean ret = TRUE;
 
 	if (!project)
 		return FALSE;
-	if (NULL == (fp = g_fopen(project->work_object.file_name, "w")))
+	/* write a new file and replace the database with it, so that it is never incomplete */
+	tmp_name = g_strconcat(project->work_object.file_name, ".tmp", NULL);
+	if (NULL == (fp = g_fopen(tmp_name, "w")))
 	{
 		g_warning("Unable to save project %s", project->work_object.file_name);
+		g_free(tmp_name);
 		return FALSE;
 	}
 	if (project->file_list)
 	{
-		for (i=0; i < project->file_list->len; ++i)
-		{
-			if (FALSE == tm_source_file_write(TM_WORK_OBJECT(project->file_list->pdata[i])
-				, fp, tm_tag_attr_max_t))
-			{
-				fclose(fp);
-				return FALSE;
-			}
-		}
+		for (i=0; ret && (i < project->file_list->len); ++i)
+			ret = tm_project_write_file(TM_WORK_OBJECT(project->file_list->pdata[i]), fp);
 	}
-	fclose(fp);
-	return TRUE;
+	if (0 != fclose(fp))
+		ret = FALSE;
+#ifdef G_OS_WIN32
+	if (ret)
+		g_unlink(project->work_object.file_name);
+#endif
+	if (!ret || (0 != g_rename(tmp_name, project->work_object.file_name)))
+	{
+		g_warning("Unable to save project %s", project->work_object.file_name);
+		g_unlink(tmp_name);
+		ret = FALSE;
+	}
+	g_free(tmp_name);
+	return ret;
 }
 
 static void tm_project_add_file_recursive(TMFileEntry *entry
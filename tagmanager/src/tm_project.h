@@ -81,6 +81,18 @@ gboolean tm_project_init(TMProject *project, const char *dir
 TMWorkObject *tm_project_new(const char *dir, const char **sources
   , const char **ignore, gboolean force);
 
+/*! Creates an empty project and adds it to the workspace, without reading or
+ scanning anything. The tags of its files are not combined into a project tags
+ array unless tm_project_update() is used, instead tm_workspace_find() and
+ tm_workspace_find_scoped() search the files one by one, so that adding, updating
+ and removing a file doesn't need all the project tags to be sorted again.
+ \param dir The top level directory for the project.
+ \param file_name The project database used by tm_project_save(), which is created
+ if it doesn't exist.
+ \sa tm_project_add_source_file()
+*/
+TMWorkObject *tm_project_new_empty(const char *dir, const char *file_name);
+
 /*! Destroys the contents of the project. Note that the tags are owned by the
  source files of the project, so they are also destroyed as each source file
  is deallocated using tm_source_file_free(). If the tags are to be used after
@@ -108,7 +120,8 @@ void tm_project_free(gpointer project);
 */
 gboolean tm_project_open(TMProject *project, gboolean force);
 
-/*! Saves the project in the project database file.
+/*! Saves the project in the project database file. Each file is written as a file
+ pseudo tag, with the analyze_time of the file as time stamp, followed by its tags.
  \param project The project to save.
  \return TRUE on success, FALSE on failure.
 */
@@ -124,6 +137,21 @@ gboolean tm_project_save(TMProject *project);
 gboolean tm_project_add_file(TMProject *project, const char *file_name
   , gboolean update);
 
+/*! Adds a source file to the project without looking for it in the workspace or
+ updating the project tags array.
+ \param project The project to add the file to.
+ \param source_file The source file, which then belongs to the project.
+*/
+void tm_project_add_source_file(TMProject *project, TMWorkObject *source_file);
+
+/*! Removes a source file added with tm_project_add_source_file() and frees it,
+ without updating the project tags array.
+ \param project The project from which the file is to be removed.
+ \param source_file The source file to remove.
+ \return TRUE on success, FALSE if the file doesn't belong to the project.
+*/
+gboolean tm_project_remove_source_file(TMProject *project, TMWorkObject *source_file);
+
 /*! Finds a file in a project. If the file exists, returns a pointer to it,
  else returns NULL. This is the overloaded function TMFindFunc for TMProject.
  You should not have to call this function directly since this is automatically
@@ -33,6 +33,15 @@
 guint source_file_class_id = 0;
 static TMSourceFile *current_source_file = NULL;
 
+/* Returns the pass to run after passCount when the parser asked for another one.
+ * Passes 0 and 1 use the same source form (they only differ for the C parser, which
+ * never asks for a retry after pass 0), so a retry after pass 0 goes straight to
+ * pass 2 instead of parsing the file once more for nothing. */
+static int next_pass(int passCount)
+{
+	return (0 == passCount) ? 2 : passCount + 1;
+}
+
 gboolean tm_source_file_init(TMSourceFile *source_file, const char *file_name
   , gboolean update, const char* name)
 {
@@ -133,6 +142,7 @@ gboolean tm_source_file_parse(TMSourceFile *source_file)
 	if (source_file->lang < 0 || ! LanguageTable [source_file->lang]->enabled)
 		return status;
 
+	tm_tag_arena_begin();
 	while ((TRUE == status) && (passCount < 3))
 	{
 		if (source_file->work_object.tags_array)
@@ -152,10 +162,12 @@ gboolean tm_source_file_parse(TMSourceFile *source_file)
 		else
 		{
 			g_warning("%s: Unable to open %s", G_STRFUNC, file_name);
+			tm_tag_arena_end();
 			return FALSE;
 		}
-		++ passCount;
+		passCount = next_pass(passCount);
 	}
+	tm_tag_arena_end();
 	return status;
 }
 
@@ -203,6 +215,8 @@ gboolean tm_source_file_buffer_parse(TMSourceFile *source_file, guchar* text_buf
 	else
 	{
 		int passCount = 0;
+
+		tm_tag_arena_begin();
 		while ((TRUE == status) && (passCount < 3))
 		{
 			if (source_file->work_object.tags_array)
@@ -222,10 +236,12 @@ gboolean tm_source_file_buffer_parse(TMSourceFile *source_file, guchar* text_buf
 			else
 			{
 				g_warning("Unable to open %s", file_name);
+				tm_tag_arena_end();
 				return FALSE;
 			}
-			++ passCount;
+			passCount = next_pass(passCount);
 		}
+		tm_tag_arena_end();
 		return TRUE;
 	}
 	return status;
@@ -249,8 +265,7 @@ void tm_source_file_set_tag_arglist(const char *tag_name, const char *arglist)
 	if (tags != NULL && count == 1)
 	{
 		tag = tags[0];
-		g_free(tag->atts.entry.arglist);
-		tag->atts.entry.arglist = g_strdup(arglist);
+		tm_tag_set_arglist(tag, arglist);
 	}
 }
 
@@ -315,6 +330,28 @@ gboolean tm_source_file_buffer_update(TMWorkObject *source_file, guchar* text_bu
 }
 
 
+gboolean tm_source_file_read_tags(TMWorkObject *source_file, FILE *fp, gboolean update_parent)
+{
+	GPtrArray *tags_array = tm_tags_read(TM_SOURCE_FILE(source_file), fp);
+
+	if (NULL == tags_array)
+		return FALSE;
+	/* keep the array others may point to, the tags were written sorted */
+	if (NULL == source_file->tags_array)
+		source_file->tags_array = tags_array;
+	else
+	{
+		tm_tags_array_free(source_file->tags_array, FALSE);
+		g_ptr_array_set_size(source_file->tags_array, tags_array->len);
+		memcpy(source_file->tags_array->pdata, tags_array->pdata, tags_array->len * sizeof(gpointer));
+		g_ptr_array_free(tags_array, TRUE);
+	}
+	if ((source_file->parent) && update_parent)
+		tm_work_object_update(source_file->parent, TRUE, FALSE, TRUE);
+	return TRUE;
+}
+
+
 gboolean tm_source_file_write(TMWorkObject *source_file, FILE *fp, guint attrs)
 {
 	TMTag *tag;
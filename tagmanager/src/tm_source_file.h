@@ -98,6 +98,17 @@ gboolean tm_source_file_update(TMWorkObject *source_file, gboolean force
 gboolean tm_source_file_buffer_update(TMWorkObject *source_file, guchar* text_buf,
 			gint buf_size, gboolean update_parent);
 
+/*!
+ Replaces the tags of a source file with tags written by tm_tags_write_full(), as if
+ the file had been parsed.
+ \param source_file The source file to update.
+ \param fp FILE pointer from which the tags are read.
+ \param update_parent If set to TRUE, sends an update signal to parent if required.
+ \return TRUE if the tags were read, FALSE otherwise, in which case the tags are unchanged.
+ \sa tm_source_file_buffer_update()
+*/
+gboolean tm_source_file_read_tags(TMWorkObject *source_file, FILE *fp, gboolean update_parent);
+
 /* Parses the source file and regenarates the tags.
  \param source_file The source file to parse
  \return TRUE on success, FALSE on failure
@@ -9,6 +9,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <glib-object.h>
 
 #include "general.h"
@@ -102,47 +103,47 @@ enum
 static guint *s_sort_attrs = NULL;
 static gboolean s_partial = FALSE;
 
-static const char *s_tag_type_names[] = {
-	"class", /* classes */
-	"enum", /* enumeration names */
-	"enumerator", /* enumerators (values inside an enumeration) */
-	"externvar", /* external variable declarations */
-	"field", /* fields */
-	"function", /*  function definitions */
-	"interface", /* interfaces */
-	"macro", /* macro definitions */
-	"member", /* class, struct, and union members */
-	"method", /* methods */
-	"namespace", /* namespaces */
-	"package", /* packages */
-	"prototype", /* function prototypes */
-	"struct", /* structure names */
-	"typedef", /* typedefs */
-	"union", /* union names */
-	"variable", /* variable definitions */
-	"other" /* Other tag type (non C/C++/Java) */
+typedef struct
+{
+	const char *name;
+	TMTagType type;
+} TagTypeName;
+
+/* sorted by name for bsearch() */
+static const TagTypeName s_tag_type_names[] = {
+	{"class", tm_tag_class_t}, /* classes */
+	{"enum", tm_tag_enum_t}, /* enumeration names */
+	{"enumerator", tm_tag_enumerator_t}, /* enumerators (values inside an enumeration) */
+	{"externvar", tm_tag_externvar_t}, /* external variable declarations */
+	{"field", tm_tag_field_t}, /* fields */
+	{"function", tm_tag_function_t}, /*  function definitions */
+	{"interface", tm_tag_interface_t}, /* interfaces */
+	{"macro", tm_tag_macro_t}, /* macro definitions */
+	{"member", tm_tag_member_t}, /* class, struct, and union members */
+	{"method", tm_tag_method_t}, /* methods */
+	{"namespace", tm_tag_namespace_t}, /* namespaces */
+	{"other", tm_tag_other_t}, /* Other tag type (non C/C++/Java) */
+	{"package", tm_tag_package_t}, /* packages */
+	{"prototype", tm_tag_prototype_t}, /* function prototypes */
+	{"struct", tm_tag_struct_t}, /* structure names */
+	{"typedef", tm_tag_typedef_t}, /* typedefs */
+	{"union", tm_tag_union_t}, /* union names */
+	{"variable", tm_tag_variable_t} /* variable definitions */
 };
 
-static int s_tag_types[] = {
-	tm_tag_class_t,
-	tm_tag_enum_t,
-	tm_tag_enumerator_t,
-	tm_tag_externvar_t,
-	tm_tag_field_t,
-	tm_tag_function_t,
-	tm_tag_interface_t,
-	tm_tag_macro_t,
-	tm_tag_member_t,
-	tm_tag_method_t,
-	tm_tag_namespace_t,
-	tm_tag_package_t,
-	tm_tag_prototype_t,
-	tm_tag_struct_t,
-	tm_tag_typedef_t,
-	tm_tag_union_t,
-	tm_tag_variable_t,
-	tm_tag_other_t
-};
+/* Tag types of the kinds of each parser, indexed by language and kind index.
+ * They are computed the first time a parser creates a tag. */
+static GPtrArray *s_kind_types = NULL;
+
+/* Storage for the strings of the tags created while parsing a file, so they don't need an
+ * allocation each. It is freed when the last tag using it is destroyed. */
+typedef struct _TMTagArena
+{
+	gint refcount;
+	GStringChunk *strings;
+} TMTagArena;
+
+static TMTagArena *s_arena = NULL;
 
 GType tm_tag_get_type(void)
 {
@@ -155,28 +156,117 @@ GType tm_tag_get_type(void)
 	return gtype;
 }
 
+static int compare_tag_type_name(const void *name, const void *entry)
+{
+	return strcmp(name, ((const TagTypeName *) entry)->name);
+}
+
 static int get_tag_type(const char *tag_name)
 {
-	unsigned int i;
-	int cmp;
+	const TagTypeName *entry;
+
 	g_return_val_if_fail(tag_name, 0);
-	for (i=0; i < sizeof(s_tag_type_names)/sizeof(char *); ++i)
-	{
-		cmp = strcmp(tag_name, s_tag_type_names[i]);
-		if (0 == cmp)
-			return s_tag_types[i];
-		else if (cmp < 0)
-			break;
-	}
-	/* other is not checked above as it is last, not sorted alphabetically */
-	if (strcmp(tag_name, "other") == 0)
-		return tm_tag_other_t;
+	entry = bsearch(tag_name, s_tag_type_names, G_N_ELEMENTS(s_tag_type_names),
+		sizeof(TagTypeName), compare_tag_type_name);
+	if (entry != NULL)
+		return entry->type;
 #ifdef TM_DEBUG
 	fprintf(stderr, "Unknown tag type %s\n", tag_name);
 #endif
 	return tm_tag_undef_t;
 }
 
+/* Returns the tag types of the kinds of the given language, computing them on first use */
+static const TMTagType *get_kind_types(langType lang)
+{
+	TMTagType *types;
+	const parserDefinition *parser;
+	unsigned int i;
+
+	if (lang < 0 || NULL == LanguageTable)
+		return NULL;
+
+	if (NULL == s_kind_types)
+		s_kind_types = g_ptr_array_new();
+	if ((guint) lang >= s_kind_types->len)
+		g_ptr_array_set_size(s_kind_types, lang + 1);
+
+	types = g_ptr_array_index(s_kind_types, lang);
+	if (NULL == types)
+	{
+		parser = LanguageTable[lang];
+		types = g_new(TMTagType, MAX(parser->kindCount, 1));
+		for (i = 0; i < parser->kindCount; ++i)
+			types[i] = get_tag_type(parser->kinds[i].name);
+		g_ptr_array_index(s_kind_types, lang) = types;
+	}
+	return types;
+}
+
+/* Maps the kind of a tag entry to a tag type. Entries of kinds from the parser's table
+ * are looked up by index (or by the address of the kind name), others by name. */
+static int get_entry_tag_type(const tagEntryInfo *tag_entry, langType lang)
+{
+	const TMTagType *types = get_kind_types(lang);
+
+	if (NULL != types)
+	{
+		const parserDefinition *parser = LanguageTable[lang];
+		int i = tag_entry->kindIndex;
+
+		if (i >= 0 && (unsigned int) i < parser->kindCount &&
+			parser->kinds[i].name == tag_entry->kindName)
+			return types[i];
+		for (i = 0; (unsigned int) i < parser->kindCount; ++i)
+		{
+			if (parser->kinds[i].name == tag_entry->kindName)
+				return types[i];
+		}
+	}
+	return get_tag_type(tag_entry->kindName);
+}
+
+void tm_tag_arena_begin(void)
+{
+	tm_tag_arena_end();
+	s_arena = g_slice_new(TMTagArena);
+	s_arena->refcount = 1;
+	s_arena->strings = g_string_chunk_new(4096);
+}
+
+static void tag_arena_unref(TMTagArena *arena)
+{
+	if (g_atomic_int_dec_and_test(&arena->refcount))
+	{
+		g_string_chunk_free(arena->strings);
+		g_slice_free(TMTagArena, arena);
+	}
+}
+
+void tm_tag_arena_end(void)
+{
+	if (NULL != s_arena)
+	{
+		tag_arena_unref(s_arena);
+		s_arena = NULL;
+	}
+}
+
+/* Copies a string of the tag into its arena, if any */
+static char *tag_strdup(TMTag *tag, const char *str)
+{
+	if (NULL != tag->arena)
+		return g_string_chunk_insert(tag->arena->strings, str);
+	return g_strdup(str);
+}
+
+void tm_tag_set_arglist(TMTag *tag, const char *arglist)
+{
+	if (NULL == tag->arena)
+		g_free(tag->atts.entry.arglist);
+	tag->atts.entry.arglist = tag_strdup(tag, arglist);
+}
+
 static char get_tag_impl(const char *impl)
 {
 	if ((0 == strcmp("virtual", impl))
@@ -220,7 +310,7 @@ gboolean tm_tag_init(TMTag *tag, TMSourceFile *file, const tagEntryInfo *tag_ent
 		{
 			tag->name = g_strdup(file->work_object.file_name);
 			tag->type = tm_tag_file_t;
-			/* tag->atts.file.timestamp = file->work_object.analyze_time; */
+			tag->atts.file.timestamp = file->work_object.analyze_time;
 			tag->atts.file.lang = file->lang;
 			tag->atts.file.inactive = FALSE;
 			return TRUE;
@@ -231,22 +321,27 @@ gboolean tm_tag_init(TMTag *tag, TMSourceFile *file, const tagEntryInfo *tag_ent
 		/* This is a normal tag entry */
 		if (NULL == tag_entry->name)
 			return FALSE;
-		tag->name = g_strdup(tag_entry->name);
-		tag->type = get_tag_type(tag_entry->kindName);
+		if (NULL != s_arena)
+		{
+			g_atomic_int_inc(&s_arena->refcount);
+			tag->arena = s_arena;
+		}
+		tag->name = tag_strdup(tag, tag_entry->name);
+		tag->type = get_entry_tag_type(tag_entry, file ? file->lang : LANG_IGNORE);
 		tag->atts.entry.local = tag_entry->isFileScope;
 		tag->atts.entry.pointerOrder = 0;	/* backward compatibility (use var_type instead) */
 		tag->atts.entry.line = tag_entry->lineNumber;
 		if (NULL != tag_entry->extensionFields.arglist)
-			tag->atts.entry.arglist = g_strdup(tag_entry->extensionFields.arglist);
+			tag->atts.entry.arglist = tag_strdup(tag, tag_entry->extensionFields.arglist);
 		if ((NULL != tag_entry->extensionFields.scope[1]) &&
-			(isalpha(tag_entry->extensionFields.scope[1][0]) ||
+			(g_ascii_isalpha(tag_entry->extensionFields.scope[1][0]) ||
 			 tag_entry->extensionFields.scope[1][0] == '_' ||
 			 tag_entry->extensionFields.scope[1][0] == '$'))
-			tag->atts.entry.scope = g_strdup(tag_entry->extensionFields.scope[1]);
+			tag->atts.entry.scope = tag_strdup(tag, tag_entry->extensionFields.scope[1]);
 		if (tag_entry->extensionFields.inheritance != NULL)
-			tag->atts.entry.inheritance = g_strdup(tag_entry->extensionFields.inheritance);
+			tag->atts.entry.inheritance = tag_strdup(tag, tag_entry->extensionFields.inheritance);
 		if (tag_entry->extensionFields.varType != NULL)
-			tag->atts.entry.var_type = g_strdup(tag_entry->extensionFields.varType);
+			tag->atts.entry.var_type = tag_strdup(tag, tag_entry->extensionFields.varType);
 		if (tag_entry->extensionFields.access != NULL)
 			tag->atts.entry.access = get_tag_access(tag_entry->extensionFields.access);
 		if (tag_entry->extensionFields.implementation != NULL)
@@ -630,8 +725,212 @@ gboolean tm_tag_write(TMTag *tag, FILE *fp, guint attrs)
 		return FALSE;
 }
 
+static const char *get_tag_type_name(TMTagType type)
+{
+	guint i;
+
+	if (tm_tag_macro_with_arg_t == type)
+		type = tm_tag_macro_t;
+	for (i = 0; i < G_N_ELEMENTS(s_tag_type_names); ++i)
+	{
+		if (s_tag_type_names[i].type == type)
+			return s_tag_type_names[i].name;
+	}
+	return "other";
+}
+
+static const char *get_tag_access_name(char access)
+{
+	switch (access)
+	{
+		case TAG_ACCESS_PUBLIC: return "public";
+		case TAG_ACCESS_PROTECTED: return "protected";
+		case TAG_ACCESS_PRIVATE: return "private";
+		case TAG_ACCESS_FRIEND: return "friend";
+		case TAG_ACCESS_DEFAULT: return "default";
+	}
+	return NULL;
+}
+
+/* Writes a tag in the format read by tm_tag_init_from_file_alt() */
+static gboolean tm_tag_write_pipe(TMTag *tag, FILE *fp)
+{
+	return fprintf(fp, "%s|%s|%s|\n", tag->name,
+		tag->atts.entry.var_type ? tag->atts.entry.var_type : "",
+		tag->atts.entry.arglist ? tag->atts.entry.arglist : "") > 0;
+}
+
+/* Writes a tag in the format read by tm_tag_init_from_file_ctags() */
+static gboolean tm_tag_write_ctags(TMTag *tag, FILE *fp)
+{
+	const char *file_name = NULL;
+	const char *access = get_tag_access_name(tag->atts.entry.access);
+
+	if (NULL != tag->atts.entry.file)
+		file_name = tag->atts.entry.file->work_object.file_name;
+	fprintf(fp, "%s\t%s\t%lu;\"\tkind:%s", tag->name, file_name ? file_name : "",
+		tag->atts.entry.line, get_tag_type_name(tag->type));
+	if (NULL != tag->atts.entry.scope)
+		fprintf(fp, "\tclass:%s", tag->atts.entry.scope);
+	if (NULL != tag->atts.entry.inheritance)
+		fprintf(fp, "\tinherits:%s", tag->atts.entry.inheritance);
+	if (NULL != tag->atts.entry.arglist)
+		fprintf(fp, "\tsignature:%s", tag->atts.entry.arglist);
+	if (tag->atts.entry.local)
+		fprintf(fp, "\tfile:");
+	if (NULL != access)
+		fprintf(fp, "\taccess:%s", access);
+	if (TAG_IMPL_VIRTUAL == tag->atts.entry.impl)
+		fprintf(fp, "\timplementation:virtual");
+	return fprintf(fp, "\n") > 0;
+}
+
+gboolean tm_tags_write(GPtrArray *tags_array, FILE *fp, TMFileFormat format)
+{
+	guint i;
+
+	switch (format)
+	{
+		case TM_FILE_FORMAT_TAGMANAGER:
+			fprintf(fp, "# format=tagmanager\n");
+			break;
+		case TM_FILE_FORMAT_PIPE:
+			fprintf(fp, "# format=pipe\n");
+			break;
+		case TM_FILE_FORMAT_CTAGS:
+			fprintf(fp, "!_TAG_FILE_FORMAT\t2\t/extended format/\n");
+			break;
+	}
+	for (i = 0; i < tags_array->len; ++i)
+	{
+		TMTag *tag = TM_TAG(tags_array->pdata[i]);
+		gboolean ret = TRUE;
+
+		switch (format)
+		{
+			case TM_FILE_FORMAT_TAGMANAGER:
+				ret = tm_tag_write(tag, fp, tm_tag_attr_type_t | tm_tag_attr_scope_t
+					| tm_tag_attr_arglist_t | tm_tag_attr_vartype_t | tm_tag_attr_pointer_t);
+				break;
+			case TM_FILE_FORMAT_PIPE:
+				if (tm_tag_file_t != tag->type)
+					ret = tm_tag_write_pipe(tag, fp);
+				break;
+			case TM_FILE_FORMAT_CTAGS:
+				if (tm_tag_file_t != tag->type)
+					ret = tm_tag_write_ctags(tag, fp);
+				break;
+		}
+		if (! ret)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Adds the length of s to *len and checks that tm_tag_init_from_file() can read it back */
+static gboolean tag_string_fits(const char *s, gsize *len)
+{
+	const guchar *p;
+
+	if (NULL == s)
+		return TRUE;
+	for (p = (const guchar *) s; '\0' != *p; ++p)
+	{
+		if ((*p >= TA_NAME) || ('\n' == *p))
+			return FALSE;
+	}
+	*len += p - (const guchar *) s;
+	return TRUE;
+}
+
+static gboolean tag_fits(const TMTag *tag)
+{
+	gsize len = 0;
+
+	if (!isprint((guchar) tag->name[0]) || (tm_tag_file_t == tag->type))
+		return FALSE;
+	if (!tag_string_fits(tag->name, &len) ||
+		!tag_string_fits(tag->atts.entry.arglist, &len) ||
+		!tag_string_fits(tag->atts.entry.scope, &len) ||
+		!tag_string_fits(tag->atts.entry.inheritance, &len) ||
+		!tag_string_fits(tag->atts.entry.var_type, &len))
+		return FALSE;
+	/* leave room for the numeric attributes and the attribute markers */
+	return len + 128 < BUFSIZ;
+}
+
+gboolean tm_tags_can_write(const GPtrArray *tags_array)
+{
+	guint i;
+
+	for (i = 0; i < tags_array->len; ++i)
+	{
+		if (!tag_fits(TM_TAG(tags_array->pdata[i])))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean tm_tags_write_full(GPtrArray *tags_array, FILE *fp)
+{
+	guint i;
+
+	if (!tm_tags_can_write(tags_array))
+		return FALSE;
+	fprintf(fp, "# format=tagmanager\n");
+	for (i = 0; i < tags_array->len; ++i)
+	{
+		if (!tm_tag_write(TM_TAG(tags_array->pdata[i]), fp, tm_tag_attr_max_t))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+TMTag *tm_tag_read(TMSourceFile *file, FILE *fp)
+{
+	TMTag *tag;
+
+	TAG_NEW(tag);
+	tag->atts.entry.access = TAG_ACCESS_UNKNOWN;
+	tag->atts.entry.impl = TAG_IMPL_UNKNOWN;
+	if (!tm_tag_init_from_file(tag, file, fp))
+	{
+		/* tm_tag_init_from_file() sets the refcount first thing */
+		tm_tag_unref(tag);
+		return NULL;
+	}
+	return tag;
+}
+
+GPtrArray *tm_tags_read(TMSourceFile *file, FILE *fp)
+{
+	GPtrArray *tags_array;
+	gchar buf[BUFSIZ];
+	TMTag *tag;
+
+	if (NULL == fgets(buf, BUFSIZ, fp) || strcmp(buf, "# format=tagmanager\n") != 0)
+		return NULL;
+
+	tags_array = g_ptr_array_new();
+	while (NULL != (tag = tm_tag_read(file, fp)))
+		g_ptr_array_add(tags_array, tag);
+	/* a line which couldn't be read means the file is damaged */
+	if (ferror(fp) || !feof(fp))
+	{
+		tm_tags_array_free(tags_array, TRUE);
+		return NULL;
+	}
+	return tags_array;
+}
+
 static void tm_tag_destroy(TMTag *tag)
 {
+	if (NULL != tag->arena)
+	{
+		/* the strings belong to the arena */
+		tag_arena_unref(tag->arena);
+		return;
+	}
 	g_free(tag->name);
 	if (tm_tag_file_t != tag->type)
 	{
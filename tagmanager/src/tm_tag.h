@@ -149,6 +149,7 @@ typedef struct _TMTag
 		} file;
 	} atts;
 	gint refcount; /*!< the reference count of the tag */
+	struct _TMTagArena *arena; /*!< storage of the tag's strings, or NULL if they are allocated separately */
 } TMTag;
 
 typedef enum {
@@ -214,6 +215,25 @@ gboolean tm_tag_init_from_file_ctags(TMTag *tag, TMSourceFile *file, FILE *fp);
 */
 TMTag *tm_tag_new(TMSourceFile *file, const tagEntryInfo *tag_entry);
 
+/*!
+ Starts a new string arena. The strings of the tags created by tm_tag_new() until
+ tm_tag_arena_end() is called are stored in it, and it is freed together with the last
+ of these tags. This is used while parsing a source file.
+*/
+void tm_tag_arena_begin(void);
+
+/*!
+ Stops storing the strings of new tags in the current arena.
+*/
+void tm_tag_arena_end(void);
+
+/*!
+ Replaces the argument list of a tag.
+ \param tag The tag.
+ \param arglist The new argument list, which is copied.
+*/
+void tm_tag_set_arglist(TMTag *tag, const char *arglist);
+
 /*!
  Same as tm_tag_new() except that the tag attributes are read from file.
  \param mode langType to use for the tag.
@@ -229,6 +249,51 @@ TMTag *tm_tag_new_from_file(TMSourceFile *file, FILE *fp, gint mode, TMFileForma
 */
 gboolean tm_tag_write(TMTag *tag, FILE *file, guint attrs);
 
+/*!
+ Writes tags to the given FILE * in the given format, with a header line so that
+ tm_workspace_load_global_tags() can detect the format.
+ \param tags_array The tags to write.
+ \param fp FILE pointer to which the tags are written.
+ \param format The format of the file.
+ \return TRUE on success, FALSE on failure.
+*/
+gboolean tm_tags_write(GPtrArray *tags_array, FILE *fp, TMFileFormat format);
+
+/*!
+ Checks whether tm_tag_write() with all attributes writes the given tags so that
+ tm_tag_read() restores them unchanged. File pseudo tags are not supported.
+ \param tags_array The tags to check.
+ \return TRUE if the tags can be written.
+*/
+gboolean tm_tags_can_write(const GPtrArray *tags_array);
+
+/*!
+ Writes all attributes of the given tags in the tagmanager format so that
+ tm_tags_read() restores them unchanged. File pseudo tags are not supported.
+ \param tags_array The tags to write.
+ \param fp FILE pointer to which the tags are written.
+ \return FALSE on failure or if a tag contains text which couldn't be read back,
+ in which case fp contains an incomplete list.
+*/
+gboolean tm_tags_write_full(GPtrArray *tags_array, FILE *fp);
+
+/*!
+ Reads a tag written by tm_tag_write(). Unlike tm_tag_new_from_file(), all attributes
+ are kept as they were written.
+ \param file The source file the tag belongs to, if it isn't a file pseudo tag.
+ \param fp FILE pointer from which the tag is read.
+ \return A new tag, or NULL at the end of the file or if the line couldn't be read.
+*/
+TMTag *tm_tag_read(TMSourceFile *file, FILE *fp);
+
+/*!
+ Reads tags written by tm_tags_write_full().
+ \param file The source file the tags belong to.
+ \param fp FILE pointer from which the tags are read.
+ \return A new array of tags, or NULL if fp doesn't contain a complete list of tags.
+*/
+GPtrArray *tm_tags_read(TMSourceFile *file, FILE *fp);
+
 /*!
  Inbuilt tag comparison function. Do not call directly since it needs some
  static variables to be set. Always use tm_tags_sort() and tm_tags_dedup()
@@ -281,6 +281,24 @@ static gchar *create_temp_file(const gchar *tpl)
 	return name;
 }
 
+gboolean tm_workspace_write_global_tags(GPtrArray *tags, FILE *fp, TMFileFormat format)
+{
+	GPtrArray *tags_array;
+	gboolean status;
+
+	tags_array = tm_tags_extract(tags, tm_tag_max_t);
+	if ((NULL == tags_array) || (0 == tags_array->len))
+	{
+		if (tags_array)
+			g_ptr_array_free(tags_array, TRUE);
+		return FALSE;
+	}
+	tm_tags_sort(tags_array, global_tags_sort_attrs, TRUE);
+	status = tm_tags_write(tags_array, fp, format);
+	g_ptr_array_free(tags_array, TRUE);
+	return status;
+}
+
 gboolean tm_workspace_create_global_tags(const char *pre_process, const char **includes,
 	int includes_count, const char *tags_file, int lang)
 {
@@ -290,10 +308,9 @@ gboolean tm_workspace_create_global_tags(const char *pre_process, const char **i
 #endif
 	int idx_inc;
 	char *command;
-	guint i;
 	FILE *fp;
 	TMWorkObject *source_file;
-	GPtrArray *tags_array;
+	gboolean status;
 	GHashTable *includes_files_hash;
 	GList *includes_files = NULL;
 	gchar *temp_file = create_temp_file("tmp_XXXXXX.cpp");
@@ -432,35 +449,17 @@ gboolean tm_workspace_create_global_tags(const char *pre_process, const char **i
 		tm_source_file_free(source_file);
 		return FALSE;
 	}
-	tags_array = tm_tags_extract(source_file->tags_array, tm_tag_max_t);
-	if ((NULL == tags_array) || (0 == tags_array->len))
-	{
-		if (tags_array)
-			g_ptr_array_free(tags_array, TRUE);
-		tm_source_file_free(source_file);
-		return FALSE;
-	}
-	if (FALSE == tm_tags_sort(tags_array, global_tags_sort_attrs, TRUE))
-	{
-		tm_source_file_free(source_file);
-		return FALSE;
-	}
 	if (NULL == (fp = g_fopen(tags_file, "w")))
 	{
 		tm_source_file_free(source_file);
 		return FALSE;
 	}
-	fprintf(fp, "# format=tagmanager\n");
-	for (i = 0; i < tags_array->len; ++i)
-	{
-		tm_tag_write(TM_TAG(tags_array->pdata[i]), fp, tm_tag_attr_type_t
-		  | tm_tag_attr_scope_t | tm_tag_attr_arglist_t | tm_tag_attr_vartype_t
-		  | tm_tag_attr_pointer_t);
-	}
+	status = tm_workspace_write_global_tags(source_file->tags_array, fp, TM_FILE_FORMAT_TAGMANAGER);
 	fclose(fp);
+	if (! status)
+		g_unlink(tags_file);
 	tm_source_file_free(source_file);
-	g_ptr_array_free(tags_array, TRUE);
-	return TRUE;
+	return status;
 }
 
 TMWorkObject *tm_workspace_find_object(TMWorkObject *work_object, const char *file_name
@@ -576,6 +575,9 @@ void tm_workspace_dump(void)
 	}
 }
 
+static void fill_find_project_tags_array(GPtrArray *dst, const char *name,
+		const char *scope, int type, gboolean partial, gint lang);
+
 const GPtrArray *tm_workspace_find(const char *name, int type, TMTagAttrType *attrs
  , gboolean partial, langType lang)
 {
@@ -623,6 +625,9 @@ const GPtrArray *tm_workspace_find(const char *name, int type, TMTagAttrType *at
 		}
 	}
 
+	/* tags of project files which aren't open */
+	fill_find_project_tags_array(tags, name, NULL, type, partial, lang);
+
 	/* global tags */
 	if (matches[1] && *matches[1])
 	{
@@ -713,6 +718,37 @@ fill_find_tags_array (GPtrArray *dst, const GPtrArray *src,
 }
 
 
+/* Adds the matching tags of the files of projects without a tags array (see
+ * tm_project_new_empty()), which are searched file by file. Inactive files are
+ * skipped, they are usually open and in the workspace tags array. */
+static void fill_find_project_tags_array(GPtrArray *dst, const char *name,
+		const char *scope, int type, gboolean partial, gint lang)
+{
+	guint i, j;
+
+	if (NULL == theWorkspace->work_objects)
+		return;
+	for (i = 0; i < theWorkspace->work_objects->len; ++i)
+	{
+		TMWorkObject *w = TM_WORK_OBJECT(theWorkspace->work_objects->pdata[i]);
+		GPtrArray *file_list;
+
+		/* the tags of projects with a tags array are in the workspace tags array */
+		if (!IS_TM_PROJECT(w) || (NULL != w->tags_array))
+			continue;
+		file_list = TM_PROJECT(w)->file_list;
+		for (j = 0; (NULL != file_list) && (j < file_list->len); ++j)
+		{
+			TMWorkObject *source_file = TM_WORK_OBJECT(file_list->pdata[j]);
+
+			if (!TM_SOURCE_FILE(source_file)->inactive)
+				fill_find_tags_array(dst, source_file->tags_array, name, scope, type,
+					partial, lang, FALSE);
+		}
+	}
+}
+
+
 /* adapted from tm_workspace_find, Anjuta 2.02 */
 const GPtrArray *
 tm_workspace_find_scoped (const char *name, const char *scope, gint type,
@@ -730,6 +766,7 @@ tm_workspace_find_scoped (const char *name, const char *scope, gint type,
 
 	fill_find_tags_array (tags, theWorkspace->work_object.tags_array,
 						  name, scope, type, partial, lang, FALSE);
+	fill_find_project_tags_array (tags, name, scope, type, partial, lang);
 	if (global_search)
 	{
 		/* for a scoped tag, I think we always want the same language */
@@ -92,6 +92,14 @@ gboolean tm_workspace_load_global_tags(const char *tags_file, gint mode);
 gboolean tm_workspace_create_global_tags(const char *pre_process, const char **includes,
     int includes_count, const char *tags_file, int lang);
 
+/* Writes tags sorted and without duplicates, the way they are stored in global tags files.
+ \param tags The tags to write, e.g. the tags of a source file. The array isn't modified.
+ \param fp The file to write to.
+ \param format The format of the tags file.
+ \return TRUE on success, FALSE if there were no tags or writing failed.
+*/
+gboolean tm_workspace_write_global_tags(GPtrArray *tags, FILE *fp, TMFileFormat format);
+
 /* Recreates the tag array of the workspace by collecting the tags of
  all member work objects. You shouldn't have to call this directly since
  this is called automatically by tm_workspace_update().
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# error out on undefined variable expansion, usful for debugging
+set -u
+
+# Parser performance regression check.
+# Parses the given sources repeatedly, then copies of them scaled up to SCALE bytes (to
+# catch parsers that are slow on large inputs), and writes the results of each language
+# to corpus.json and scaled.json in OUTDIR.
+# If BASELINE is a directory containing these files from an earlier run on the same
+# machine, fails when a parser got slower than THRESHOLD percent.
+
+# FIXME: get this from automake so we have $(EXEEXT)
+TMBENCH="${top_builddir:-../..}/tagmanager/src/tm-bench"
+OUTDIR="${OUTDIR:-.}"
+BASELINE="${BASELINE:-}"
+THRESHOLD="${THRESHOLD:-20}"
+SCALE="${SCALE:-1048576}"
+
+status=0
+
+run()
+{
+	name="$1"
+	shift
+	if [ -n "$BASELINE" ]; then
+		set -- --baseline="$BASELINE/$name.json" "$@"
+	fi
+	# see runner.sh for the language mappings
+	"$TMBENCH" --threshold="$THRESHOLD" --json="$OUTDIR/$name.json" \
+		--map=h=C --map=m=Matlab --map=mm=ObjectiveC "$@" || status=1
+}
+
+run corpus --repeat=20 "$@"
+run scaled --repeat=3 --scale="$SCALE" "$@"
+
+exit $status
@@ -3,23 +3,16 @@
 # error out on undefined variable expansion, usful for debugging
 set -u
 
-# FIXME: get this from automake so we have $(EXEEXT)
-GEANY="${top_builddir:-../..}/src/geany"
-TMPDIR=$(mktemp -d) || exit 99
-CONFDIR="$TMPDIR/config/"
-
-trap 'rm -rf "$TMPDIR"' EXIT
+# Runs all the given tests in a single tm-bench process: each argument is an expected
+# tags file, and its source file is the argument without the .tags extension.
+# tm-bench detects the language of a file from its extension like CTags does, so
+# map the extensions for which Geany's filetype detection differs.
 
-# make sure we don't use an old or modified system version of the filetype
-# related configuration files
-mkdir -p "$CONFDIR" || exit 99
-mkdir -p "$CONFDIR/filedefs/" || exit 99
-cp "${srcdir:-.}"/../../data/filetype_extensions.conf "$CONFDIR" || exit 99
-cp "${srcdir:-.}"/../../data/filetypes.* "$CONFDIR/filedefs/" || exit 99
-
-result="$1"
-source="${result%.*}"
-tagfile="$TMPDIR/test.${source##*.}.tags"
+# FIXME: get this from automake so we have $(EXEEXT)
+TMBENCH="${top_builddir:-../..}/tagmanager/src/tm-bench"
 
-"$GEANY" -c "$CONFDIR" -P -g "$tagfile" "$source" || exit 1
-diff -u "$result" "$tagfile" || exit 2
+exec "$TMBENCH" --check --quiet \
+	--map=h=C \
+	--map=m=Matlab \
+	--map=mm=ObjectiveC \
+	"$@"